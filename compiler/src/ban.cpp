@@ -60,12 +60,15 @@ bool Ban::acceptConnection(uint32_t clientip)
 
 bool IOBan::isAccountBanned(uint32_t accountId, BanInfo& banInfo)
 {
-	Database* db = Database::getInstance();
+	return isAccountBanned(*Database::getInstance(), accountId, banInfo);
+}
 
+bool IOBan::isAccountBanned(Database& db, uint32_t accountId, BanInfo& banInfo)
+{
 	std::ostringstream query;
 	query << "SELECT `reason`, `expires_at`, `banned_at`, `banned_by`, (SELECT `name` FROM `players` WHERE `id` = `banned_by`) AS `name` FROM `account_bans` WHERE `account_id` = " << accountId;
 
-	DBResult_ptr result = db->storeQuery(query.str());
+	DBResult_ptr result = db.storeQuery(query.str());
 	if (!result) {
 		return false;
 	}
@@ -74,12 +77,12 @@ bool IOBan::isAccountBanned(uint32_t accountId, BanInfo& banInfo)
 	if (expiresAt != 0 && time(nullptr) > expiresAt) {
 		// Move the ban to history if it has expired
 		query.str(std::string());
-		query << "INSERT INTO `account_ban_history` (`account_id`, `reason`, `banned_at`, `expired_at`, `banned_by`) VALUES (" << accountId << ',' << db->escapeString(result->getString("reason")) << ',' << result->getNumber<time_t>("banned_at") << ',' << expiresAt << ',' << result->getNumber<uint32_t>("banned_by") << ')';
-		g_databaseTasks.addTask(query.str());
+		query << "INSERT INTO `account_ban_history` (`account_id`, `reason`, `banned_at`, `expired_at`, `banned_by`) VALUES (" << accountId << ',' << db.escapeString(result->getString("reason")) << ',' << result->getNumber<time_t>("banned_at") << ',' << expiresAt << ',' << result->getNumber<uint32_t>("banned_by") << ')';
+		g_databaseTasks.addTask(accountId, query.str());
 
 		query.str(std::string());
 		query << "DELETE FROM `account_bans` WHERE `account_id` = " << accountId;
-		g_databaseTasks.addTask(query.str());
+		g_databaseTasks.addTask(accountId, query.str());
 		return false;
 	}
 
@@ -120,8 +123,13 @@ bool IOBan::isIpBanned(uint32_t clientip, BanInfo& banInfo)
 }
 
 bool IOBan::isPlayerNamelocked(uint32_t playerId)
+{
+	return isPlayerNamelocked(*Database::getInstance(), playerId);
+}
+
+bool IOBan::isPlayerNamelocked(Database& db, uint32_t playerId)
 {
 	std::ostringstream query;
 	query << "SELECT 1 FROM `player_namelocks` WHERE `player_id` = " << playerId;
-	return Database::getInstance()->storeQuery(query.str()).get() != nullptr;
+	return db.storeQuery(query.str()).get() != nullptr;
 }
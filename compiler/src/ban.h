@@ -20,6 +20,8 @@
 #ifndef FS_BAN_H_CADB975222D745F0BDA12D982F1006E3
 #define FS_BAN_H_CADB975222D745F0BDA12D982F1006E3
 
+class Database;
+
 struct BanInfo {
 	std::string bannedBy;
 	std::string reason;
@@ -51,8 +53,10 @@ class IOBan
 {
 	public:
 		static bool isAccountBanned(uint32_t accountId, BanInfo& banInfo);
+		static bool isAccountBanned(Database& db, uint32_t accountId, BanInfo& banInfo);
 		static bool isIpBanned(uint32_t ip, BanInfo& banInfo);
 		static bool isPlayerNamelocked(uint32_t playerId);
+		static bool isPlayerNamelocked(Database& db, uint32_t playerId);
 };
 
 #endif
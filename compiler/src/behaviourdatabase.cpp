@@ -26,27 +26,19 @@
 #include "spells.h"
 #include "monster.h"
 #include "scheduler.h"
+#include "fileloader.h"
 
 extern Game g_game;
 extern Monsters g_monsters;
 extern Spells* g_spells;
 
-BehaviourDatabase::BehaviourDatabase(Npc * _npc) : npc(_npc) {
-	topic = 0;
-	data = -1;
-	type = 0;
-	price = 0;
-	amount = 0;
-	delay = 1000;
-}
-
-BehaviourDatabase::~BehaviourDatabase() {
-	for (NpcBehaviour* behaviour : behaviourEntries) {
-		delete behaviour;
-	}
+BehaviourProgram::BehaviourProgram()
+{
+	// string 0 is the empty one
+	addString("");
 }
 
-bool BehaviourDatabase::loadDatabase(ScriptReader& script)
+bool BehaviourProgram::loadDatabase(ScriptReader& script)
 {
 	script.readSymbol('{');
 	script.nextToken();
@@ -64,112 +56,131 @@ bool BehaviourDatabase::loadDatabase(ScriptReader& script)
 		}
 	}
 
+	// store the behaviours in the order they are tried
+	std::vector<NpcBehaviour> sorted;
+	sorted.reserve(order.size());
+	for (uint32_t index : order) {
+		sorted.push_back(behaviours[index]);
+	}
+	behaviours.swap(sorted);
+
+	std::unordered_map<std::string, uint32_t>().swap(stringIndex);
+	std::vector<uint32_t>().swap(order);
+
+	behaviours.shrink_to_fit();
+	conditions.shrink_to_fit();
+	actions.shrink_to_fit();
+	nodes.shrink_to_fit();
+	strings.shrink_to_fit();
 	return true;
 }
 
-bool BehaviourDatabase::loadBehaviour(ScriptReader& script)
+bool BehaviourProgram::loadBehaviour(ScriptReader& script)
 {
-	NpcBehaviour* behaviour = new NpcBehaviour();
+	uint32_t index = behaviours.size();
+	behaviours.emplace_back();
 
+	NpcBehaviour& behaviour = behaviours.back();
+	behaviour.firstCondition = conditions.size();
 	if (!loadConditions(script, behaviour)) {
 		return false;
 	}
 
 	if (script.Token != SPECIAL || script.getSpecial() != 'I') {
 		script.error("'->' expected");
-		delete behaviour;
 		return false;
 	}
 
 	script.nextToken();
+	behaviour.firstAction = actions.size();
 	if (!loadActions(script, behaviour)) {
-		delete behaviour;
 		return false;
 	}
 
 	// set this behaviour priority to condition size
-	behaviour->priority += behaviour->conditions.size();
+	behaviour.priority += behaviour.conditionCount;
 
-	if (priorityBehaviour) {
-		priorityBehaviour->priority += behaviour->priority + 1;
-		priorityBehaviour = nullptr;
+	if (priorityBehaviour != BEHAVIOUR_NODE_NONE) {
+		behaviours[priorityBehaviour].priority += behaviour.priority + 1;
+		priorityBehaviour = BEHAVIOUR_NODE_NONE;
 	}
 
 	// order it correctly
-	auto it = std::lower_bound(behaviourEntries.begin(), behaviourEntries.end(), behaviour, compareBehaviour);
-	behaviourEntries.insert(it, behaviour);
+	auto it = std::lower_bound(order.begin(), order.end(), index, [this](uint32_t left, uint32_t right) {
+		return behaviours[left].priority >= behaviours[right].priority;
+	});
+	order.insert(it, index);
 
 	// set previous behaviour (*) functionality
-	previousBehaviour = behaviour;
+	previousBehaviour = index;
 	return true;
 }
 
-bool BehaviourDatabase::loadConditions(ScriptReader& script, NpcBehaviour* behaviour)
+bool BehaviourProgram::loadConditions(ScriptReader& script, NpcBehaviour& behaviour)
 {
 	while (true) {
-		std::unique_ptr<NpcBehaviourCondition> condition(new NpcBehaviourCondition);
+		NpcBehaviourCondition condition;
 
 		bool searchTerm = false;
 		if (script.Token == IDENTIFIER) {
 			std::string identifier = script.getIdentifier();
 			if (identifier == "address") {
-				condition->situation = SITUATION_ADDRESS;
-				behaviour->situation = SITUATION_ADDRESS;
+				behaviour.situation = SITUATION_ADDRESS;
 				searchTerm = true;
 			} else if (identifier == "busy") {
-				condition->situation = SITUATION_BUSY;
-				behaviour->situation = SITUATION_BUSY;
+				behaviour.situation = SITUATION_BUSY;
 				searchTerm = true;
 			} else if (identifier == "vanish") {
-				condition->situation = SITUATION_VANISH;
-				behaviour->situation = SITUATION_VANISH;
+				behaviour.situation = SITUATION_VANISH;
 				searchTerm = true;
 			} else if (identifier == "sorcerer") {
-				condition->type = BEHAVIOUR_TYPE_SORCERER;
+				condition.type = BEHAVIOUR_TYPE_SORCERER;
 				searchTerm = true;
 			} else if (identifier == "knight") {
-				condition->type = BEHAVIOUR_TYPE_KNIGHT;
+				condition.type = BEHAVIOUR_TYPE_KNIGHT;
 				searchTerm = true;
 			} else if (identifier == "paladin") {
-				condition->type = BEHAVIOUR_TYPE_PALADIN;
+				condition.type = BEHAVIOUR_TYPE_PALADIN;
 				searchTerm = true;
 			} else if (identifier == "druid") {
-				condition->type = BEHAVIOUR_TYPE_DRUID;
+				condition.type = BEHAVIOUR_TYPE_DRUID;
 				searchTerm = true;
 			} else if (identifier == "premium") {
-				condition->type = BEHAVIOUR_TYPE_ISPREMIUM;
+				condition.type = BEHAVIOUR_TYPE_ISPREMIUM;
 				searchTerm = true;
 			} else if (identifier == "pvpenforced") {
-				condition->type = BEHAVIOUR_TYPE_PVPENFORCED;
+				condition.type = BEHAVIOUR_TYPE_PVPENFORCED;
 				searchTerm = true;
 			} else if (identifier == "female") {
-				condition->type = BEHAVIOUR_TYPE_FEMALE;
+				condition.type = BEHAVIOUR_TYPE_FEMALE;
 				searchTerm = true;
 			} else if (identifier == "male") {
-				condition->type = BEHAVIOUR_TYPE_MALE;
+				condition.type = BEHAVIOUR_TYPE_MALE;
 				searchTerm = true;
 			} else if (identifier == "pzblock") {
-				condition->type = BEHAVIOUR_TYPE_PZLOCKED;
+				condition.type = BEHAVIOUR_TYPE_PZLOCKED;
 				searchTerm = true;
 			} else if (identifier == "promoted") {
-				condition->type = BEHAVIOUR_TYPE_PROMOTED;
+				condition.type = BEHAVIOUR_TYPE_PROMOTED;
 				searchTerm = true;
 			}
 		} else if (script.Token == STRING) {
 			const std::string keyString = asLowerCaseString(script.getString());
-			condition->setCondition(BEHAVIOUR_TYPE_STRING, 0, keyString);
-			behaviour->priority += keyString.length();
+			condition.type = BEHAVIOUR_TYPE_STRING;
+			condition.string = addString(keyString);
+			behaviour.priority += keyString.length();
 
 			searchTerm = true;
 		} else if (script.Token == SPECIAL) {
 			if (script.getSpecial() == '!') {
-				condition->setCondition(BEHAVIOUR_TYPE_NOP, 0, "");
+				condition.type = BEHAVIOUR_TYPE_NOP;
 				searchTerm = true;
 
 				// set this one for behaviour
-				priorityBehaviour = behaviour;
+				priorityBehaviour = behaviours.size() - 1;
 			} else if (script.getSpecial() == '%') {
-				condition->setCondition(BEHAVIOUR_TYPE_MESSAGE_COUNT, script.readNumber(), "");
+				condition.type = BEHAVIOUR_TYPE_MESSAGE_COUNT;
+				condition.number = script.readNumber();
 				searchTerm = true;
 			} else if (script.getSpecial() == ',') {
 				script.nextToken();
@@ -181,14 +192,13 @@ bool BehaviourDatabase::loadConditions(ScriptReader& script, NpcBehaviour* behav
 
 		// relational operation search
 		if (!searchTerm) {
-			condition->type = BEHAVIOUR_TYPE_OPERATION;
-			NpcBehaviourNode* headNode = readValue(script);
-			NpcBehaviourNode* nextNode = readFactor(script, headNode);
+			condition.type = BEHAVIOUR_TYPE_OPERATION;
+			uint32_t headNode = readValue(script);
+			uint32_t nextNode = readFactor(script, headNode);
 
 			// relational operators
 			if (script.Token != SPECIAL) {
 				script.error("relational operator expected");
-				delete nextNode;
 				return false;
 			}
 
@@ -214,124 +224,123 @@ bool BehaviourDatabase::loadConditions(ScriptReader& script, NpcBehaviour* behav
 				break;
 			default:
 				script.error("relational operator expected");
-				delete nextNode;
 				return false;
 			}
 
 			script.nextToken();
-			headNode = new NpcBehaviourNode();
-			headNode->type = BEHAVIOUR_TYPE_OPERATION;
-			headNode->number = operatorType;
-			headNode->left = nextNode;
-			nextNode = readValue(script);
-			nextNode = readFactor(script, nextNode);
-			headNode->right = nextNode;
-
-			condition->expression = headNode;
+			uint32_t rightNode = readValue(script);
+			rightNode = readFactor(script, rightNode);
+
+			headNode = addNode(BEHAVIOUR_TYPE_OPERATION, operatorType);
+			nodes[headNode].left = nextNode;
+			nodes[headNode].right = rightNode;
+
+			condition.expression = headNode;
 		} else {
 			script.nextToken();
 		}
 
-		behaviour->conditions.push_back(condition.release());
+		conditions.push_back(condition);
+		++behaviour.conditionCount;
 	}
 
 	return true;
 }
 
-bool BehaviourDatabase::loadActions(ScriptReader& script, NpcBehaviour* behaviour)
+bool BehaviourProgram::loadActions(ScriptReader& script, NpcBehaviour& behaviour)
 {
 	while (true) {
-		std::unique_ptr<NpcBehaviourAction> action(new NpcBehaviourAction);
+		NpcBehaviourAction action;
 		NpcBehaviourParameterSearch_t searchType = BEHAVIOUR_PARAMETER_NONE;
 
 		if (script.Token == STRING) {
-			action->type = BEHAVIOUR_TYPE_STRING;
-			action->string = script.getString();
+			action.type = BEHAVIOUR_TYPE_STRING;
+			action.string = addString(script.getString());
 		} else if (script.Token == IDENTIFIER) {
 			std::string identifier = script.getIdentifier();
 			if (identifier == "idle") {
-				action->type = BEHAVIOUR_TYPE_IDLE;
+				action.type = BEHAVIOUR_TYPE_IDLE;
 			} else if (identifier == "nop") {
-				action->type = BEHAVIOUR_TYPE_NOP;
+				action.type = BEHAVIOUR_TYPE_NOP;
 			} else if (identifier == "queue") {
-				action->type = BEHAVIOUR_TYPE_QUEUE;
+				action.type = BEHAVIOUR_TYPE_QUEUE;
 			} else if (identifier == "createmoney") {
-				action->type = BEHAVIOUR_TYPE_CREATEMONEY;
+				action.type = BEHAVIOUR_TYPE_CREATEMONEY;
 			} else if (identifier == "deletemoney") {
-				action->type = BEHAVIOUR_TYPE_DELETEMONEY;
+				action.type = BEHAVIOUR_TYPE_DELETEMONEY;
 			} else if (identifier == "promote") {
-				action->type = BEHAVIOUR_TYPE_PROMOTE;
+				action.type = BEHAVIOUR_TYPE_PROMOTE;
 			} else if (identifier == "topic") {
-				action->type = BEHAVIOUR_TYPE_TOPIC;
+				action.type = BEHAVIOUR_TYPE_TOPIC;
 				searchType = BEHAVIOUR_PARAMETER_ASSIGN;
 			} else if (identifier == "price") {
-				action->type = BEHAVIOUR_TYPE_PRICE;
+				action.type = BEHAVIOUR_TYPE_PRICE;
 				searchType = BEHAVIOUR_PARAMETER_ASSIGN;
 			} else if (identifier == "amount") {
-				action->type = BEHAVIOUR_TYPE_AMOUNT;
+				action.type = BEHAVIOUR_TYPE_AMOUNT;
 				searchType = BEHAVIOUR_PARAMETER_ASSIGN;
 			} else if (identifier == "data") {
-				action->type = BEHAVIOUR_TYPE_DATA;
+				action.type = BEHAVIOUR_TYPE_DATA;
 				searchType = BEHAVIOUR_PARAMETER_ASSIGN;
 			} else if (identifier == "type") {
-				action->type = BEHAVIOUR_TYPE_ITEM;
+				action.type = BEHAVIOUR_TYPE_ITEM;
 				searchType = BEHAVIOUR_PARAMETER_ASSIGN;
 			} else if (identifier == "string") {
-				action->type = BEHAVIOUR_TYPE_TEXT;
+				action.type = BEHAVIOUR_TYPE_TEXT;
 				searchType = BEHAVIOUR_PARAMETER_ASSIGN;
 			} else if (identifier == "hp") {
-				action->type = BEHAVIOUR_TYPE_HEALTH;
+				action.type = BEHAVIOUR_TYPE_HEALTH;
 				searchType = BEHAVIOUR_PARAMETER_ASSIGN;
 			} else if (identifier == "withdraw") {
-				action->type = BEHAVIOUR_TYPE_WITHDRAW;
+				action.type = BEHAVIOUR_TYPE_WITHDRAW;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "deposit") {
-				action->type = BEHAVIOUR_TYPE_DEPOSIT;
+				action.type = BEHAVIOUR_TYPE_DEPOSIT;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "bless") {
-				action->type = BEHAVIOUR_TYPE_BLESS;
+				action.type = BEHAVIOUR_TYPE_BLESS;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "effectme") {
-				action->type = BEHAVIOUR_TYPE_EFFECTME;
+				action.type = BEHAVIOUR_TYPE_EFFECTME;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "effectopp") {
-				action->type = BEHAVIOUR_TYPE_EFFECTOPP;
+				action.type = BEHAVIOUR_TYPE_EFFECTOPP;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "create") {
-				action->type = BEHAVIOUR_TYPE_CREATE;
+				action.type = BEHAVIOUR_TYPE_CREATE;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "delete") {
-				action->type = BEHAVIOUR_TYPE_DELETE;
+				action.type = BEHAVIOUR_TYPE_DELETE;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "teachspell") {
-				action->type = BEHAVIOUR_TYPE_TEACHSPELL;
+				action.type = BEHAVIOUR_TYPE_TEACHSPELL;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "town") {
-				action->type = BEHAVIOUR_TYPE_TOWN;
+				action.type = BEHAVIOUR_TYPE_TOWN;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "profession") {
-				action->type = BEHAVIOUR_TYPE_PROFESSION;
+				action.type = BEHAVIOUR_TYPE_PROFESSION;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "experience") {
-				action->type = BEHAVIOUR_TYPE_EXPERIENCE;
+				action.type = BEHAVIOUR_TYPE_EXPERIENCE;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "summon") {
-				action->type = BEHAVIOUR_TYPE_SUMMON;
+				action.type = BEHAVIOUR_TYPE_SUMMON;
 				searchType = BEHAVIOUR_PARAMETER_ONE;
 			} else if (identifier == "burning") {
-				action->type = BEHAVIOUR_TYPE_BURNING;
+				action.type = BEHAVIOUR_TYPE_BURNING;
 				searchType = BEHAVIOUR_PARAMETER_TWO;
 			} else if (identifier == "setquestvalue") {
-				action->type = BEHAVIOUR_TYPE_QUESTVALUE;
+				action.type = BEHAVIOUR_TYPE_QUESTVALUE;
 				searchType = BEHAVIOUR_PARAMETER_TWO;
 			} else if (identifier == "poison") {
-				action->type = BEHAVIOUR_TYPE_POISON;
+				action.type = BEHAVIOUR_TYPE_POISON;
 				searchType = BEHAVIOUR_PARAMETER_TWO;
 			} else if (identifier == "teleport") {
-				action->type = BEHAVIOUR_TYPE_TELEPORT;
+				action.type = BEHAVIOUR_TYPE_TELEPORT;
 				searchType = BEHAVIOUR_PARAMETER_THREE;
 			} else if (identifier == "createcontainer") {
-				action->type = BEHAVIOUR_TYPE_CREATECONTAINER;
+				action.type = BEHAVIOUR_TYPE_CREATECONTAINER;
 				searchType = BEHAVIOUR_PARAMETER_THREE;
 			} else {
 				script.error("illegal action term");
@@ -339,13 +348,17 @@ bool BehaviourDatabase::loadActions(ScriptReader& script, NpcBehaviour* behaviou
 			}
 		} else if (script.Token == SPECIAL) {
 			if (script.getSpecial() == '*') {
-				if (previousBehaviour == nullptr) {
+				if (previousBehaviour == BEHAVIOUR_NODE_NONE) {
 					script.error("no previous pattern");
 					return false;
 				}
 
-				for (NpcBehaviourAction* actionCopy : previousBehaviour->actions) {
-					behaviour->actions.push_back(actionCopy->clone());
+				// the expressions are immutable, the copies share them
+				const NpcBehaviour& previous = behaviours[previousBehaviour];
+				for (uint32_t i = 0; i < previous.actionCount; ++i) {
+					NpcBehaviourAction copy = actions[previous.firstAction + i];
+					actions.push_back(copy);
+					++behaviour.actionCount;
 				}
 				script.nextToken();
 				return true;
@@ -355,15 +368,15 @@ bool BehaviourDatabase::loadActions(ScriptReader& script, NpcBehaviour* behaviou
 		if (searchType == BEHAVIOUR_PARAMETER_ASSIGN) {
 			script.readSymbol('=');
 			script.nextToken();
-			NpcBehaviourNode* headNode = readValue(script);
-			NpcBehaviourNode* nextNode = readFactor(script, headNode);
-			action->expression = nextNode;
+			uint32_t headNode = readValue(script);
+			uint32_t nextNode = readFactor(script, headNode);
+			action.expression = nextNode;
 		} else if (searchType == BEHAVIOUR_PARAMETER_ONE) {
 			script.readSymbol('(');
 			script.nextToken();
-			NpcBehaviourNode* headNode = readValue(script);
-			NpcBehaviourNode* nextNode = readFactor(script, headNode);
-			action->expression = nextNode;
+			uint32_t headNode = readValue(script);
+			uint32_t nextNode = readFactor(script, headNode);
+			action.expression = nextNode;
 			if (script.Token != SPECIAL || script.getSpecial() != ')') {
 				script.error("')' expected");
 				return false;
@@ -372,9 +385,9 @@ bool BehaviourDatabase::loadActions(ScriptReader& script, NpcBehaviour* behaviou
 		} else if (searchType == BEHAVIOUR_PARAMETER_TWO) {
 			script.readSymbol('(');
 			script.nextToken();
-			NpcBehaviourNode* headNode = readValue(script);
-			NpcBehaviourNode* nextNode = readFactor(script, headNode);
-			action->expression = nextNode;
+			uint32_t headNode = readValue(script);
+			uint32_t nextNode = readFactor(script, headNode);
+			action.expression = nextNode;
 			if (script.Token != SPECIAL || script.getSpecial() != ',') {
 				script.error("',' expected");
 				return false;
@@ -382,7 +395,7 @@ bool BehaviourDatabase::loadActions(ScriptReader& script, NpcBehaviour* behaviou
 			script.nextToken();
 			headNode = readValue(script);
 			nextNode = readFactor(script, headNode);
-			action->expression2 = nextNode;
+			action.expression2 = nextNode;
 			if (script.Token != SPECIAL || script.getSpecial() != ')') {
 				script.error("')' expected");
 				return false;
@@ -391,9 +404,9 @@ bool BehaviourDatabase::loadActions(ScriptReader& script, NpcBehaviour* behaviou
 		} else if (searchType == BEHAVIOUR_PARAMETER_THREE) {
 			script.readSymbol('(');
 			script.nextToken();
-			NpcBehaviourNode* headNode = readValue(script);
-			NpcBehaviourNode* nextNode = readFactor(script, headNode);
-			action->expression = nextNode;
+			uint32_t headNode = readValue(script);
+			uint32_t nextNode = readFactor(script, headNode);
+			action.expression = nextNode;
 			if (script.Token != SPECIAL || script.getSpecial() != ',') {
 				script.error("',' expected");
 				return false;
@@ -401,7 +414,7 @@ bool BehaviourDatabase::loadActions(ScriptReader& script, NpcBehaviour* behaviou
 			script.nextToken();
 			headNode = readValue(script);
 			nextNode = readFactor(script, headNode);
-			action->expression2 = nextNode;
+			action.expression2 = nextNode;
 			if (script.Token != SPECIAL || script.getSpecial() != ',') {
 				script.error("',' expected");
 				return false;
@@ -409,7 +422,7 @@ bool BehaviourDatabase::loadActions(ScriptReader& script, NpcBehaviour* behaviou
 			script.nextToken();
 			headNode = readValue(script);
 			nextNode = readFactor(script, headNode);
-			action->expression3 = nextNode;
+			action.expression3 = nextNode;
 			if (script.Token != SPECIAL || script.getSpecial() != ')') {
 				script.error("')' expected");
 				return false;
@@ -419,7 +432,8 @@ bool BehaviourDatabase::loadActions(ScriptReader& script, NpcBehaviour* behaviou
 			script.nextToken();
 		}
 
-		behaviour->actions.push_back(action.release());
+		actions.push_back(action);
+		++behaviour.actionCount;
 
 		if (script.Token == SPECIAL) {
 			if (script.getSpecial() == ',') {
@@ -434,20 +448,16 @@ bool BehaviourDatabase::loadActions(ScriptReader& script, NpcBehaviour* behaviou
 	return true;
 }
 
-NpcBehaviourNode* BehaviourDatabase::readValue(ScriptReader& script)
+uint32_t BehaviourProgram::readValue(ScriptReader& script)
 {
 	if (script.Token == NUMBER) {
-		NpcBehaviourNode* node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_NUMBER;
-		node->number = script.getNumber();
+		uint32_t node = addNode(BEHAVIOUR_TYPE_NUMBER, script.getNumber());
 		script.nextToken();
 		return node;
 	}
 
 	if (script.Token == STRING) {
-		NpcBehaviourNode* node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_STRING;
-		node->string = asLowerCaseString(script.getString());
+		uint32_t node = addNode(BEHAVIOUR_TYPE_STRING, 0, addString(asLowerCaseString(script.getString())));
 		script.nextToken();
 		return node;
 	}
@@ -455,113 +465,92 @@ NpcBehaviourNode* BehaviourDatabase::readValue(ScriptReader& script)
 	if (script.Token == SPECIAL) {
 		if (script.getSpecial() != '%') {
 			script.error("illegal character");
-			return nullptr;
+			return BEHAVIOUR_NODE_NONE;
 		}
 
-		NpcBehaviourNode* node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_MESSAGE_COUNT;
-		node->number = script.readNumber();
+		uint32_t node = addNode(BEHAVIOUR_TYPE_MESSAGE_COUNT, script.readNumber());
 		script.nextToken();
 		return node;
 	}
 
-	NpcBehaviourNode* node = nullptr;
+	uint32_t node = BEHAVIOUR_NODE_NONE;
 	NpcBehaviourParameterSearch_t searchType = BEHAVIOUR_PARAMETER_NONE;
 
 	std::string identifier = script.getIdentifier();
 	if (identifier == "topic") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_TOPIC;
+		node = addNode(BEHAVIOUR_TYPE_TOPIC);
 	} else if (identifier == "price") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_PRICE;
+		node = addNode(BEHAVIOUR_TYPE_PRICE);
 	} else if (identifier == "type") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_ITEM;
+		node = addNode(BEHAVIOUR_TYPE_ITEM);
 	} else if (identifier == "string") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_TEXT;
+		node = addNode(BEHAVIOUR_TYPE_TEXT);
 	} else if (identifier == "data") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_DATA;
+		node = addNode(BEHAVIOUR_TYPE_DATA);
 	} else if (identifier == "amount") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_AMOUNT;
+		node = addNode(BEHAVIOUR_TYPE_AMOUNT);
 	} else if (identifier == "countmoney") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_COUNTMONEY;
+		node = addNode(BEHAVIOUR_TYPE_COUNTMONEY);
 	} else if (identifier == "hp") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_HEALTH;
+		node = addNode(BEHAVIOUR_TYPE_HEALTH);
 	} else if (identifier == "burning") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_BURNING;
+		node = addNode(BEHAVIOUR_TYPE_BURNING);
 	} else if (identifier == "level") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_LEVEL;
+		node = addNode(BEHAVIOUR_TYPE_LEVEL);
 	} else if (identifier == "magiclevel") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_MAGICLEVEL;
+		node = addNode(BEHAVIOUR_TYPE_MAGICLEVEL);
 	} else if (identifier == "poison") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_POISON;
+		node = addNode(BEHAVIOUR_TYPE_POISON);
 	} else if (identifier == "balance") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_BALANCE;
+		node = addNode(BEHAVIOUR_TYPE_BALANCE);
 	} else if (identifier == "spellknown") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_SPELLKNOWN;
+		node = addNode(BEHAVIOUR_TYPE_SPELLKNOWN);
 		searchType = BEHAVIOUR_PARAMETER_ONE;
 	} else if (identifier == "spelllevel") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_SPELLLEVEL;
+		node = addNode(BEHAVIOUR_TYPE_SPELLLEVEL);
 		searchType = BEHAVIOUR_PARAMETER_ONE;
 	} else if (identifier == "spellmagiclevel") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_SPELLMAGICLEVEL;
+		node = addNode(BEHAVIOUR_TYPE_SPELLMAGICLEVEL);
 		searchType = BEHAVIOUR_PARAMETER_ONE;
 	} else if (identifier == "questvalue") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_QUESTVALUE;
+		node = addNode(BEHAVIOUR_TYPE_QUESTVALUE);
 		searchType = BEHAVIOUR_PARAMETER_ONE;
 	} else if (identifier == "count") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_COUNT;
+		node = addNode(BEHAVIOUR_TYPE_COUNT);
 		searchType = BEHAVIOUR_PARAMETER_ONE;
 	} else if (identifier == "random") {
-		node = new NpcBehaviourNode();
-		node->type = BEHAVIOUR_TYPE_RANDOM;
+		node = addNode(BEHAVIOUR_TYPE_RANDOM);
 		searchType = BEHAVIOUR_PARAMETER_TWO;
 	}
 
 	if (searchType == BEHAVIOUR_PARAMETER_ONE) {
 		script.readSymbol('(');
 		script.nextToken();
-		NpcBehaviourNode* nextNode = readValue(script);
+		uint32_t nextNode = readValue(script);
 		nextNode = readFactor(script, nextNode);
-		node->left = nextNode;
+		nodes[node].left = nextNode;
 		if (script.Token != SPECIAL || script.getSpecial() != ')') {
 			script.error("')' expected");
 		}
 	} else if (searchType == BEHAVIOUR_PARAMETER_TWO) {
 		script.readSymbol('(');
 		script.nextToken();
-		NpcBehaviourNode* nextNode = readValue(script);
+		uint32_t nextNode = readValue(script);
 		nextNode = readFactor(script, nextNode);
-		node->left = nextNode;
+		nodes[node].left = nextNode;
 		if (script.Token != SPECIAL || script.getSpecial() != ',') {
 			script.error("',' expected");
 		}
 		script.nextToken();
 		nextNode = readValue(script);
 		nextNode = readFactor(script, nextNode);
-		node->right = nextNode;
+		nodes[node].right = nextNode;
 		if (script.Token != SPECIAL || script.getSpecial() != ')') {
 			script.error("')' expected");
 		}
 	}
 
-	if (!node) {
+	if (node == BEHAVIOUR_NODE_NONE) {
 		script.error("unknown value");
 	}
 
@@ -569,7 +558,7 @@ NpcBehaviourNode* BehaviourDatabase::readValue(ScriptReader& script)
 	return node;
 }
 
-NpcBehaviourNode* BehaviourDatabase::readFactor(ScriptReader& script, NpcBehaviourNode* nextNode)
+uint32_t BehaviourProgram::readFactor(ScriptReader& script, uint32_t nextNode)
 {
 	// * operator
 	while (true) {
@@ -581,15 +570,13 @@ NpcBehaviourNode* BehaviourDatabase::readFactor(ScriptReader& script, NpcBehavio
 			break;
 		}
 
-		NpcBehaviourNode* headNode = new NpcBehaviourNode();
-		headNode->type = BEHAVIOUR_TYPE_OPERATION;
-		headNode->number = BEHAVIOUR_OPERATOR_MULTIPLY;
-		headNode->left = nextNode;
+		uint32_t headNode = addNode(BEHAVIOUR_TYPE_OPERATION, BEHAVIOUR_OPERATOR_MULTIPLY);
+		nodes[headNode].left = nextNode;
 
+		// indices stay valid while the node array grows
 		script.nextToken();
-		nextNode = readValue(script);
-
-		headNode->right = nextNode;
+		uint32_t rightNode = readValue(script);
+		nodes[headNode].right = rightNode;
 		nextNode = headNode;
 	}
 
@@ -603,47 +590,77 @@ NpcBehaviourNode* BehaviourDatabase::readFactor(ScriptReader& script, NpcBehavio
 			break;
 		}
 
-		NpcBehaviourNode* headNode = new NpcBehaviourNode();
-		headNode->type = BEHAVIOUR_TYPE_OPERATION;
-		headNode->number = BEHAVIOUR_OPERATOR_SUM;
+		uint32_t headNode = addNode(BEHAVIOUR_TYPE_OPERATION, BEHAVIOUR_OPERATOR_SUM);
 		if (script.getSpecial() == '-') {
-			headNode->number = BEHAVIOUR_OPERATOR_RES;
+			nodes[headNode].number = BEHAVIOUR_OPERATOR_RES;
 		}
 
-		headNode->left = nextNode;
+		nodes[headNode].left = nextNode;
 		script.nextToken();
-		nextNode = readValue(script);
-
-		headNode->right = nextNode;
+		uint32_t rightNode = readValue(script);
+		nodes[headNode].right = rightNode;
 		nextNode = headNode;
 	}
 
 	return nextNode;
 }
 
+uint32_t BehaviourProgram::addNode(NpcBehaviourType_t type, int32_t number/* = 0*/, uint32_t string/* = 0*/)
+{
+	NpcBehaviourNode node;
+	node.type = type;
+	node.number = number;
+	node.string = string;
+	nodes.push_back(node);
+	return nodes.size() - 1;
+}
+
+uint32_t BehaviourProgram::addString(const std::string& str)
+{
+	auto it = stringIndex.emplace(str, strings.size());
+	if (it.second) {
+		strings.push_back(str);
+	}
+	return it.first->second;
+}
+
+BehaviourDatabase::BehaviourDatabase(Npc* _npc, std::shared_ptr<const BehaviourProgram> _program) :
+	npc(_npc), program(std::move(_program))
+{
+	topic = 0;
+	data = -1;
+	type = 0;
+	price = 0;
+	amount = 0;
+	delay = 1000;
+}
+
 void BehaviourDatabase::react(BehaviourSituation_t situation, Player* player, const std::string& message)
 {
-	for (NpcBehaviour* behaviour : behaviourEntries) {
+	// conditions only look for words and digits, lower the message once for all of them
+	const std::string lowerMessage = asLowerCaseString(message);
+
+	for (const NpcBehaviour& behaviour : program->getBehaviours()) {
 		bool fulfilled = true;
 
-		if (situation == SITUATION_ADDRESS && behaviour->situation != SITUATION_ADDRESS) {
+		if (situation == SITUATION_ADDRESS && behaviour.situation != SITUATION_ADDRESS) {
 			continue;
 		}
 
-		if (situation == SITUATION_BUSY && behaviour->situation != SITUATION_BUSY) {
+		if (situation == SITUATION_BUSY && behaviour.situation != SITUATION_BUSY) {
 			continue;
 		}
 
-		if (situation == SITUATION_VANISH && behaviour->situation != SITUATION_VANISH) {
+		if (situation == SITUATION_VANISH && behaviour.situation != SITUATION_VANISH) {
 			continue;
 		}
 
-		if (situation == SITUATION_NONE && behaviour->situation != SITUATION_NONE) {
+		if (situation == SITUATION_NONE && behaviour.situation != SITUATION_NONE) {
 			continue;
 		}
 
-		for (const NpcBehaviourCondition* condition : behaviour->conditions) {
-			if (!checkCondition(condition, player, message)) {
+		for (uint32_t i = 0; i < behaviour.conditionCount; ++i) {
+			if (!checkCondition(program->getCondition(behaviour.firstCondition + i), player, lowerMessage)) {
 				fulfilled = false;
 				break;
 			}
@@ -668,27 +685,27 @@ void BehaviourDatabase::react(BehaviourSituation_t situation, Player* player, co
 			idle();
 		}
 
-		for (const NpcBehaviourAction* action : behaviour->actions) {
-			checkAction(action, player, message);
+		for (uint32_t i = 0; i < behaviour.actionCount; ++i) {
+			checkAction(program->getAction(behaviour.firstAction + i), player, message);
 		}
 
 		break;
 	}
 }
 
-bool BehaviourDatabase::checkCondition(const NpcBehaviourCondition* condition, Player* player, const std::string& message)
+bool BehaviourDatabase::checkCondition(const NpcBehaviourCondition& condition, Player* player, const std::string& message)
 {
-	switch (condition->type) {
+	switch (condition.type) {
 	case BEHAVIOUR_TYPE_NOP: break;
 	case BEHAVIOUR_TYPE_MESSAGE_COUNT: {
 		int32_t value = searchDigit(message);
-		if (value < condition->number) {
+		if (value < condition.number) {
 			return false;
 		}
 		break;
 	}
 	case BEHAVIOUR_TYPE_STRING:
-		if (!searchWord(condition->string, message)) {
+		if (!searchWord(program->getString(condition.string), message)) {
 			return false;
 		}
 		break;
@@ -746,7 +763,7 @@ bool BehaviourDatabase::checkCondition(const NpcBehaviourCondition* condition, P
 		break;
 	}
 	case BEHAVIOUR_TYPE_OPERATION:
-		return checkOperation(player, condition->expression, message) > 0;
+		return checkOperation(player, program->getNode(condition.expression), message) > 0;
 	case BEHAVIOUR_TYPE_SPELLKNOWN: {
 		if (!player->hasLearnedInstantSpell(string)) {
 			return false;
@@ -755,19 +772,19 @@ bool BehaviourDatabase::checkCondition(const NpcBehaviourCondition* condition, P
 		break;
 	}
 	default:
-		std::cout << "[Warning - BehaviourDatabase::react]: Unhandled node type " << condition->type << std::endl;
+		std::cout << "[Warning - BehaviourDatabase::react]: Unhandled node type " << condition.type << std::endl;
 		return false;
 	}
 
 	return true;
 }
 
-void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* player, const std::string& message)
+void BehaviourDatabase::checkAction(const NpcBehaviourAction& action, Player* player, const std::string& message)
 {
-	switch (action->type) {
+	switch (action.type) {
 	case BEHAVIOUR_TYPE_NOP: break;
 	case BEHAVIOUR_TYPE_STRING: {
-		delayedEvents.push_back(g_scheduler.addEvent(createSchedulerTask(delay, std::bind(&Npc::doSay, npc, parseResponse(player, action->string)))));
+		delayedEvents.push_back(g_scheduler.addEvent(createSchedulerTask(delay, std::bind(&Npc::doSay, npc, parseResponse(player, program->getString(action.string))))));
 		delay += 100 * (message.length() / 5) + 10000;
 		break;
 	}
@@ -778,25 +795,25 @@ void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* pl
 		queueCustomer(player->getID(), message);
 		break;
 	case BEHAVIOUR_TYPE_TOPIC:
-		topic = evaluate(action->expression, player, message);
+		topic = evaluate(action.expression, player, message);
 		break;
 	case BEHAVIOUR_TYPE_PRICE:
-		price = evaluate(action->expression, player, message);
+		price = evaluate(action.expression, player, message);
 		break;
 	case BEHAVIOUR_TYPE_DATA:
-		data = evaluate(action->expression, player, message);
+		data = evaluate(action.expression, player, message);
 		break;
 	case BEHAVIOUR_TYPE_ITEM:
-		type = evaluate(action->expression, player, message);
+		type = evaluate(action.expression, player, message);
 		break;
 	case BEHAVIOUR_TYPE_AMOUNT:
-		amount = evaluate(action->expression, player, message);
+		amount = evaluate(action.expression, player, message);
 		break;
 	case BEHAVIOUR_TYPE_TEXT:
-		string = action->expression->string;
+		string = program->getString(program->getNode(action.expression).string);
 		break;
 	case BEHAVIOUR_TYPE_HEALTH: {
-		int32_t newHealth = evaluate(action->expression, player, message);
+		int32_t newHealth = evaluate(action.expression, player, message);
 		player->changeHealth(-player->getHealth() + newHealth);
 		break;
 	}
@@ -807,7 +824,7 @@ void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* pl
 		g_game.removeMoney(player, price);
 		break;
 	case BEHAVIOUR_TYPE_CREATE: {
-		int32_t itemId = evaluate(action->expression, player, message);
+		int32_t itemId = evaluate(action.expression, player, message);
 		const ItemType& it = Item::items[itemId];
 
 		if (it.isRune()) {
@@ -871,7 +888,7 @@ void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* pl
 		break;
 	}
 	case BEHAVIOUR_TYPE_DELETE: {
-		type = evaluate(action->expression, player, message);
+		type = evaluate(action.expression, player, message);
 		const ItemType& itemType = Item::items[type];
 		if (itemType.stackable || !itemType.hasSubType()) {
 			data = -1;
@@ -883,14 +900,14 @@ void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* pl
 		break;
 	}
 	case BEHAVIOUR_TYPE_EFFECTME:
-		g_game.addMagicEffect(npc->getPosition(), evaluate(action->expression, player, message));
+		g_game.addMagicEffect(npc->getPosition(), evaluate(action.expression, player, message));
 		break;
 	case BEHAVIOUR_TYPE_EFFECTOPP:
-		g_game.addMagicEffect(player->getPosition(), evaluate(action->expression, player, message));
+		g_game.addMagicEffect(player->getPosition(), evaluate(action.expression, player, message));
 		break;
 	case BEHAVIOUR_TYPE_BURNING: {
-		const int32_t cycles = evaluate(action->expression, player, message);
-		const int32_t count = evaluate(action->expression2, player, message);
+		const int32_t cycles = evaluate(action.expression, player, message);
+		const int32_t count = evaluate(action.expression2, player, message);
 
 		if (cycles == 0) {
 			player->removeCondition(CONDITION_FIRE, true);
@@ -905,8 +922,8 @@ void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* pl
 		break;
 	}
 	case BEHAVIOUR_TYPE_POISON: {
-		const int32_t cycles = evaluate(action->expression, player, message);
-		const int32_t count = evaluate(action->expression2, player, message);
+		const int32_t cycles = evaluate(action.expression, player, message);
+		const int32_t count = evaluate(action.expression2, player, message);
 
 		if (cycles == 0) {
 			player->removeCondition(CONDITION_POISON, true);
@@ -921,27 +938,27 @@ void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* pl
 		break;
 	}
 	case BEHAVIOUR_TYPE_TOWN:
-		player->setTown(g_game.map.towns.getTown(evaluate(action->expression, player, message)));
+		player->setTown(g_game.map.towns.getTown(evaluate(action.expression, player, message)));
 		break;
 	case BEHAVIOUR_TYPE_TEACHSPELL:
 		player->learnInstantSpell(string);
 		break;
 	case BEHAVIOUR_TYPE_QUESTVALUE: {
-		int32_t questNumber = evaluate(action->expression, player, message);
-		int32_t questValue = evaluate(action->expression2, player, message);
+		int32_t questNumber = evaluate(action.expression, player, message);
+		int32_t questValue = evaluate(action.expression2, player, message);
 		player->addStorageValue(questNumber, questValue);
 		break;
 	}
 	case BEHAVIOUR_TYPE_TELEPORT: {
 		Position pos;
-		pos.x = evaluate(action->expression, player, message);
-		pos.y = evaluate(action->expression2, player, message);
-		pos.z = evaluate(action->expression3, player, message);
+		pos.x = evaluate(action.expression, player, message);
+		pos.y = evaluate(action.expression2, player, message);
+		pos.z = evaluate(action.expression3, player, message);
 		g_game.internalTeleport(player, pos);
 		break;
 	}
 	case BEHAVIOUR_TYPE_PROFESSION: {
-		int32_t newVocation = evaluate(action->expression, player, message);
+		int32_t newVocation = evaluate(action.expression, player, message);
 		player->setVocation(newVocation);
 		break;
 	}
@@ -952,7 +969,7 @@ void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* pl
 		break;
 	}
 	case BEHAVIOUR_TYPE_SUMMON: {
-		std::string name = action->expression->string;
+		const std::string& name = program->getString(program->getNode(action.expression).string);
 
 		Monster* monster = Monster::createMonster(name);
 		if (!monster) {
@@ -966,22 +983,22 @@ void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* pl
 		break;
 	}
 	case BEHAVIOUR_TYPE_EXPERIENCE: {
-		int32_t experience = evaluate(action->expression, player, message);
+		int32_t experience = evaluate(action.expression, player, message);
 		player->addExperience(experience, true, false);
 		break;
 	}
 	case BEHAVIOUR_TYPE_WITHDRAW: {
-		int32_t money = evaluate(action->expression, player, message);
+		int32_t money = evaluate(action.expression, player, message);
 		player->setBankBalance(player->getBankBalance() - money);
 		break;
 	}
 	case BEHAVIOUR_TYPE_DEPOSIT: {
-		int32_t money = evaluate(action->expression, player, message);
+		int32_t money = evaluate(action.expression, player, message);
 		player->setBankBalance(player->getBankBalance() + money);
 		break;
 	}
 	case BEHAVIOUR_TYPE_BLESS: {
-		uint8_t number = static_cast<uint8_t>(evaluate(action->expression, player, message)) - 1;
+		uint8_t number = static_cast<uint8_t>(evaluate(action.expression, player, message)) - 1;
 
 		if (!player->hasBlessing(number)) {
 			player->addBlessing(1 << number);
@@ -989,9 +1006,9 @@ void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* pl
 		break;
 	}
 	case BEHAVIOUR_TYPE_CREATECONTAINER: {
-		int32_t containerId = evaluate(action->expression, player, message);
-		int32_t itemId = evaluate(action->expression2, player, message);
-		int32_t data = evaluate(action->expression3, player, message);
+		int32_t containerId = evaluate(action.expression, player, message);
+		int32_t itemId = evaluate(action.expression2, player, message);
+		int32_t data = evaluate(action.expression3, player, message);
 
 		for (int32_t i = 0; i < std::max<int32_t>(1, amount); i++) {
 			Item* container = Item::CreateItem(containerId);
@@ -1021,16 +1038,17 @@ void BehaviourDatabase::checkAction(const NpcBehaviourAction* action, Player* pl
 		break;
 	}
 	default:
-		std::cout << "[Warning - BehaviourDatabase::checkAction]: Unhandled node type " << action->type << std::endl;
+		std::cout << "[Warning - BehaviourDatabase::checkAction]: Unhandled node type " << action.type << std::endl;
 		break;
 	}
 }
 
-int32_t BehaviourDatabase::evaluate(NpcBehaviourNode* node, Player* player, const std::string& message)
+int32_t BehaviourDatabase::evaluate(uint32_t index, Player* player, const std::string& message)
 {
-	switch (node->type) {
+	const NpcBehaviourNode& node = program->getNode(index);
+	switch (node.type) {
 	case BEHAVIOUR_TYPE_NUMBER:
-		return node->number;
+		return node.number;
 	case BEHAVIOUR_TYPE_TOPIC:
 		return topic;
 	case BEHAVIOUR_TYPE_PRICE:
@@ -1044,7 +1062,7 @@ int32_t BehaviourDatabase::evaluate(NpcBehaviourNode* node, Player* player, cons
 	case BEHAVIOUR_TYPE_HEALTH:
 		return player->getHealth();
 	case BEHAVIOUR_TYPE_COUNT: {
-		int32_t itemId = evaluate(node->left, player, message);
+		int32_t itemId = evaluate(node.left, player, message);
 		const ItemType& itemType = Item::items[itemId];
 		if (itemType.stackable || !itemType.hasSubType()) {
 			data = -1;
@@ -1084,19 +1102,19 @@ int32_t BehaviourDatabase::evaluate(NpcBehaviourNode* node, Player* player, cons
 	case BEHAVIOUR_TYPE_MAGICLEVEL:
 		return player->getMagicLevel();
 	case BEHAVIOUR_TYPE_RANDOM: {
-		int32_t min = evaluate(node->left, player, message);
-		int32_t max = evaluate(node->right, player, message);
+		int32_t min = evaluate(node.left, player, message);
+		int32_t max = evaluate(node.right, player, message);
 		return normal_random(min, max);
 	}
 	case BEHAVIOUR_TYPE_QUESTVALUE: {
-		int32_t questNumber = evaluate(node->left, player, message);
+		int32_t questNumber = evaluate(node.left, player, message);
 		int32_t questValue;
 		player->getStorageValue(questNumber, questValue);
 		return questValue;
 	}
 	case BEHAVIOUR_TYPE_MESSAGE_COUNT: {
 		int32_t value = searchDigit(message);
-		if (value < node->number) {
+		if (value < node.number) {
 			return false;
 		}
 		return value;
@@ -1115,7 +1133,7 @@ int32_t BehaviourDatabase::evaluate(NpcBehaviourNode* node, Player* player, cons
 	case BEHAVIOUR_TYPE_SPELLLEVEL: {
 		InstantSpell* spell = g_spells->getInstantSpellByName(string);
 		if (!spell) {
-			std::cout << "[Warning - BehaviourDatabase::evaluate]: SpellLevel unknown spell " << node->string << std::endl;
+			std::cout << "[Warning - BehaviourDatabase::evaluate]: SpellLevel unknown spell " << program->getString(node.string) << std::endl;
 			return std::numeric_limits<int32_t>::max();
 		}
 
@@ -1124,25 +1142,25 @@ int32_t BehaviourDatabase::evaluate(NpcBehaviourNode* node, Player* player, cons
 	case BEHAVIOUR_TYPE_SPELLMAGICLEVEL: {
 		InstantSpell* spell = g_spells->getInstantSpellByName(string);
 		if (!spell) {
-			std::cout << "[Warning - BehaviourDatabase::evaluate]: SpellMagicLevel unknown spell " << node->string << std::endl;
+			std::cout << "[Warning - BehaviourDatabase::evaluate]: SpellMagicLevel unknown spell " << program->getString(node.string) << std::endl;
 			return std::numeric_limits<int32_t>::max();
 		}
 
 		return spell->getMagicLevel();
 	}
 	default:
-		std::cout << "[Warning - BehaviourDatabase::evaluate]: Unhandled node type " << node->type << std::endl;
+		std::cout << "[Warning - BehaviourDatabase::evaluate]: Unhandled node type " << node.type << std::endl;
 		break;
 	}
 
 	return false;
 }
 
-int32_t BehaviourDatabase::checkOperation(Player* player, NpcBehaviourNode* node, const std::string& message)
+int32_t BehaviourDatabase::checkOperation(Player* player, const NpcBehaviourNode& node, const std::string& message)
 {
-	int32_t leftResult = evaluate(node->left, player, message);
-	int32_t rightResult = evaluate(node->right, player, message);
-	switch (node->number) {
+	int32_t leftResult = evaluate(node.left, player, message);
+	int32_t rightResult = evaluate(node.right, player, message);
+	switch (node.number) {
 	case BEHAVIOUR_OPERATOR_LESSER_THAN:
 		return leftResult < rightResult;
 	case BEHAVIOUR_OPERATOR_EQUALS:
@@ -1216,26 +1234,18 @@ bool BehaviourDatabase::searchWord(const std::string& pattern, const std::string
 		wholeWord = true;
 	}
 
-	std::string newPattern = pattern.substr(0, len);
-	std::string actualMessage = asLowerCaseString(message);
-
-	if (actualMessage.find(newPattern) == std::string::npos) {
+	size_t wordPos = message.find(pattern.data(), 0, len);
+	if (wordPos == std::string::npos) {
 		return false;
 	}
 
 	if (wholeWord) {
-		size_t wordPos = actualMessage.find(newPattern);
-		size_t wordEnd = wordPos + newPattern.length() - 1;
-
-		if (wordEnd + 1 > actualMessage.length()) {
-			return false;
-		}
-
-		if (wordEnd + 1 == actualMessage.length()) {
+		size_t wordEnd = wordPos + len;
+		if (wordEnd == message.length()) {
 			return true;
 		}
 
-		if (!isspace(actualMessage[wordEnd + 1])) {
+		if (!isspace(message[wordEnd])) {
 			return false;
 		}
 	}
@@ -1333,10 +1343,149 @@ void BehaviourDatabase::reset()
 	delayedEvents.clear();
 }
 
-bool NpcBehaviourCondition::setCondition(NpcBehaviourType_t _type, int32_t _number, const std::string & _string)
+void BehaviourProgram::serialize(PropWriteStream& propWriteStream) const
 {
-	type = _type;
-	number = _number;
-	string = _string;
-	return false;
+	propWriteStream.write<uint32_t>(behaviours.size());
+	for (const NpcBehaviour& behaviour : behaviours) {
+		propWriteStream.write<uint8_t>(behaviour.situation);
+		propWriteStream.write<uint32_t>(behaviour.priority);
+		propWriteStream.write<uint32_t>(behaviour.firstCondition);
+		propWriteStream.write<uint32_t>(behaviour.conditionCount);
+		propWriteStream.write<uint32_t>(behaviour.firstAction);
+		propWriteStream.write<uint32_t>(behaviour.actionCount);
+	}
+
+	propWriteStream.write<uint32_t>(conditions.size());
+	for (const NpcBehaviourCondition& condition : conditions) {
+		propWriteStream.write<uint8_t>(condition.type);
+		propWriteStream.write<int32_t>(condition.number);
+		propWriteStream.write<uint32_t>(condition.string);
+		propWriteStream.write<uint32_t>(condition.expression);
+	}
+
+	propWriteStream.write<uint32_t>(actions.size());
+	for (const NpcBehaviourAction& action : actions) {
+		propWriteStream.write<uint8_t>(action.type);
+		propWriteStream.write<uint32_t>(action.string);
+		propWriteStream.write<uint32_t>(action.expression);
+		propWriteStream.write<uint32_t>(action.expression2);
+		propWriteStream.write<uint32_t>(action.expression3);
+	}
+
+	propWriteStream.write<uint32_t>(nodes.size());
+	for (const NpcBehaviourNode& node : nodes) {
+		propWriteStream.write<uint8_t>(node.type);
+		propWriteStream.write<int32_t>(node.number);
+		propWriteStream.write<uint32_t>(node.string);
+		propWriteStream.write<uint32_t>(node.left);
+		propWriteStream.write<uint32_t>(node.right);
+	}
+
+	propWriteStream.write<uint32_t>(strings.size());
+	for (const std::string& str : strings) {
+		propWriteStream.writeString(str);
+	}
+}
+
+bool BehaviourProgram::unserialize(PropStream& propStream)
+{
+	uint32_t count;
+	if (!propStream.read<uint32_t>(count)) {
+		return false;
+	}
+
+	behaviours.resize(count);
+	for (NpcBehaviour& behaviour : behaviours) {
+		uint8_t situation;
+		if (!propStream.read<uint8_t>(situation) || !propStream.read<uint32_t>(behaviour.priority) ||
+			!propStream.read<uint32_t>(behaviour.firstCondition) || !propStream.read<uint32_t>(behaviour.conditionCount) ||
+			!propStream.read<uint32_t>(behaviour.firstAction) || !propStream.read<uint32_t>(behaviour.actionCount)) {
+			return false;
+		}
+		behaviour.situation = static_cast<BehaviourSituation_t>(situation);
+	}
+
+	if (!propStream.read<uint32_t>(count)) {
+		return false;
+	}
+
+	conditions.resize(count);
+	for (NpcBehaviourCondition& condition : conditions) {
+		uint8_t type;
+		if (!propStream.read<uint8_t>(type) || !propStream.read<int32_t>(condition.number) ||
+			!propStream.read<uint32_t>(condition.string) || !propStream.read<uint32_t>(condition.expression)) {
+			return false;
+		}
+		condition.type = static_cast<NpcBehaviourType_t>(type);
+	}
+
+	if (!propStream.read<uint32_t>(count)) {
+		return false;
+	}
+
+	actions.resize(count);
+	for (NpcBehaviourAction& action : actions) {
+		uint8_t type;
+		if (!propStream.read<uint8_t>(type) || !propStream.read<uint32_t>(action.string) || !propStream.read<uint32_t>(action.expression) ||
+			!propStream.read<uint32_t>(action.expression2) || !propStream.read<uint32_t>(action.expression3)) {
+			return false;
+		}
+		action.type = static_cast<NpcBehaviourType_t>(type);
+	}
+
+	if (!propStream.read<uint32_t>(count)) {
+		return false;
+	}
+
+	nodes.resize(count);
+	for (NpcBehaviourNode& node : nodes) {
+		uint8_t type;
+		if (!propStream.read<uint8_t>(type) || !propStream.read<int32_t>(node.number) || !propStream.read<uint32_t>(node.string) ||
+			!propStream.read<uint32_t>(node.left) || !propStream.read<uint32_t>(node.right)) {
+			return false;
+		}
+		node.type = static_cast<NpcBehaviourType_t>(type);
+	}
+
+	if (!propStream.read<uint32_t>(count)) {
+		return false;
+	}
+
+	strings.resize(count);
+	for (std::string& str : strings) {
+		if (!propStream.readString(str)) {
+			return false;
+		}
+	}
+
+	// every index must point inside the program, the cache is not trusted blindly
+	auto validNode = [this](uint32_t index) {
+		return index == BEHAVIOUR_NODE_NONE || index < nodes.size();
+	};
+
+	for (const NpcBehaviour& behaviour : behaviours) {
+		if (behaviour.firstCondition + static_cast<uint64_t>(behaviour.conditionCount) > conditions.size() ||
+			behaviour.firstAction + static_cast<uint64_t>(behaviour.actionCount) > actions.size()) {
+			return false;
+		}
+	}
+
+	for (const NpcBehaviourCondition& condition : conditions) {
+		if (condition.string >= strings.size() || !validNode(condition.expression)) {
+			return false;
+		}
+	}
+
+	for (const NpcBehaviourAction& action : actions) {
+		if (action.string >= strings.size() || !validNode(action.expression) || !validNode(action.expression2) || !validNode(action.expression3)) {
+			return false;
+		}
+	}
+
+	for (const NpcBehaviourNode& node : nodes) {
+		if (node.string >= strings.size() || !validNode(node.left) || !validNode(node.right)) {
+			return false;
+		}
+	}
+	return !strings.empty();
 }
@@ -113,117 +113,48 @@ enum NpcBehaviourParameterSearch_t
 
 class Npc;
 class Player;
+class PropStream;
+class PropWriteStream;
 
+static constexpr uint32_t BEHAVIOUR_NODE_NONE = std::numeric_limits<uint32_t>::max();
+
+// Nodes, conditions and actions refer to each other by index into their
+// program and strings are interned, so a parsed behaviour database is a few
+// flat arrays that every npc created from the same script shares.
 struct NpcBehaviourNode
 {
-	NpcBehaviourType_t type;
-	int32_t number;
-	std::string string;
-	NpcBehaviourNode* left;
-	NpcBehaviourNode* right;
-
-	NpcBehaviourNode() : type(), number(0), left(nullptr), right(nullptr) { }
-	~NpcBehaviourNode() {
-		delete left;
-		delete right;
-	}
-
-	NpcBehaviourNode* clone() {
-		NpcBehaviourNode* copy = new NpcBehaviourNode();
-		copy->type = type;
-		copy->number = number;
-		copy->string = string;
-		if (left) {
-			copy->left = left->clone();
-		}
-		if (right) {
-			copy->right = right->clone();
-		}
-		return copy;
-	}
+	NpcBehaviourType_t type = BEHAVIOUR_TYPE_NOP;
+	int32_t number = 0;
+	uint32_t string = 0;
+	uint32_t left = BEHAVIOUR_NODE_NONE;
+	uint32_t right = BEHAVIOUR_NODE_NONE;
 };
 
 struct NpcBehaviourCondition
 {
-	NpcBehaviourType_t type;
-	BehaviourSituation_t situation;
-	std::string string;
-	int32_t number;
-	NpcBehaviourNode* expression;
-
-	NpcBehaviourCondition() : type(), situation(SITUATION_NONE), string(), number(0), expression(nullptr) {}
-	~NpcBehaviourCondition() {
-		delete expression;
-	}
-
-	//non-copyable
-	NpcBehaviourCondition(const NpcBehaviourCondition&) = delete;
-	NpcBehaviourCondition& operator=(const NpcBehaviourCondition&) = delete;
-
-	bool setCondition(NpcBehaviourType_t _type, int32_t _number, const std::string& _string);
+	NpcBehaviourType_t type = BEHAVIOUR_TYPE_NOP;
+	int32_t number = 0;
+	uint32_t string = 0;
+	uint32_t expression = BEHAVIOUR_NODE_NONE;
 };
 
 struct NpcBehaviourAction
 {
-	NpcBehaviourType_t type;
-	std::string string;
-	int32_t number;
-	NpcBehaviourNode* expression;
-	NpcBehaviourNode* expression2;
-	NpcBehaviourNode* expression3;
-
-	NpcBehaviourAction() :
-		type(),
-		string(),
-		number(0),
-		expression(nullptr),
-		expression2(nullptr),
-		expression3(nullptr) {}
-	~NpcBehaviourAction() {
-		delete expression;
-		delete expression2;
-		delete expression3;
-	}
-
-	NpcBehaviourAction* clone() {
-		NpcBehaviourAction* copy = new NpcBehaviourAction();
-		copy->type = type;
-		copy->string = string;
-		copy->number = number;
-		if (expression) {
-			copy->expression = expression->clone();
-		}
-		if (expression2) {
-			copy->expression2 = expression2->clone();
-		}
-		if (expression3) {
-			copy->expression3 = expression3->clone();
-		}
-		return copy;
-	}
+	NpcBehaviourType_t type = BEHAVIOUR_TYPE_NOP;
+	uint32_t string = 0;
+	uint32_t expression = BEHAVIOUR_NODE_NONE;
+	uint32_t expression2 = BEHAVIOUR_NODE_NONE;
+	uint32_t expression3 = BEHAVIOUR_NODE_NONE;
 };
 
 struct NpcBehaviour
 {
 	BehaviourSituation_t situation = SITUATION_NONE;
 	uint32_t priority = 0;
-	std::vector<NpcBehaviourCondition*> conditions;
-	std::vector<NpcBehaviourAction*> actions;
-
-	NpcBehaviour() = default;
-	~NpcBehaviour() {
-		for (auto condition : conditions) {
-			delete condition;
-		}
-
-		for (auto action : actions) {
-			delete action;
-		}
-	}
-
-	//non-copyable
-	NpcBehaviour(const NpcBehaviour&) = delete;
-	NpcBehaviour& operator=(const NpcBehaviour&) = delete;
+	uint32_t firstCondition = 0;
+	uint32_t conditionCount = 0;
+	uint32_t firstAction = 0;
+	uint32_t actionCount = 0;
 };
 
 struct NpcQueueEntry
@@ -232,38 +163,82 @@ struct NpcQueueEntry
 	std::string text;
 };
 
-class BehaviourDatabase
+class BehaviourProgram
 {
 	public:
-		BehaviourDatabase(Npc* _npc);
-		~BehaviourDatabase();
+		BehaviourProgram();
 
 		// non-copyable
-		BehaviourDatabase(const BehaviourDatabase&) = delete;
-		BehaviourDatabase& operator=(const BehaviourDatabase&) = delete;
+		BehaviourProgram(const BehaviourProgram&) = delete;
+		BehaviourProgram& operator=(const BehaviourProgram&) = delete;
 
 		bool loadDatabase(ScriptReader& script);
-		bool loadBehaviour(ScriptReader& script);
-		bool loadConditions(ScriptReader& script, NpcBehaviour* behaviour);
-		bool loadActions(ScriptReader& script, NpcBehaviour* behaviour);
-		NpcBehaviourNode* readValue(ScriptReader& script);
-		NpcBehaviourNode* readFactor(ScriptReader& script, NpcBehaviourNode* nextNode);
 
-		void react(BehaviourSituation_t situation, Player* player, const std::string& message);
+		void serialize(PropWriteStream& propWriteStream) const;
+		bool unserialize(PropStream& propStream);
 
-		static bool compareBehaviour(const NpcBehaviour* left, const NpcBehaviour* right) {
-			return left->priority >= right->priority;
+		// in the order they are tried
+		const std::vector<NpcBehaviour>& getBehaviours() const {
+			return behaviours;
+		}
+		const NpcBehaviourCondition& getCondition(uint32_t index) const {
+			return conditions[index];
 		}
+		const NpcBehaviourAction& getAction(uint32_t index) const {
+			return actions[index];
+		}
+		const NpcBehaviourNode& getNode(uint32_t index) const {
+			return nodes[index];
+		}
+		const std::string& getString(uint32_t index) const {
+			return strings[index];
+		}
+
+	private:
+		bool loadBehaviour(ScriptReader& script);
+		bool loadConditions(ScriptReader& script, NpcBehaviour& behaviour);
+		bool loadActions(ScriptReader& script, NpcBehaviour& behaviour);
+		uint32_t readValue(ScriptReader& script);
+		uint32_t readFactor(ScriptReader& script, uint32_t nextNode);
+
+		uint32_t addNode(NpcBehaviourType_t type, int32_t number = 0, uint32_t string = 0);
+		uint32_t addString(const std::string& str);
+
+		std::vector<NpcBehaviour> behaviours;
+		std::vector<NpcBehaviourCondition> conditions;
+		std::vector<NpcBehaviourAction> actions;
+		std::vector<NpcBehaviourNode> nodes;
+		std::vector<std::string> strings;
+
+		// only used while loading
+		std::unordered_map<std::string, uint32_t> stringIndex;
+		std::vector<uint32_t> order;
+		uint32_t previousBehaviour = BEHAVIOUR_NODE_NONE;
+		uint32_t priorityBehaviour = BEHAVIOUR_NODE_NONE;
+};
+
+// the conversation state of one npc, the behaviours come from its program
+class BehaviourDatabase
+{
+	public:
+		BehaviourDatabase(Npc* _npc, std::shared_ptr<const BehaviourProgram> _program);
+
+		// non-copyable
+		BehaviourDatabase(const BehaviourDatabase&) = delete;
+		BehaviourDatabase& operator=(const BehaviourDatabase&) = delete;
+
+		void react(BehaviourSituation_t situation, Player* player, const std::string& message);
 
 	private:
 
-		bool checkCondition(const NpcBehaviourCondition* condition, Player* player, const std::string& message);
-		void checkAction(const NpcBehaviourAction* action, Player* player, const std::string& message);
+		bool checkCondition(const NpcBehaviourCondition& condition, Player* player, const std::string& message);
+		void checkAction(const NpcBehaviourAction& action, Player* player, const std::string& message);
 
-		int32_t evaluate(NpcBehaviourNode* node, Player* player, const std::string& message = "");
+		int32_t evaluate(uint32_t index, Player* player, const std::string& message = "");
 
-		int32_t checkOperation(Player* player, NpcBehaviourNode* node, const std::string& message);
+		int32_t checkOperation(Player* player, const NpcBehaviourNode& node, const std::string& message);
 		int32_t searchDigit(const std::string& message);
+		// message is already lower case
 		bool searchWord(const std::string& pattern, const std::string& message);
 
 		std::string parseResponse(Player* player, const std::string& message);
@@ -282,12 +257,10 @@ class BehaviourDatabase
 		std::string string;
 
 		Npc* npc = nullptr;
-		NpcBehaviour* previousBehaviour = nullptr;
-		NpcBehaviour* priorityBehaviour = nullptr;
+		std::shared_ptr<const BehaviourProgram> program;
 
 		std::list<NpcQueueEntry> queueList;
 		std::vector<uint32_t> delayedEvents;
-		std::list<NpcBehaviour*> behaviourEntries;
 		std::recursive_mutex mutex;
 
 };
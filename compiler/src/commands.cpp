@@ -35,8 +35,12 @@
 #include "scheduler.h"
 
 #include "pugicast.h"
+#include "script.h"
+#include "rsa.h"
+#include "xtea.h"
 
 extern ConfigManager g_config;
+extern RSA g_RSA;
 extern Actions* g_actions;
 extern Monsters g_monsters;
 extern TalkActions* g_talkActions;
@@ -54,6 +58,7 @@ s_defcommands Commands::defined_commands[] = {
 	//admin commands
 	{"/reload", &Commands::reloadInfo},
 	{"/raid", &Commands::forceRaid},
+	{"/benchmark", &Commands::benchmark},
 
 	// player commands
 	{"!sellhouse", &Commands::sellHouse}
@@ -326,3 +331,34 @@ void Commands::forceRaid(Player& player, const std::string& param)
 
 	player.sendTextMessage(MESSAGE_STATUS_CONSOLE_BLUE, "Raid started.");
 }
+
+void Commands::benchmark(Player& player, const std::string& param)
+{
+	std::vector<std::string> params = explodeString(param, " ");
+	std::string type = asLowerCaseString(params.front());
+	uint32_t iterations = 0;
+	if (params.size() > 1) {
+		iterations = std::max<int32_t>(0, atoi(params[1].c_str()));
+	}
+
+	std::string result;
+	if (type == "spectators") {
+		result = g_game.map.benchmarkSpectators(player.getPosition(), iterations != 0 ? iterations : 100000);
+	} else if (type == "path") {
+		result = g_game.map.benchmarkPathfinding(player, iterations != 0 ? iterations : 10000);
+	} else if (type == "mapdescription") {
+		result = player.benchmarkMapDescription(iterations != 0 ? iterations : 10000);
+	} else if (type == "scripts") {
+		result = ScriptReader::benchmark(iterations != 0 ? iterations : 10);
+	} else if (type == "rsa") {
+		result = g_RSA.benchmark(iterations != 0 ? iterations : 1000);
+	} else if (type == "xtea") {
+		result = xtea::benchmark(iterations != 0 ? iterations : 200);
+	} else {
+		player.sendTextMessage(MESSAGE_STATUS_CONSOLE_BLUE, "Benchmark type not found.");
+		return;
+	}
+
+	std::cout << "> Benchmark " << type << ":" << std::endl << result;
+	player.sendTextMessage(MESSAGE_STATUS_CONSOLE_BLUE, result);
+}
@@ -47,6 +47,7 @@ class Commands
 		void reloadInfo(Player& player, const std::string& param);
 		void sellHouse(Player& player, const std::string& param);
 		void forceRaid(Player& player, const std::string& param);
+		void benchmark(Player& player, const std::string& param);
 
 		//table of commands
 		static s_defcommands defined_commands[];
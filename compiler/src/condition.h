@@ -273,6 +273,9 @@ class ConditionDamage final : public Condition
 		bool setParam(ConditionParam_t param, int32_t value) final;
 
 		int32_t getTotalDamage() const;
+		int32_t getHitDamage() const {
+			return hit_damage;
+		}
 
 		//serialization
 		void serialize(PropWriteStream& propWriteStream) final;
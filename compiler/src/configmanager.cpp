@@ -60,9 +60,12 @@ bool ConfigManager::load()
 		string[MYSQL_SOCK] = getGlobalString(L, "mysqlSock", "");
 
 		integer[SQL_PORT] = getGlobalNumber(L, "mysqlPort", 3306);
+		integer[DATABASE_WORKERS] = getGlobalNumber(L, "databaseWorkers", 2);
 		integer[GAME_PORT] = getGlobalNumber(L, "gameProtocolPort", 7172);
 		integer[LOGIN_PORT] = getGlobalNumber(L, "loginProtocolPort", 7171);
 		integer[STATUS_PORT] = getGlobalNumber(L, "statusProtocolPort", 7171);
+		integer[NETWORK_THREADS] = getGlobalNumber(L, "networkThreads", 0);
+		integer[MAP_LOADER_THREADS] = getGlobalNumber(L, "mapLoaderThreads", 0);
 	}
 
 	boolean[SHOW_MONSTER_LOOT] = getGlobalBoolean(L, "showMonsterLoot", true);
@@ -91,6 +94,8 @@ bool ConfigManager::load()
 	boolean[FIRST_PAY_RENT_ON_FINAL_BID] = getGlobalBoolean(L, "firstPayRentOnFinalBid", false);
 	boolean[ATTACKERPARTYENTERPZ] = getGlobalBoolean(L, "attackerPartyEnterPz", false);
 	boolean[MEMBERSAFESKULLGUILD] = getGlobalBoolean(L, "memberSafeSkullGuild", false);
+	boolean[TICK_LOOP] = getGlobalBoolean(L, "tickLoop", false);
+	boolean[MAP_CHECKSUM] = getGlobalBoolean(L, "mapChecksum", false);
 
 	string[DEFAULT_PRIORITY] = getGlobalString(L, "defaultPriority", "high");
 	string[SERVER_NAME] = getGlobalString(L, "serverName", "");
@@ -128,6 +133,8 @@ bool ConfigManager::load()
 	integer[STAIRHOP_DELAY] = getGlobalNumber(L, "stairJumpExhaustion", 2000);
 	integer[EXP_FROM_PLAYERS_LEVEL_RANGE] = getGlobalNumber(L, "expFromPlayersLevelRange", 75);
 	integer[MAX_PACKETS_PER_SECOND] = getGlobalNumber(L, "maxPacketsPerSecond", 25);
+	integer[MAX_PENDING_LOGINS] = getGlobalNumber(L, "maxPendingLogins", 100);
+	integer[OUTPUT_FLUSH_BUDGET] = getGlobalNumber(L, "outputFlushBudget", 32768);
 	integer[NEWBIE_TOWN] = getGlobalNumber(L, "newbieTownId", 1);
 	integer[NEWBIE_LEVEL_THRESHOLD] = getGlobalNumber(L, "newbieLevelThreshold", 5);
 	integer[MONEY_RATE] = getGlobalNumber(L, "moneyRate", 1);
@@ -137,6 +144,7 @@ bool ConfigManager::load()
 	integer[TICKS_REGEN_BED_GAIN] = getGlobalNumber(L, "ticksRegenBedGain", 30);
 	integer[RATE_NUTRITION_BED] = getGlobalNumber(L, "rateNutritionBed", 1);
 	integer[BAN_ACCOUNT_FROM_BID_DAY] = getGlobalNumber(L, "daysBanAccountFromBid", 0);
+	integer[TICK_LOOP_INTERVAL] = getGlobalNumber(L, "tickLoopInterval", 50);
 
 	//config.lua: ignoreMonsters = {"dog", "etc...", "etc...} only lowercase!
 	listConfigs[IGNORE_MONSTER_RADIUS] = loadLuaTable(L, "ignoreMonsters");
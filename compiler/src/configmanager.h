@@ -58,6 +58,8 @@ class ConfigManager
 			FIRST_PAY_RENT_ON_FINAL_BID,
 			ATTACKERPARTYENTERPZ,
 			MEMBERSAFESKULLGUILD,
+			TICK_LOOP,
+			MAP_CHECKSUM,
 
 			LAST_BOOLEAN_CONFIG /* this must be the last one */
 		};
@@ -126,6 +128,12 @@ class ConfigManager
 			TICKS_REGEN_BED_GAIN,
 			RATE_NUTRITION_BED,
 			BAN_ACCOUNT_FROM_BID_DAY,
+			TICK_LOOP_INTERVAL,
+			DATABASE_WORKERS,
+			MAX_PENDING_LOGINS,
+			NETWORK_THREADS,
+			OUTPUT_FLUSH_BUDGET,
+			MAP_LOADER_THREADS,
 
 			LAST_INTEGER_CONFIG /* this must be the last one */
 		};
@@ -28,12 +28,6 @@
 #include "scheduler.h"
 #include "server.h"
 
-#if BOOST_VERSION >= 107000
-#define GET_IO_SERVICE(s) ((boost::asio::io_context&)(s).get_executor().context())
-#else
-#define GET_IO_SERVICE(s) ((s).get_io_service())
-#endif
-
 extern ConfigManager g_config;
 
 Connection_ptr ConnectionManager::createConnection(boost::asio::io_service& io_service, ConstServicePort_ptr servicePort)
@@ -52,17 +46,27 @@ void ConnectionManager::releaseConnection(const Connection_ptr& connection)
 	connections.erase(connection);
 }
 
+ConnectionQueueStats ConnectionManager::getQueueStats()
+{
+	std::lock_guard<std::mutex> lockClass(connectionManagerLock);
+
+	ConnectionQueueStats stats;
+	stats.connections = connections.size();
+	for (const auto& connection : connections) {
+		const uint32_t bytes = connection->getQueuedBytes();
+		stats.queuedMessages += connection->getQueuedMessages();
+		stats.queuedBytes += bytes;
+		stats.maxQueuedBytes = std::max(stats.maxQueuedBytes, bytes);
+	}
+	return stats;
+}
+
 void ConnectionManager::closeAll()
 {
 	std::lock_guard<std::mutex> lockClass(connectionManagerLock);
 
 	for (const auto& connection : connections) {
-		try {
-			boost::system::error_code error;
-			connection->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
-			connection->socket.close(error);
-		} catch (boost::system::system_error&) {
-		}
+		connection->strand.post(std::bind(&Connection::closeSocket, connection));
 	}
 	connections.clear();
 }
@@ -72,9 +76,13 @@ void ConnectionManager::closeAll()
 void Connection::close(bool force)
 {
 	//any thread
+	if (!strand.running_in_this_thread()) {
+		strand.post(std::bind(&Connection::close, shared_from_this(), force));
+		return;
+	}
+
 	ConnectionManager::getInstance().releaseConnection(shared_from_this());
 
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
 	if (connectionState != CONNECTION_STATE_OPEN) {
 		return;
 	}
@@ -85,7 +93,7 @@ void Connection::close(bool force)
 			createTask(std::bind(&Protocol::release, protocol)));
 	}
 
-	if (messageQueue.empty() || force) {
+	if (writeBatch.empty() || force) {
 		closeSocket();
 	} else {
 		//will be closed by the destructor or onWriteOperation
@@ -122,15 +130,20 @@ void Connection::accept(Protocol_ptr protocol)
 
 void Connection::accept()
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
+	if (!strand.running_in_this_thread()) {
+		auto self = shared_from_this();
+		strand.post([self]() { self->accept(); });
+		return;
+	}
+
 	try {
 		readTimer.expires_from_now(boost::posix_time::seconds(CONNECTION_READ_TIMEOUT));
-		readTimer.async_wait(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()), std::placeholders::_1));
+		readTimer.async_wait(strand.wrap(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()), std::placeholders::_1)));
 
 		// Read size of the first packet
 		boost::asio::async_read(socket,
 		                        boost::asio::buffer(msg.getBuffer(), NetworkMessage::HEADER_LENGTH),
-		                        std::bind(&Connection::parseHeader, shared_from_this(), std::placeholders::_1));
+		                        strand.wrap(std::bind(&Connection::parseHeader, shared_from_this(), std::placeholders::_1)));
 	} catch (boost::system::system_error& e) {
 		std::cout << "[Network error - Connection::accept] " << e.what() << std::endl;
 		close(FORCE_CLOSE);
@@ -139,7 +152,6 @@ void Connection::accept()
 
 void Connection::parseHeader(const boost::system::error_code& error)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
 	readTimer.cancel();
 
 	if (error) {
@@ -173,13 +185,13 @@ void Connection::parseHeader(const boost::system::error_code& error)
 
 	try {
 		readTimer.expires_from_now(boost::posix_time::seconds(CONNECTION_READ_TIMEOUT));
-		readTimer.async_wait(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
-		                                    std::placeholders::_1));
+		readTimer.async_wait(strand.wrap(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
+		                                    std::placeholders::_1)));
 
 		// Read packet content
 		msg.setLength(size + NetworkMessage::HEADER_LENGTH);
 		boost::asio::async_read(socket, boost::asio::buffer(msg.getBodyBuffer(), size),
-		                        std::bind(&Connection::parsePacket, shared_from_this(), std::placeholders::_1));
+		                        strand.wrap(std::bind(&Connection::parsePacket, shared_from_this(), std::placeholders::_1)));
 	} catch (boost::system::system_error& e) {
 		std::cout << "[Network error - Connection::parseHeader] " << e.what() << std::endl;
 		close(FORCE_CLOSE);
@@ -188,7 +200,6 @@ void Connection::parseHeader(const boost::system::error_code& error)
 
 void Connection::parsePacket(const boost::system::error_code& error)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
 	readTimer.cancel();
 
 	if (error) {
@@ -220,13 +231,13 @@ void Connection::parsePacket(const boost::system::error_code& error)
 
 	try {
 		readTimer.expires_from_now(boost::posix_time::seconds(CONNECTION_READ_TIMEOUT));
-		readTimer.async_wait(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
-		                                    std::placeholders::_1));
+		readTimer.async_wait(strand.wrap(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
+		                                    std::placeholders::_1)));
 
 		// Wait to the next packet
 		boost::asio::async_read(socket,
 		                        boost::asio::buffer(msg.getBuffer(), NetworkMessage::HEADER_LENGTH),
-		                        std::bind(&Connection::parseHeader, shared_from_this(), std::placeholders::_1));
+		                        strand.wrap(std::bind(&Connection::parseHeader, shared_from_this(), std::placeholders::_1)));
 	} catch (boost::system::system_error& e) {
 		std::cout << "[Network error - Connection::parsePacket] " << e.what() << std::endl;
 		close(FORCE_CLOSE);
@@ -235,91 +246,187 @@ void Connection::parsePacket(const boost::system::error_code& error)
 
 void Connection::send(const OutputMessage_ptr& msg)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
+	//any thread
+	if (!strand.running_in_this_thread()) {
+		strand.post(std::bind(&Connection::send, shared_from_this(), msg));
+		return;
+	}
+
 	if (connectionState != CONNECTION_STATE_OPEN) {
 		return;
 	}
 
-	bool noPendingWrite = messageQueue.empty();
-	messageQueue.emplace_back(msg);
-	if (noPendingWrite) {
-		internalSend(msg);
+	// frames received before this message must not be overtaken by it
+	if (frameBatch) {
+		enqueueFrameBatch();
+	}
+	enqueue(msg);
+
+	// anything queued while a write is in flight goes out with the next one
+	if (writeBatch.empty()) {
+		internalSend();
 	}
 }
 
-void Connection::internalSend(const OutputMessage_ptr& msg)
+void Connection::sendFrame(const ConstOutputMessage_ptr& frame)
 {
-	if (msg->isBroadcastMsg()) {
-		dispatchBroadcastMessage(msg);
+	//any thread
+	if (!strand.running_in_this_thread()) {
+		strand.post(std::bind(&Connection::sendFrame, shared_from_this(), frame));
+		return;
+	}
+
+	if (connectionState != CONNECTION_STATE_OPEN) {
+		return;
+	}
+
+	// every spectator has its own XTEA key, so the shared frame is copied
+	// once into a message of this connection and encrypted there
+	if (frameBatch && frameBatch->getLength() + frame->getLength() > NetworkMessage::MAX_PROTOCOL_BODY_LENGTH) {
+		enqueueFrameBatch();
+	}
+	if (!frameBatch) {
+		frameBatch = OutputMessagePool::getOutputMessage();
+	}
+	frameBatch->append(*frame);
+
+	// while a write is in flight the batch keeps growing, onWriteOperation
+	// queues it
+	if (writeBatch.empty()) {
+		enqueueFrameBatch();
+		internalSend();
+	}
+}
+
+void Connection::enqueue(OutputMessage_ptr msg)
+{
+	queuedMessages.fetch_add(1, std::memory_order_relaxed);
+	const uint32_t backlog = queuedBytes.fetch_add(msg->getLength(), std::memory_order_relaxed) + msg->getLength();
+	if (backlog >= CONNECTION_BACKLOG_WARNING && !backlogReported) {
+		backlogReported = true;
+		std::cout << "[Network warning] " << convertIPToString(ip) << " has " << getQueuedMessages() << " messages (" << backlog << " bytes) waiting to be sent." << std::endl;
+	}
+	messageQueue.emplace_back(std::move(msg));
+}
+
+void Connection::enqueueFrameBatch()
+{
+	enqueue(std::move(frameBatch));
+	frameBatch = nullptr;
+}
+
+void Connection::internalSend()
+{
+	// gather as much of the queue as fits into one write
+	while (!messageQueue.empty()) {
+		const OutputMessage_ptr& msg = messageQueue.front();
+		if (!writeBatch.empty() && writeBatchBytes + msg->getLength() > CONNECTION_MAX_WRITE_BYTES) {
+			break;
+		}
+
+		if (msg->isBroadcastMsg()) {
+			broadcastMessage(msg);
+		}
+
+		// encryption adds padding and a header, keep the backlog in wire bytes
+		const uint32_t plainLength = msg->getLength();
+		protocol->onSendMessage(msg);
+		queuedBytes.fetch_add(msg->getLength() - plainLength, std::memory_order_relaxed);
+
+		writeBatchBytes += msg->getLength();
+		writeBuffers.emplace_back(msg->getOutputBuffer(), msg->getLength());
+		writeBatch.emplace_back(std::move(messageQueue.front()));
+		messageQueue.pop_front();
 	}
 
-	protocol->onSendMessage(msg);
 	try {
 		writeTimer.expires_from_now(boost::posix_time::seconds(CONNECTION_WRITE_TIMEOUT));
-		writeTimer.async_wait(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
-		                                     std::placeholders::_1));
+		writeTimer.async_wait(strand.wrap(std::bind(&Connection::handleTimeout, std::weak_ptr<Connection>(shared_from_this()),
+		                                     std::placeholders::_1)));
 
-		boost::asio::async_write(socket,
-		                         boost::asio::buffer(msg->getOutputBuffer(), msg->getLength()),
-		                         std::bind(&Connection::onWriteOperation, shared_from_this(), std::placeholders::_1));
+		boost::asio::async_write(socket, writeBuffers,
+		                         strand.wrap(std::bind(&Connection::onWriteOperation, shared_from_this(), std::placeholders::_1)));
 	} catch (boost::system::system_error& e) {
 		std::cout << "[Network error - Connection::internalSend] " << e.what() << std::endl;
 		close(FORCE_CLOSE);
 	}
 }
 
-uint32_t Connection::getIP()
+void Connection::resolveIP()
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
-
-	// IP-address is expressed in network byte order
+	// called once by the acceptor before any handler can run, the address is
+	// cached so other threads never have to touch the socket
 	boost::system::error_code error;
 	const boost::asio::ip::tcp::endpoint endpoint = socket.remote_endpoint(error);
 	if (error) {
-		return 0;
+		ip = 0;
+		return;
 	}
 
-	return htonl(endpoint.address().to_v4().to_ulong());
-}
-
-void Connection::dispatchBroadcastMessage(const OutputMessage_ptr& msg)
-{
-	auto msgCopy = OutputMessagePool::getOutputMessage();
-	msgCopy->append(msg);
-	GET_IO_SERVICE(socket).dispatch(std::bind(&Connection::broadcastMessage, shared_from_this(), msgCopy));
+	// IP-address is expressed in network byte order
+	ip = htonl(endpoint.address().to_v4().to_ulong());
 }
 
-void Connection::broadcastMessage(OutputMessage_ptr msg)
+void Connection::broadcastMessage(const OutputMessage_ptr& msg)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
 	const auto client = std::dynamic_pointer_cast<ProtocolGame>(protocol);
-	if (client) {
+	if (!client) {
+		return;
+	}
+
+	ProtocolGame::CastSpectatorVec spectators;
+	{
 		std::lock_guard<decltype(client->liveCastLock)> lockGuard(client->liveCastLock);
+		spectators = client->getLiveCastSpectators();
+	}
 
-		const auto& spectators = client->getLiveCastSpectators();
-		for (const ProtocolSpectator_ptr& spectator : spectators) {
-			auto newMsg = OutputMessagePool::getOutputMessage();
-			newMsg->append(msg);
-			spectator->send(std::move(newMsg));
+	if (spectators.empty()) {
+		return;
+	}
+
+	// the caster's message is encrypted in place right after this, so the
+	// plain payload is copied once and shared read-only by all spectators
+	auto frame = OutputMessagePool::getOutputMessage();
+	frame->append(msg);
+
+	const ConstOutputMessage_ptr sharedFrame = std::move(frame);
+	for (const ProtocolSpectator_ptr& spectator : spectators) {
+		if (auto connection = spectator->getConnection()) {
+			connection->sendFrame(sharedFrame);
 		}
 	}
 }
 
 void Connection::onWriteOperation(const boost::system::error_code& error)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(connectionLock);
 	writeTimer.cancel();
-	messageQueue.pop_front();
+
+	queuedMessages.fetch_sub(writeBatch.size(), std::memory_order_relaxed);
+	queuedBytes.fetch_sub(writeBatchBytes, std::memory_order_relaxed);
+	writeBatch.clear();
+	writeBuffers.clear();
+	writeBatchBytes = 0;
 
 	if (error) {
 		messageQueue.clear();
+		frameBatch.reset();
+		queuedMessages.store(0, std::memory_order_relaxed);
+		queuedBytes.store(0, std::memory_order_relaxed);
 		close(FORCE_CLOSE);
 		return;
 	}
 
+	if (frameBatch && connectionState == CONNECTION_STATE_OPEN) {
+		enqueueFrameBatch();
+	}
+
 	if (!messageQueue.empty()) {
-		internalSend(messageQueue.front());
-	} else if (connectionState == CONNECTION_STATE_CLOSED) {
+		internalSend();
+		return;
+	}
+
+	backlogReported = false;
+	if (connectionState == CONNECTION_STATE_CLOSED) {
 		closeSocket();
 	}
 }
@@ -20,17 +20,31 @@
 #ifndef FS_CONNECTION_H_FC8E1B4392D24D27A2F129D8B93A6348
 #define FS_CONNECTION_H_FC8E1B4392D24D27A2F129D8B93A6348
 
+#include <atomic>
+#include <deque>
 #include <unordered_set>
 
 #include "networkmessage.h"
 
 static constexpr int32_t CONNECTION_WRITE_TIMEOUT = 30;
 static constexpr int32_t CONNECTION_READ_TIMEOUT = 30;
+// bytes gathered into one write, a single larger message is still sent alone
+static constexpr uint32_t CONNECTION_MAX_WRITE_BYTES = 64 * 1024;
+// backlog after which a connection is reported as a slow reader
+static constexpr uint32_t CONNECTION_BACKLOG_WARNING = 1024 * 1024;
+
+struct ConnectionQueueStats {
+	uint32_t connections = 0;
+	uint64_t queuedMessages = 0;
+	uint64_t queuedBytes = 0;
+	uint32_t maxQueuedBytes = 0; // worst single connection
+};
 
 class Protocol;
 typedef std::shared_ptr<Protocol> Protocol_ptr;
 class OutputMessage;
 typedef std::shared_ptr<OutputMessage> OutputMessage_ptr;
+typedef std::shared_ptr<const OutputMessage> ConstOutputMessage_ptr;
 class Connection;
 typedef std::shared_ptr<Connection> Connection_ptr;
 typedef std::weak_ptr<Connection> ConnectionWeak_ptr;
@@ -52,6 +66,8 @@ class ConnectionManager
 		void releaseConnection(const Connection_ptr& connection);
 		void closeAll();
 
+		ConnectionQueueStats getQueueStats();
+
 	protected:
 		ConnectionManager() = default;
 
@@ -78,7 +94,8 @@ class Connection : public std::enable_shared_from_this<Connection>
 			readTimer(io_service),
 			writeTimer(io_service),
 			service_port(std::move(service_port)),
-			socket(io_service) {
+			socket(io_service),
+			strand(io_service) {
 			connectionState = CONNECTION_STATE_OPEN;
 			receivedFirst = false;
 			packetsSent = 0;
@@ -88,16 +105,32 @@ class Connection : public std::enable_shared_from_this<Connection>
 
 		friend class ConnectionManager;
 
+		// any thread, the work is moved into the connection's strand
 		void close(bool force = false);
 		// Used by protocols that require server to send first
 		void accept(Protocol_ptr protocol);
 		void accept();
 
 		void send(const OutputMessage_ptr& msg);
+		// live cast frame shared by every spectator, copied into the next
+		// outgoing message so frames arriving during a write leave together
+		void sendFrame(const ConstOutputMessage_ptr& frame);
+
+		uint32_t getIP() const {
+			return ip;
+		}
 
-		uint32_t getIP();
+		// waiting plus in flight, readable from any thread
+		uint32_t getQueuedMessages() const {
+			return queuedMessages.load(std::memory_order_relaxed);
+		}
+		uint32_t getQueuedBytes() const {
+			return queuedBytes.load(std::memory_order_relaxed);
+		}
 
 	private:
+		void resolveIP();
+
 		void parseHeader(const boost::system::error_code& error);
 		void parsePacket(const boost::system::error_code& error);
 
@@ -106,7 +139,9 @@ class Connection : public std::enable_shared_from_this<Connection>
 		static void handleTimeout(ConnectionWeak_ptr connectionWeak, const boost::system::error_code& error);
 
 		void closeSocket();
-		void internalSend(const OutputMessage_ptr& msg);
+		void internalSend();
+		void enqueue(OutputMessage_ptr msg);
+		void enqueueFrameBatch();
 
 		boost::asio::ip::tcp::socket& getSocket() {
 			return socket;
@@ -115,20 +150,31 @@ class Connection : public std::enable_shared_from_this<Connection>
 
 		NetworkMessage msg;
 		//live
-		void broadcastMessage(OutputMessage_ptr msg);
-		void dispatchBroadcastMessage(const OutputMessage_ptr& msg);
+		void broadcastMessage(const OutputMessage_ptr& msg);
 
 		boost::asio::deadline_timer readTimer;
 		boost::asio::deadline_timer writeTimer;
 
-		std::recursive_mutex connectionLock;
+		// everything below is only touched from inside the strand
+		std::deque<OutputMessage_ptr> messageQueue;
+		// messages of the write in flight, gathered into one buffer sequence
+		std::vector<OutputMessage_ptr> writeBatch;
+		std::vector<boost::asio::const_buffer> writeBuffers;
+		uint32_t writeBatchBytes = 0;
+		// live cast frames not yet queued
+		OutputMessage_ptr frameBatch;
 
-		std::list<OutputMessage_ptr> messageQueue;
+		std::atomic<uint32_t> queuedMessages{0};
+		std::atomic<uint32_t> queuedBytes{0};
+		bool backlogReported = false;
 
 		ConstServicePort_ptr service_port;
 		Protocol_ptr protocol;
 
 		boost::asio::ip::tcp::socket socket;
+		boost::asio::io_service::strand strand;
+
+		uint32_t ip = 0;
 
 		time_t timeConnected;
 		uint32_t packetsSent;
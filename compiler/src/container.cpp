@@ -82,7 +82,7 @@ Attr_ReadValue Container::readAttr(AttrTypes_t attr, PropStream& propStream)
 	return Item::readAttr(attr, propStream);
 }
 
-bool Container::unserializeItemNode(FileLoader& f, NODE node, PropStream& propStream)
+bool Container::unserializeItemNode(MappedFileLoader& f, MAPPED_NODE node, PropStream& propStream)
 {
 	bool ret = Item::unserializeItemNode(f, node, propStream);
 	if (!ret) {
@@ -90,7 +90,7 @@ bool Container::unserializeItemNode(FileLoader& f, NODE node, PropStream& propSt
 	}
 
 	uint32_t type;
-	NODE nodeItem = f.getChildNode(node, type);
+	MAPPED_NODE nodeItem = f.getChildNode(node, type);
 	while (nodeItem) {
 		//load container items
 		if (type != OTBM_ITEM) {
@@ -72,7 +72,7 @@ class Container : public Item, public Cylinder
 		}
 
 		Attr_ReadValue readAttr(AttrTypes_t attr, PropStream& propStream) override;
-		bool unserializeItemNode(FileLoader& f, NODE node, PropStream& propStream) override;
+		bool unserializeItemNode(MappedFileLoader& f, MAPPED_NODE node, PropStream& propStream) override;
 		std::string getContentDescription() const;
 
 		size_t size() const {
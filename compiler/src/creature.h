@@ -48,6 +48,13 @@ enum slots_t : uint8_t {
 	CONST_SLOT_LAST = CONST_SLOT_AMMO,
 };
 
+// client updates collected during a dispatcher task and sent once at its end
+enum CreatureUpdate_t : uint8_t {
+	CREATURE_UPDATE_HEALTH = 1 << 0,
+	CREATURE_UPDATE_SPEED = 1 << 1,
+	CREATURE_UPDATE_STATS = 1 << 2, // players only, to their own client
+};
+
 struct FindPathParams {
 	bool fullPathSearch = true;
 	bool clearSight = true;
@@ -83,6 +90,10 @@ class FrozenPathingConditionCall
 		bool isInRange(const Position& startPos, const Position& testPos,
 		               const FindPathParams& fpp) const;
 
+		const Position& getTargetPos() const {
+			return targetPos;
+		}
+
 	protected:
 		Position targetPos;
 };
@@ -439,6 +450,18 @@ class Creature : virtual public Thing
 		bool getPathTo(const Position& targetPos, std::forward_list<Direction>& dirList, const FindPathParams& fpp) const;
 		bool getPathTo(const Position& targetPos, std::forward_list<Direction>& dirList, int32_t minTargetDist, int32_t maxTargetDist, bool fullPathSearch = true, bool clearSight = true, int32_t maxSearchDist = 0) const;
 
+		// returns true when nothing was pending before, see Game::addCreatureUpdate
+		bool addPendingUpdates(uint8_t updates) {
+			const bool first = pendingUpdates == 0;
+			pendingUpdates |= updates;
+			return first;
+		}
+		uint8_t takePendingUpdates() {
+			const uint8_t updates = pendingUpdates;
+			pendingUpdates = 0;
+			return updates;
+		}
+
 		void incrementReferenceCounter() {
 			++referenceCounter;
 		}
@@ -510,6 +533,8 @@ class Creature : virtual public Thing
 		Direction direction = DIRECTION_SOUTH;
 		Skulls_t skull = SKULL_NONE;
 
+		uint8_t pendingUpdates = 0;
+
 		bool localMapCache[mapWalkHeight][mapWalkWidth] = {{ false }};
 		bool isInternalRemoved = false;
 		bool isMapLoaded = false;
@@ -245,7 +245,7 @@ bool DBResult::next()
 	return row != nullptr;
 }
 
-DBInsert::DBInsert(std::string query) : query(std::move(query))
+DBInsert::DBInsert(std::string query, Database* db) : db(db), query(std::move(query))
 {
 	this->length = this->query.length();
 }
@@ -255,7 +255,7 @@ bool DBInsert::addRow(const std::string& row)
 	// adds new row to buffer
 	const size_t rowLength = row.length();
 	length += rowLength;
-	if (length > Database::getInstance()->getMaxPacketSize() && !execute()) {
+	if (length > db->getMaxPacketSize() && !execute()) {
 		return false;
 	}
 
@@ -288,8 +288,20 @@ bool DBInsert::execute()
 	}
 
 	// executes buffer
-	bool res = Database::getInstance()->executeQuery(query + values);
+	bool res = db->executeQuery(query + values + upsert);
 	values.clear();
-	length = query.length();
+	length = query.length() + upsert.length();
 	return res;
 }
+
+void DBInsert::setUpsert(const std::vector<std::string>& columns)
+{
+	length -= upsert.length();
+	upsert.clear();
+
+	for (const std::string& column : columns) {
+		upsert.append(upsert.empty() ? " ON DUPLICATE KEY UPDATE " : ", ");
+		upsert.append(1, '`').append(column).append("` = VALUES(`").append(column).append("`)");
+	}
+	length += upsert.length();
+}
@@ -190,25 +190,30 @@ class DBResult
 class DBInsert
 {
 	public:
-		explicit DBInsert(std::string query);
+		explicit DBInsert(std::string query, Database* db = Database::getInstance());
 		bool addRow(const std::string& row);
 		bool addRow(std::ostringstream& row);
 		bool execute();
 
+		// rows whose key already exists get the given columns overwritten instead
+		void setUpsert(const std::vector<std::string>& columns);
+
 	protected:
+		Database* db;
 		std::string query;
 		std::string values;
+		std::string upsert;
 		size_t length;
 };
 
 class DBTransaction
 {
 	public:
-		constexpr DBTransaction() = default;
+		explicit DBTransaction(Database* db = Database::getInstance()) : db(db) {}
 
 		~DBTransaction() {
 			if (state == STATE_START) {
-				Database::getInstance()->rollback();
+				db->rollback();
 			}
 		}
 
@@ -218,7 +223,7 @@ class DBTransaction
 
 		bool begin() {
 			state = STATE_START;
-			return Database::getInstance()->beginTransaction();
+			return db->beginTransaction();
 		}
 
 		bool commit() {
@@ -227,7 +232,7 @@ class DBTransaction
 			}
 
 			state = STEATE_COMMIT;
-			return Database::getInstance()->commit();
+			return db->commit();
 		}
 
 	private:
@@ -237,6 +242,7 @@ class DBTransaction
 			STEATE_COMMIT,
 		};
 
+		Database* db;
 		TransactionStates_t state = STATE_NO_START;
 };
 
@@ -19,83 +19,179 @@
 
 #include "otpch.h"
 
+#include "configmanager.h"
 #include "databasetasks.h"
 #include "tasks.h"
 
+extern ConfigManager g_config;
 extern Dispatcher g_dispatcher;
 
 
 void DatabaseTasks::start()
 {
-	db.connect();
+	const int32_t workerCount = std::max<int32_t>(1, g_config.getNumber(ConfigManager::DATABASE_WORKERS));
+	for (int32_t i = 0; i < workerCount; ++i) {
+		workers.emplace_back(new Worker);
+		workers.back()->db.connect();
+	}
+
 	ThreadHolder::start();
+	for (size_t i = 1; i < workers.size(); ++i) {
+		Worker& worker = *workers[i];
+		worker.thread = std::thread(&DatabaseTasks::workerMain, this, std::ref(worker));
+	}
 }
 
 void DatabaseTasks::threadMain()
 {
-	std::unique_lock<std::mutex> taskLockUnique(taskLock, std::defer_lock);
-	while (getState() != THREAD_STATE_TERMINATED) {
+	workerMain(*workers.front());
+}
+
+void DatabaseTasks::workerMain(Worker& worker)
+{
+	// a worker is the only user of its connection, on shutdown it drains its
+	// own queue before it exits so the last saves still reach the database
+	std::unique_lock<std::mutex> taskLockUnique(worker.taskLock, std::defer_lock);
+	while (true) {
 		taskLockUnique.lock();
-		if (tasks.empty()) {
-			taskSignal.wait(taskLockUnique);
+		if (worker.tasks.empty() && getState() != THREAD_STATE_TERMINATED) {
+			worker.taskSignal.wait(taskLockUnique);
 		}
 
-		if (!tasks.empty()) {
-			DatabaseTask task = std::move(tasks.front());
-			tasks.pop_front();
+		if (!worker.tasks.empty()) {
+			DatabaseTask task = std::move(worker.tasks.front());
+			worker.tasks.pop_front();
 			taskLockUnique.unlock();
-			runTask(task);
+			runTask(worker, task);
 		} else {
+			bool terminated = getState() == THREAD_STATE_TERMINATED;
 			taskLockUnique.unlock();
+			if (terminated) {
+				break;
+			}
 		}
 	}
 }
 
 void DatabaseTasks::addTask(const std::string& query, const std::function<void(DBResult_ptr, bool)>& callback/* = nullptr*/, bool store/* = false*/)
+{
+	if (workers.empty()) {
+		return;
+	}
+	addTask(*workers.front(), DatabaseTask(query, callback, store));
+}
+
+void DatabaseTasks::addTask(uint32_t key, const std::string& query, const std::function<void(DBResult_ptr, bool)>& callback/* = nullptr*/, bool store/* = false*/)
+{
+	if (workers.empty()) {
+		return;
+	}
+	addTask(*workers[key % workers.size()], DatabaseTask(query, callback, store));
+}
+
+void DatabaseTasks::addJob(uint32_t key, std::function<bool(Database&)> job, std::function<void(bool)> callback/* = nullptr*/)
+{
+	if (workers.empty()) {
+		return;
+	}
+	addTask(*workers[key % workers.size()], DatabaseTask(std::move(job), std::move(callback)));
+}
+
+void DatabaseTasks::addTask(Worker& worker, DatabaseTask&& task)
 {
 	bool signal = false;
-	taskLock.lock();
+	worker.taskLock.lock();
 	if (getState() == THREAD_STATE_RUNNING) {
-		signal = tasks.empty();
-		tasks.emplace_back(query, callback, store);
+		signal = worker.tasks.empty();
+		worker.tasks.emplace_back(std::move(task));
+	} else if (task.job) {
+		std::cout << "[Warning - DatabaseTasks::addTask] Dropped a database job queued while the workers are stopped." << std::endl;
+	} else {
+		std::cout << "[Warning - DatabaseTasks::addTask] Dropped a query queued while the workers are stopped: " << task.query << std::endl;
 	}
-	taskLock.unlock();
+	worker.taskLock.unlock();
 
 	if (signal) {
-		taskSignal.notify_one();
+		worker.taskSignal.notify_one();
 	}
 }
 
-void DatabaseTasks::runTask(const DatabaseTask& task)
+void DatabaseTasks::runTask(Worker& worker, const DatabaseTask& task)
 {
-	bool success;
-	DBResult_ptr result;
-	if (task.store) {
-		result = db.storeQuery(task.query);
-		success = true;
+	using namespace std::chrono;
+
+	const auto started = steady_clock::now();
+	const uint64_t wait = duration_cast<microseconds>(started - task.queuedAt).count();
+
+	Database& db = worker.db;
+	if (task.job) {
+		bool success = task.job(db);
+		if (task.jobCallback) {
+			g_dispatcher.addTask(createTask(std::bind(task.jobCallback, success)));
+		}
 	} else {
-		result = nullptr;
-		success = db.executeQuery(task.query);
+		bool success;
+		DBResult_ptr result;
+		if (task.store) {
+			result = db.storeQuery(task.query);
+			success = true;
+		} else {
+			result = nullptr;
+			success = db.executeQuery(task.query);
+		}
+
+		if (task.callback) {
+			g_dispatcher.addTask(createTask(std::bind(task.callback, result, success)));
+		}
 	}
 
-	if (task.callback) {
-		g_dispatcher.addTask(createTask(std::bind(task.callback, result, success)));
+	// only the owning worker writes these, readers just want a recent value
+	worker.processed.fetch_add(1, std::memory_order_relaxed);
+	worker.waitTotal.fetch_add(wait, std::memory_order_relaxed);
+	worker.runTotal.fetch_add(duration_cast<microseconds>(steady_clock::now() - started).count(), std::memory_order_relaxed);
+	if (wait > worker.waitMax.load(std::memory_order_relaxed)) {
+		worker.waitMax.store(wait, std::memory_order_relaxed);
 	}
 }
 
-void DatabaseTasks::flush()
+DatabaseTasksStats DatabaseTasks::getStats() const
 {
-	while (!tasks.empty()) {
-		runTask(tasks.front());
-		tasks.pop_front();
+	DatabaseTasksStats stats;
+	stats.workers = workers.size();
+	for (const auto& worker : workers) {
+		{
+			std::lock_guard<std::mutex> lockGuard(worker->taskLock);
+			stats.queued += worker->tasks.size();
+		}
+		stats.processed += worker->processed.load(std::memory_order_relaxed);
+		stats.waitTotal += worker->waitTotal.load(std::memory_order_relaxed);
+		stats.waitMax = std::max(stats.waitMax, worker->waitMax.load(std::memory_order_relaxed));
+		stats.runTotal += worker->runTotal.load(std::memory_order_relaxed);
 	}
+	return stats;
 }
 
 void DatabaseTasks::shutdown()
 {
-	taskLock.lock();
+	for (auto& worker : workers) {
+		worker->taskLock.lock();
+	}
+
+	// the workers finish what is already queued, see workerMain
 	setState(THREAD_STATE_TERMINATED);
-	flush();
-	taskLock.unlock();
-	taskSignal.notify_one();
+
+	for (auto& worker : workers) {
+		worker->taskLock.unlock();
+		worker->taskSignal.notify_one();
+	}
+}
+
+void DatabaseTasks::join()
+{
+	ThreadHolder::join();
+	for (size_t i = 1; i < workers.size(); ++i) {
+		if (workers[i]->thread.joinable()) {
+			workers[i]->thread.join();
+		}
+	}
 }
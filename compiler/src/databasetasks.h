@@ -20,6 +20,7 @@
 #ifndef FS_DATABASETASKS_H_9CBA08E9F5FEBA7275CCEE6560059576
 #define FS_DATABASETASKS_H_9CBA08E9F5FEBA7275CCEE6560059576
 
+#include <atomic>
 #include <condition_variable>
 #include "thread_holder_base.h"
 #include "database.h"
@@ -28,31 +29,66 @@
 struct DatabaseTask {
 	DatabaseTask(std::string query, std::function<void(DBResult_ptr, bool)> callback, bool store) :
 		query(std::move(query)), callback(std::move(callback)), store(store) {}
+	DatabaseTask(std::function<bool(Database&)> job, std::function<void(bool)> jobCallback) :
+		job(std::move(job)), jobCallback(std::move(jobCallback)), store(false) {}
 
 	std::string query;
 	std::function<void(DBResult_ptr, bool)> callback;
+	std::function<bool(Database&)> job;
+	std::function<void(bool)> jobCallback;
+	std::chrono::steady_clock::time_point queuedAt = std::chrono::steady_clock::now();
 	bool store;
 };
 
+struct DatabaseTasksStats {
+	uint32_t workers = 0;
+	uint32_t queued = 0; // tasks waiting right now
+	uint64_t processed = 0;
+	uint64_t waitTotal = 0; // microseconds between addTask and the worker picking it up
+	uint64_t waitMax = 0;
+	uint64_t runTotal = 0; // microseconds spent executing
+};
+
 class DatabaseTasks : public ThreadHolder<DatabaseTasks>
 {
 	public:
 		DatabaseTasks() = default;
 		void start();
-		void flush();
+		// stops taking tasks, join returns once every queued task has run
 		void shutdown();
+		void join();
 
 		void addTask(const std::string& query, const std::function<void(DBResult_ptr, bool)>& callback = nullptr, bool store = false);
+		// queries sharing a key (e.g. a player guid) run in the order they were added
+		void addTask(uint32_t key, const std::string& query, const std::function<void(DBResult_ptr, bool)>& callback = nullptr, bool store = false);
+
+		// runs job with a worker's own connection, jobs sharing a key run in the
+		// order they were added, the callback is dispatched back to the game thread
+		void addJob(uint32_t key, std::function<bool(Database&)> job, std::function<void(bool)> callback = nullptr);
+
+		DatabaseTasksStats getStats() const;
 
 		void threadMain();
 	private:
-		void runTask(const DatabaseTask& task);
+		struct Worker {
+			Database db;
+			std::thread thread;
+			std::list<DatabaseTask> tasks;
+			mutable std::mutex taskLock;
+			std::condition_variable taskSignal;
+
+			std::atomic<uint64_t> processed{0};
+			std::atomic<uint64_t> waitTotal{0};
+			std::atomic<uint64_t> waitMax{0};
+			std::atomic<uint64_t> runTotal{0};
+		};
+
+		void workerMain(Worker& worker);
+		void addTask(Worker& worker, DatabaseTask&& task);
+		void runTask(Worker& worker, const DatabaseTask& task);
 
-		Database db;
-		std::thread thread;
-		std::list<DatabaseTask> tasks;
-		std::mutex taskLock;
-		std::condition_variable taskSignal;
+		// unkeyed queries always go to the first worker so they keep their order
+		std::vector<std::unique_ptr<Worker>> workers;
 };
 
 extern DatabaseTasks g_databaseTasks;
@@ -0,0 +1,155 @@
+/**
+ * Tibia GIMUD Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2017  Alejandro Mujica <alejandrodemujica@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "otpch.h"
+
+#include "datacache.h"
+#include "tools.h"
+
+static bool getSourceKey(const std::string& fileName, uint64_t& size, int64_t& time, uint64_t& digest)
+{
+	boost::system::error_code ec;
+	std::time_t writeTime = boost::filesystem::last_write_time(fileName, ec);
+	if (ec) {
+		return false;
+	}
+
+	std::vector<char> source;
+	if (!readFile(fileName, source)) {
+		return false;
+	}
+
+	size = source.size();
+	time = writeTime;
+	digest = updateDigest(DIGEST_OFFSET, source.data(), source.size());
+	return true;
+}
+
+DataCache::DataCache(const std::string& sourceFile, uint32_t version)
+{
+	std::string relative = sourceFile;
+	if (relative.compare(0, 5, "data/") == 0) {
+		relative.erase(0, 5);
+	}
+	cacheFile = "data/cache/" + relative + ".bin";
+
+	if (!getSourceKey(sourceFile, header.sourceSize, header.sourceTime, header.sourceDigest)) {
+		return;
+	}
+
+	memcpy(header.magic, "FSDC", 4);
+	header.version = version;
+	validSource = true;
+}
+
+bool DataCache::load(PropStream& propStream)
+{
+	if (!validSource || !readFile(cacheFile, buffer) || buffer.size() < sizeof(Header)) {
+		return false;
+	}
+
+	Header cached;
+	memcpy(&cached, buffer.data(), sizeof(Header));
+
+	const char* payload = buffer.data() + sizeof(Header);
+	size_t payloadSize = buffer.size() - sizeof(Header);
+	if (memcmp(&cached, &header, offsetof(Header, payloadDigest)) != 0 || cached.payloadDigest != updateDigest(DIGEST_OFFSET, payload, payloadSize)) {
+		return false;
+	}
+
+	propStream.init(payload, payloadSize);
+
+	uint32_t dependencies;
+	if (!propStream.read<uint32_t>(dependencies)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < dependencies; ++i) {
+		std::string fileName;
+		uint64_t size, digest;
+		int64_t time;
+		if (!propStream.readString(fileName) || !propStream.read<uint64_t>(size) || !propStream.read<int64_t>(time) || !propStream.read<uint64_t>(digest)) {
+			return false;
+		}
+
+		uint64_t currentSize, currentDigest;
+		int64_t currentTime;
+		if (!getSourceKey(fileName, currentSize, currentTime, currentDigest) || currentSize != size || currentTime != time || currentDigest != digest) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void DataCache::save(const PropWriteStream& propWriteStream, const std::vector<std::string>& dependencies/* = {}*/) const
+{
+	if (!validSource) {
+		return;
+	}
+
+	PropWriteStream dependencyStream;
+	dependencyStream.write<uint32_t>(dependencies.size());
+	for (const std::string& fileName : dependencies) {
+		uint64_t size, digest;
+		int64_t time;
+		if (!getSourceKey(fileName, size, time, digest)) {
+			return;
+		}
+
+		dependencyStream.writeString(fileName);
+		dependencyStream.write<uint64_t>(size);
+		dependencyStream.write<int64_t>(time);
+		dependencyStream.write<uint64_t>(digest);
+	}
+
+	boost::system::error_code ec;
+	boost::filesystem::create_directories(boost::filesystem::path(cacheFile).parent_path(), ec);
+	if (ec) {
+		return;
+	}
+
+	size_t prefixSize;
+	const char* prefix = dependencyStream.getStream(prefixSize);
+
+	size_t size;
+	const char* data = propWriteStream.getStream(size);
+
+	Header written = header;
+	written.payloadDigest = updateDigest(updateDigest(DIGEST_OFFSET, prefix, prefixSize), data, size);
+
+	//written aside and renamed, a crash never leaves half a cache behind
+	std::string tmpFile = cacheFile + ".tmp";
+	FILE* file = fopen(tmpFile.c_str(), "wb");
+	if (!file) {
+		return;
+	}
+
+	bool success = fwrite(&written, sizeof(Header), 1, file) == 1 && fwrite(prefix, 1, prefixSize, file) == prefixSize &&
+		(size == 0 || fwrite(data, 1, size, file) == size);
+	success = fclose(file) == 0 && success;
+	if (success) {
+		boost::filesystem::rename(tmpFile, cacheFile, ec);
+		success = !ec;
+	}
+
+	if (!success) {
+		std::cout << "[Warning - DataCache::save] Could not write " << cacheFile << '.' << std::endl;
+		boost::filesystem::remove(tmpFile, ec);
+	}
+}
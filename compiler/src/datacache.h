@@ -0,0 +1,62 @@
+/**
+ * Tibia GIMUD Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2017  Alejandro Mujica <alejandrodemujica@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_DATACACHE_H_36429230D4EE459B8F3C630D79EBCEFC
+#define FS_DATACACHE_H_36429230D4EE459B8F3C630D79EBCEFC
+
+#include "fileloader.h"
+
+// Parsed form of a data file, kept under data/cache/ so an unchanged source
+// is read back in one go instead of being tokenized again. A cache is only
+// used when it was written with the same format version from a source of
+// the same size, modification time and contents, and when every file the
+// source pulled in is still unchanged as well.
+class DataCache
+{
+	public:
+		DataCache(const std::string& sourceFile, uint32_t version);
+
+		// non-copyable
+		DataCache(const DataCache&) = delete;
+		DataCache& operator=(const DataCache&) = delete;
+
+		// false when there is no usable cache; the stream points into this
+		// object and is valid as long as it is
+		bool load(PropStream& propStream);
+		// dependencies are files read besides the source, such as includes
+		void save(const PropWriteStream& propWriteStream, const std::vector<std::string>& dependencies = {}) const;
+
+	private:
+		struct Header {
+			char magic[4];
+			uint32_t version;
+			uint64_t sourceSize;
+			int64_t sourceTime;
+			uint64_t sourceDigest;
+			uint64_t payloadDigest;
+		};
+		static_assert(sizeof(Header) == 40, "cache header must not contain padding");
+
+		std::string cacheFile;
+		std::vector<char> buffer;
+		Header header = {};
+		bool validSource = false;
+};
+
+#endif
@@ -21,6 +21,15 @@
 
 #include "fileloader.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 FileLoader::~FileLoader()
 {
 	if (file) {
@@ -403,3 +412,293 @@ int32_t FileLoader::loadCacheBlock(uint32_t pos)
 	cached_data[loading_cache].loaded = 1;
 	return loading_cache;
 }
+
+MappedFileLoader::~MappedFileLoader()
+{
+	closeFile();
+}
+
+void MappedFileLoader::closeFile()
+{
+#ifdef _WIN32
+	if (data && ownsMapping) {
+		UnmapViewOfFile(data);
+	}
+
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+	}
+
+	if (fileHandle) {
+		CloseHandle(fileHandle);
+		fileHandle = nullptr;
+	}
+#else
+	if (data && ownsMapping) {
+		munmap(const_cast<uint8_t*>(data), size);
+	}
+#endif
+
+	data = nullptr;
+	dataEnd = nullptr;
+	size = 0;
+	ownsMapping = false;
+}
+
+void MappedFileLoader::attach(const MappedFileLoader& source)
+{
+	closeFile();
+
+	data = source.data;
+	dataEnd = source.dataEnd;
+	size = source.size;
+	lastError = ERROR_NONE;
+}
+
+bool MappedFileLoader::openFile(const char* filename, const char* accept_identifier)
+{
+	closeFile();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		lastError = ERROR_CAN_NOT_OPEN;
+		return false;
+	}
+
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		closeFile();
+		lastError = ERROR_CAN_NOT_OPEN;
+		return false;
+	}
+
+	// empty files can not be mapped
+	if (fileSize.QuadPart < 4) {
+		closeFile();
+		lastError = ERROR_EOF;
+		return false;
+	}
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle) {
+		closeFile();
+		lastError = ERROR_CAN_NOT_OPEN;
+		return false;
+	}
+
+	data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (!data) {
+		closeFile();
+		lastError = ERROR_CAN_NOT_OPEN;
+		return false;
+	}
+
+	size = static_cast<size_t>(fileSize.QuadPart);
+	ownsMapping = true;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		lastError = ERROR_CAN_NOT_OPEN;
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0) {
+		::close(fd);
+		lastError = ERROR_CAN_NOT_OPEN;
+		return false;
+	}
+
+	// empty files can not be mapped
+	if (fileStat.st_size < 4) {
+		::close(fd);
+		lastError = ERROR_EOF;
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		lastError = ERROR_CAN_NOT_OPEN;
+		return false;
+	}
+
+	// the file is walked front to back exactly once
+	madvise(mapping, fileStat.st_size, MADV_SEQUENTIAL);
+
+	data = static_cast<const uint8_t*>(mapping);
+	size = fileStat.st_size;
+	ownsMapping = true;
+#endif
+
+	dataEnd = data + size;
+
+	// The first four bytes must either match the accept identifier or be 0x00000000 (wildcard)
+	if (memcmp(data, accept_identifier, 4) != 0 && memcmp(data, "\0\0\0\0", 4) != 0) {
+		closeFile();
+		lastError = ERROR_INVALID_FILE_VERSION;
+		return false;
+	}
+
+	if (size < 6 || data[4] != NODE_START) {
+		closeFile();
+		lastError = ERROR_INVALID_FORMAT;
+		return false;
+	}
+
+	lastError = ERROR_NONE;
+	return true;
+}
+
+MAPPED_NODE MappedFileLoader::readNode(const uint8_t* pos, uint8_t depth, uint32_t& type)
+{
+	if (depth >= MAX_DEPTH || dataEnd - pos < 2) {
+		lastError = ERROR_INVALID_FORMAT;
+		return nullptr;
+	}
+
+	MappedNode& node = nodes[depth];
+	node.type = pos[1];
+	node.depth = depth;
+	node.props = pos + 2;
+	node.end = nullptr;
+	node.escaped = false;
+
+	const uint8_t* p = node.props;
+	while (p < dataEnd) {
+		uint8_t byte = *p;
+		if (byte == NODE_START || byte == NODE_END) {
+			node.propsEnd = p;
+			type = node.type;
+			return &node;
+		} else if (byte == ESCAPE_CHAR) {
+			node.escaped = true;
+			p += 2;
+		} else {
+			++p;
+		}
+	}
+
+	lastError = ERROR_EOF;
+	return nullptr;
+}
+
+const uint8_t* MappedFileLoader::skipChildren(const uint8_t* pos)
+{
+	uint32_t level = 0;
+	while (pos < dataEnd) {
+		//most bytes are plain property data
+		if (*pos < ESCAPE_CHAR) {
+			++pos;
+			continue;
+		}
+
+		switch (*pos) {
+			case NODE_START:
+				//skip the type byte too
+				pos += 2;
+				++level;
+				break;
+
+			case NODE_END:
+				++pos;
+				if (level == 0) {
+					return pos;
+				}
+				--level;
+				break;
+
+			case ESCAPE_CHAR:
+				pos += 2;
+				break;
+
+			default:
+				++pos;
+				break;
+		}
+	}
+
+	lastError = ERROR_EOF;
+	return nullptr;
+}
+
+bool MappedFileLoader::getProps(const MAPPED_NODE node, PropStream& props)
+{
+	if (!node) {
+		props.init(nullptr, 0);
+		return false;
+	}
+
+	if (!node->escaped) {
+		props.init(reinterpret_cast<const char*>(node->props), node->propsEnd - node->props);
+		return true;
+	}
+
+	//unescape into the shared buffer, valid until the next call
+	buffer.resize(node->propsEnd - node->props);
+
+	size_t j = 0;
+	for (const uint8_t* p = node->props; p < node->propsEnd; ++p) {
+		if (*p == ESCAPE_CHAR) {
+			++p;
+		}
+		buffer[j++] = *p;
+	}
+
+	props.init(reinterpret_cast<const char*>(buffer.data()), j);
+	return true;
+}
+
+MAPPED_NODE MappedFileLoader::getChildNode(const MAPPED_NODE parent, uint32_t& type)
+{
+	if (!parent) {
+		if (!data) {
+			lastError = ERROR_NOT_OPEN;
+			return nullptr;
+		}
+
+		return readNode(data + 4, 0, type);
+	}
+
+	if (*parent->propsEnd != NODE_START) {
+		parent->end = parent->propsEnd + 1;
+		return nullptr;
+	}
+
+	return readNode(parent->propsEnd, parent->depth + 1, type);
+}
+
+MAPPED_NODE MappedFileLoader::getNextNode(const MAPPED_NODE prev, uint32_t& type)
+{
+	if (!prev) {
+		return nullptr;
+	}
+
+	//children that were not walked are skipped here
+	const uint8_t* pos = prev->end;
+	if (!pos) {
+		pos = skipChildren(prev->propsEnd);
+		if (!pos) {
+			return nullptr;
+		}
+	}
+
+	if (pos >= dataEnd || prev->depth == 0) {
+		return nullptr;
+	}
+
+	if (*pos == NODE_START) {
+		return readNode(pos, prev->depth, type);
+	} else if (*pos != NODE_END) {
+		lastError = ERROR_INVALID_FORMAT;
+		return nullptr;
+	}
+
+	//last sibling, so the parent ends here as well
+	nodes[prev->depth - 1].end = pos + 1;
+	return nullptr;
+}
@@ -149,6 +149,85 @@ class FileLoader
 		int32_t loadCacheBlock(uint32_t pos);
 };
 
+struct MappedNode {
+	const uint8_t* props = nullptr;
+	const uint8_t* propsEnd = nullptr; // NODE_START of the first child or NODE_END
+	const uint8_t* end = nullptr; // past NODE_END, known once the children were walked
+	uint8_t type = 0;
+	uint8_t depth = 0;
+	bool escaped = false;
+};
+
+typedef MappedNode* MAPPED_NODE;
+
+// Reads a node file mapped into memory in a single pass, without building
+// a node tree. A handle is a slot per depth, so it stays valid until the next
+// call on a sibling; the nested walks of IOMap and Container need no more.
+// Properties without escape bytes are handed out straight from the mapping.
+class MappedFileLoader
+{
+	public:
+		MappedFileLoader() = default;
+		~MappedFileLoader();
+
+		// non-copyable
+		MappedFileLoader(const MappedFileLoader&) = delete;
+		MappedFileLoader& operator=(const MappedFileLoader&) = delete;
+
+		bool openFile(const char* filename, const char* identifier);
+		// reads the mapping of an open loader without owning it, so another
+		// thread can walk its own part of the file
+		void attach(const MappedFileLoader& source);
+
+		bool getProps(const MAPPED_NODE node, PropStream& props);
+		MAPPED_NODE getChildNode(const MAPPED_NODE parent, uint32_t& type);
+		MAPPED_NODE getNextNode(const MAPPED_NODE prev, uint32_t& type);
+
+		// a node reopened by position has no siblings, only children
+		const uint8_t* getNodePosition(const MAPPED_NODE node) const {
+			return node->props - 2;
+		}
+		MAPPED_NODE getNodeAt(const uint8_t* pos, uint32_t& type) {
+			return readNode(pos, 0, type);
+		}
+
+		FILELOADER_ERRORS getError() const {
+			return lastError;
+		}
+
+		size_t getSize() const {
+			return size;
+		}
+
+	protected:
+		enum SPECIAL_BYTES {
+			ESCAPE_CHAR = 0xFD,
+			NODE_START = 0xFE,
+			NODE_END = 0xFF,
+		};
+
+		MAPPED_NODE readNode(const uint8_t* pos, uint8_t depth, uint32_t& type);
+		const uint8_t* skipChildren(const uint8_t* pos);
+		void closeFile();
+
+		static constexpr uint8_t MAX_DEPTH = 64;
+		MappedNode nodes[MAX_DEPTH];
+
+		std::vector<uint8_t> buffer;
+
+		const uint8_t* data = nullptr;
+		const uint8_t* dataEnd = nullptr;
+		size_t size = 0;
+		bool ownsMapping = false;
+
+#ifdef _WIN32
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#endif
+
+		FILELOADER_ERRORS lastError = ERROR_NONE;
+};
+
 class PropStream
 {
 	public:
@@ -36,6 +36,7 @@
 #include "bed.h"
 #include "scheduler.h"
 #include "databasetasks.h"
+#include "outputmessage.h"
 
 extern ConfigManager g_config;
 extern Actions* g_actions;
@@ -56,6 +57,16 @@ void Game::start(ServiceManager* manager)
 {
 	serviceManager = manager;
 
+	g_dispatcher.setTaskEpilogue(std::bind(&Game::flushCreatureUpdates, this));
+
+	if (g_config.getBoolean(ConfigManager::TICK_LOOP)) {
+		tickInterval = std::max<int32_t>(SCHEDULER_TICK, g_config.getNumber(ConfigManager::TICK_LOOP_INTERVAL));
+		OutputMessagePool::getInstance().setAutoSend(false);
+		g_dispatcher.setFrame(tickInterval, std::bind(&Game::tick, this));
+		std::cout << ">> Game loop running at a fixed tick of " << tickInterval << " ms" << std::endl;
+		return;
+	}
+
 	g_scheduler.addEvent(createSchedulerTask(EVENT_LIGHTINTERVAL, std::bind(&Game::checkLight, this)));
 	g_scheduler.addEvent(createSchedulerTask(EVENT_CREATURE_THINK_INTERVAL, std::bind(&Game::checkCreatures, this, 0)));
 	g_scheduler.addEvent(createSchedulerTask(EVENT_DECAYINTERVAL, std::bind(&Game::checkDecay, this)));
@@ -153,7 +164,19 @@ void Game::saveGameState(bool crash /*= false*/)
     }
 
     std::cout << "Saving server..." << std::endl;
-    
+
+    // players are only snapshotted here, the database workers write them
+    // and report back once the last one is done
+    struct SaveProgress {
+        int64_t start = OTSYS_TIME();
+        size_t pending = 0;
+        size_t failed = 0;
+        size_t skipped = 0;
+        uint64_t rows = 0;
+    };
+    auto progress = std::make_shared<SaveProgress>();
+    progress->pending = players.size();
+
     for (const auto& it : players) {
         if (crash) {
             it.second->loginPosition = it.second->getTown()->getTemplePosition();
@@ -161,7 +184,23 @@ void Game::saveGameState(bool crash /*= false*/)
             it.second->loginPosition = it.second->getPosition();
         }
 
-        IOLoginData::savePlayer(it.second);
+        IOLoginData::savePlayerAsync(it.second, [progress](bool success, uint32_t rowsWritten) {
+            if (!success) {
+                ++progress->failed;
+            } else if (rowsWritten == 0) {
+                ++progress->skipped;
+            }
+            progress->rows += rowsWritten;
+
+            if (--progress->pending == 0) {
+                std::cout << "> Saved players in " << (OTSYS_TIME() - progress->start) / 1000. << " seconds, ";
+                std::cout << progress->rows << " rows written, " << progress->skipped << " unchanged";
+                if (progress->failed != 0) {
+                    std::cout << " (" << progress->failed << " failed)";
+                }
+                std::cout << '.' << std::endl;
+            }
+        });
     }
 
     Map::save();
@@ -527,6 +566,13 @@ bool Game::removeCreature(Creature* creature, bool isLogout/* = true*/)
 		return false;
 	}
 
+	// flushCreatureUpdates skips removed creatures, send what changed in this
+	// task (e.g. the health of a creature that just died) while it is visible
+	const uint8_t updates = creature->takePendingUpdates();
+	if (updates != 0) {
+		sendCreatureUpdates(creature, updates);
+	}
+
 	Tile* tile = creature->getTile();
 
 	std::vector<int32_t> oldStackPosVector;
@@ -3206,7 +3252,9 @@ void Game::removeCreatureCheck(Creature* creature)
 
 void Game::checkCreatures(size_t index)
 {
-	g_scheduler.addEvent(createSchedulerTask(EVENT_CHECK_CREATURE_INTERVAL, std::bind(&Game::checkCreatures, this, (index + 1) % EVENT_CREATURECOUNT)));
+	if (tickInterval == 0) {
+		g_scheduler.addEvent(createSchedulerTask(EVENT_CHECK_CREATURE_INTERVAL, std::bind(&Game::checkCreatures, this, (index + 1) % EVENT_CREATURECOUNT)));
+	}
 
 	auto& checkCreatureList = checkCreatureLists[index];
 	auto it = checkCreatureList.begin(), end = checkCreatureList.end();
@@ -3234,12 +3282,70 @@ void Game::checkCreatures(size_t index)
 void Game::changeSpeed(Creature* creature, int32_t varSpeedDelta)
 {
 	creature->setSpeed(varSpeedDelta);
+	addCreatureUpdate(creature, CREATURE_UPDATE_SPEED);
+}
 
-	//send to clients
-	SpectatorVec list;
-	map.getSpectators(list, creature->getPosition(), false, true);
-	for (Creature* spectator : list) {
-		spectator->getPlayer()->sendChangeSpeed(creature, creature->getStepSpeed());
+void Game::addCreatureUpdate(Creature* creature, uint8_t updates)
+{
+	// creatures that are not on the map (e.g. players loaded offline) have
+	// nobody to tell, players without a client have no stats to send
+	if (creature->isRemoved() || !creature->getTile()) {
+		updates &= ~(CREATURE_UPDATE_HEALTH | CREATURE_UPDATE_SPEED);
+	}
+
+	const Player* player = creature->getPlayer();
+	if (!player || !player->client) {
+		updates &= ~CREATURE_UPDATE_STATS;
+	}
+
+	if (updates != 0 && creature->addPendingUpdates(updates)) {
+		creature->incrementReferenceCounter();
+		updatedCreatures.push_back(creature);
+	}
+}
+
+void Game::flushCreatureUpdates()
+{
+	// sending can run code that changes creatures again
+	while (!updatedCreatures.empty()) {
+		std::vector<Creature*> creatures;
+		creatures.swap(updatedCreatures);
+
+		for (Creature* creature : creatures) {
+			// removeCreature already sent the updates of removed creatures
+			const uint8_t updates = creature->takePendingUpdates();
+			if (updates != 0 && !creature->isRemoved() && creature->getTile()) {
+				sendCreatureUpdates(creature, updates);
+			}
+			creature->decrementReferenceCounter();
+		}
+	}
+}
+
+void Game::sendCreatureUpdates(Creature* creature, uint8_t updates)
+{
+	if ((updates & (CREATURE_UPDATE_HEALTH | CREATURE_UPDATE_SPEED)) != 0) {
+		const Position& position = creature->getPosition();
+
+		SpectatorVec list;
+		map.getSpectators(list, position, true, true);
+		for (Creature* spectator : list) {
+			Player* tmpPlayer = spectator->getPlayer();
+			if ((updates & CREATURE_UPDATE_HEALTH) != 0) {
+				tmpPlayer->sendCreatureHealth(creature);
+			}
+
+			// speed only ever went to the creature's own floor
+			if ((updates & CREATURE_UPDATE_SPEED) != 0 && spectator->getPosition().z == position.z) {
+				tmpPlayer->sendChangeSpeed(creature, creature->getStepSpeed());
+			}
+		}
+	}
+
+	if ((updates & CREATURE_UPDATE_STATS) != 0) {
+		if (Player* player = creature->getPlayer()) {
+			player->sendStatsNow();
+		}
 	}
 }
 
@@ -3512,7 +3618,7 @@ bool Game::combatChangeHealth(Creature* attacker, Creature* target, CombatDamage
 		if (list.empty()) {
 			map.getSpectators(list, targetPos, true, true);
 		}
-		addCreatureHealth(list, target);
+		addCreatureHealth(target);
 
 		TextColor_t color = TEXTCOLOR_NONE;
 		uint8_t hitEffect;
@@ -3610,20 +3716,9 @@ bool Game::combatChangeMana(Creature* attacker, Creature* target, int32_t manaCh
 	return true;
 }
 
-void Game::addCreatureHealth(const Creature* target)
+void Game::addCreatureHealth(Creature* target)
 {
-	SpectatorVec list;
-	map.getSpectators(list, target->getPosition(), true, true);
-	addCreatureHealth(list, target);
-}
-
-void Game::addCreatureHealth(const SpectatorVec& list, const Creature* target)
-{
-	for (Creature* spectator : list) {
-		if (Player* tmpPlayer = spectator->getPlayer()) {
-			tmpPlayer->sendCreatureHealth(target);
-		}
-	}
+	addCreatureUpdate(target, CREATURE_UPDATE_HEALTH);
 }
 
 void Game::addMagicEffect(const Position& pos, uint8_t effect)
@@ -3723,7 +3818,9 @@ void Game::internalDecayItem(Item* item)
 
 void Game::checkDecay()
 {
-	g_scheduler.addEvent(createSchedulerTask(EVENT_DECAYINTERVAL, std::bind(&Game::checkDecay, this)));
+	if (tickInterval == 0) {
+		g_scheduler.addEvent(createSchedulerTask(EVENT_DECAYINTERVAL, std::bind(&Game::checkDecay, this)));
+	}
 
 	size_t bucket = (lastBucket + 1) % EVENT_DECAY_BUCKETS;
 
@@ -3767,7 +3864,9 @@ void Game::checkDecay()
 
 void Game::checkLight()
 {
-	g_scheduler.addEvent(createSchedulerTask(EVENT_LIGHTINTERVAL, std::bind(&Game::checkLight, this)));
+	if (tickInterval == 0) {
+		g_scheduler.addEvent(createSchedulerTask(EVENT_LIGHTINTERVAL, std::bind(&Game::checkLight, this)));
+	}
 
 	lightHour += lightHourDelta;
 
@@ -3819,6 +3918,38 @@ void Game::checkLight()
 	}
 }
 
+void Game::tick()
+{
+	int64_t frameStart = OTSYS_TIME();
+
+	tickCreatureTime += tickInterval;
+	while (tickCreatureTime >= EVENT_CHECK_CREATURE_INTERVAL) {
+		tickCreatureTime -= EVENT_CHECK_CREATURE_INTERVAL;
+		checkCreatures(tickCreatureIndex);
+		tickCreatureIndex = (tickCreatureIndex + 1) % EVENT_CREATURECOUNT;
+	}
+
+	tickDecayTime += tickInterval;
+	while (tickDecayTime >= EVENT_DECAYINTERVAL) {
+		tickDecayTime -= EVENT_DECAYINTERVAL;
+		checkDecay();
+	}
+
+	tickLightTime += tickInterval;
+	if (tickLightTime >= EVENT_LIGHTINTERVAL) {
+		tickLightTime -= EVENT_LIGHTINTERVAL;
+		checkLight();
+	}
+
+	// everything the frame produced leaves in one flush
+	OutputMessagePool::getInstance().sendAll();
+
+	int64_t frameTime = OTSYS_TIME() - frameStart;
+	if (frameTime > tickInterval) {
+		std::cout << "[Warning - Game::tick] Frame took " << frameTime << " ms (tick is " << tickInterval << " ms)." << std::endl;
+	}
+}
+
 void Game::getWorldLightInfo(LightInfo& lightInfo) const
 {
 	lightInfo.level = lightLevel;
@@ -3925,7 +4056,7 @@ void Game::updatePlayerShield(Player* player)
 	}
 }
 
-void Game::updatePremium(Account& account)
+void Game::updatePremium(Account& account, Database* db/* = Database::getInstance()*/)
 {
 	bool save = false;
 	time_t timeNow = time(nullptr);
@@ -3954,7 +4085,7 @@ void Game::updatePremium(Account& account)
 		save = true;
 	}
 
-	if (save && !IOLoginData::saveAccount(account)) {
+	if (save && !IOLoginData::saveAccount(account, db)) {
 		std::cout << "> ERROR: Failed to save account: " << account.id << "!" << std::endl;
 	}
 	//printf(">> Premium Updater Account: %d - PremiumDaysNow: %d\n", account.id, account.premiumDays);
@@ -402,7 +402,7 @@ class Game
 		void closeRuleViolationReport(Player* player);
 		void cancelRuleViolationReport(Player* player);
 
-		static void updatePremium(Account& account);
+		static void updatePremium(Account& account, Database* db = Database::getInstance());
 
 		void cleanup();
 		void shutdown();
@@ -414,6 +414,13 @@ class Game
 		bool isSightClear(const Position& fromPos, const Position& toPos, bool sameFloor) const;
 
 		void changeSpeed(Creature* creature, int32_t varSpeedDelta);
+
+		// queues CreatureUpdate_t flags, several changes of the same creature
+		// during one task become one packet per spectator
+		void addCreatureUpdate(Creature* creature, uint8_t updates);
+		// dispatcher thread, after every task
+		void flushCreatureUpdates();
+		void sendCreatureUpdates(Creature* creature, uint8_t updates);
 		void internalCreatureChangeOutfit(Creature* creature, const Outfit_t& oufit);
 		void internalCreatureChangeVisible(Creature* creature, bool visible);
 		void changeLight(const Creature* creature);
@@ -432,6 +439,9 @@ class Game
 		void checkCreatures(size_t index);
 		void checkLight();
 
+		// one frame of the tick loop mode
+		void tick();
+
 		bool combatBlockHit(CombatDamage& damage, Creature* attacker, Creature* target, bool checkDefense, bool checkArmor, bool field);
 
 		void combatGetTypeInfo(CombatType_t combatType, Creature* target, TextColor_t& color, uint8_t& effect);
@@ -440,8 +450,7 @@ class Game
 		bool combatChangeMana(Creature* attacker, Creature* target, int32_t manaChange);
 
 		//animation help functions
-		void addCreatureHealth(const Creature* target);
-		static void addCreatureHealth(const SpectatorVec& list, const Creature* target);
+		void addCreatureHealth(Creature* target);
 		void addMagicEffect(const Position& pos, uint8_t effect);
 		static void addMagicEffect(const SpectatorVec& list, const Position& pos, uint8_t effect);
 		void addDistanceEffect(const Position& fromPos, const Position& toPos, uint8_t effect);
@@ -520,10 +529,19 @@ class Game
 
 		std::vector<Creature*> ToReleaseCreatures;
 		std::vector<Item*> ToReleaseItems;
+		// creatures with pending CreatureUpdate_t flags, each holds a reference
+		std::vector<Creature*> updatedCreatures;
 		std::vector<char> commandTags;
 
 		size_t lastBucket = 0;
 
+		// tick loop mode, 0 when the events are scheduled on their own
+		uint32_t tickInterval = 0;
+		int64_t tickCreatureTime = 0;
+		int64_t tickDecayTime = 0;
+		int64_t tickLightTime = 0;
+		size_t tickCreatureIndex = 0;
+
 		WildcardTreeNode wildcardTree { false };
 
 		std::map<uint32_t, Npc*> npcs;
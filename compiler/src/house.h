@@ -105,6 +105,14 @@ enum AccessHouseLevel_t {
 	HOUSE_OWNER = 3,
 };
 
+enum HouseSaveSection_t : uint8_t {
+	HOUSE_SAVE_INFO,
+	HOUSE_SAVE_LISTS,
+	HOUSE_SAVE_ITEMS,
+
+	HOUSE_SAVE_SECTIONS
+};
+
 typedef std::list<HouseTile*> HouseTileList;
 typedef std::list<BedItem*> HouseBedItemList;
 
@@ -220,6 +228,14 @@ class House
 			return static_cast<uint32_t>(std::ceil(bedsList.size() / 2.)); //each bed takes 2 sqms of space, ceil is just for bad maps
 		}
 
+		// digest of what the last committed map save wrote, 0 when unknown
+		uint64_t getSavedDigest(HouseSaveSection_t section) const {
+			return savedDigests[section];
+		}
+		void setSavedDigest(HouseSaveSection_t section, uint64_t digest) {
+			savedDigests[section] = digest;
+		}
+
 	private:
 		bool transferToDepot() const;
 		bool transferToDepot(Player* player) const;
@@ -248,6 +264,8 @@ class House
 
 		Position posEntry = {};
 
+		uint64_t savedDigests[HOUSE_SAVE_SECTIONS] = {};
+
 		bool isLoaded = false;
 };
 
@@ -21,18 +21,20 @@
 
 #include "iologindata.h"
 #include "configmanager.h"
+#include "databasetasks.h"
 #include "game.h"
 
 extern ConfigManager g_config;
+extern DatabaseTasks g_databaseTasks;
 extern Game g_game;
 
-Account IOLoginData::loadAccount(uint32_t accno)
+Account IOLoginData::loadAccount(uint32_t accno, Database* db/* = Database::getInstance()*/)
 {
 	Account account;
 
 	std::ostringstream query;
 	query << "SELECT `id`, `password`, `type`, `premdays`, `lastday` FROM `accounts` WHERE `id` = " << accno;
-	DBResult_ptr result = Database::getInstance()->storeQuery(query.str());
+	DBResult_ptr result = db->storeQuery(query.str());
 	if (!result) {
 		return account;
 	}
@@ -44,17 +46,15 @@ Account IOLoginData::loadAccount(uint32_t accno)
 	return account;
 }
 
-bool IOLoginData::saveAccount(const Account& acc)
+bool IOLoginData::saveAccount(const Account& acc, Database* db/* = Database::getInstance()*/)
 {
 	std::ostringstream query;
 	query << "UPDATE `accounts` SET `premdays` = " << acc.premiumDays << ", `lastday` = " << acc.lastDay << " WHERE `id` = " << acc.id;
-	return Database::getInstance()->executeQuery(query.str());
+	return db->executeQuery(query.str());
 }
 
-bool IOLoginData::loginserverAuthentication(uint32_t accountNumber, const std::string& password, Account& account)
+bool IOLoginData::loginserverAuthentication(uint32_t accountNumber, const std::string& password, Account& account, Database* db/* = Database::getInstance()*/)
 {
-	Database* db = Database::getInstance();
-
 	std::ostringstream query;
 	query << "SELECT `id`, `password`, `type`, `premdays`, `lastday` FROM `accounts` WHERE `id` = " << accountNumber;
 	DBResult_ptr result = db->storeQuery(query.str());
@@ -149,83 +149,228 @@ void IOLoginData::updateOnlineStatus(uint32_t guid, bool login)
 	Database::getInstance()->executeQuery(query.str());
 }
 
-bool IOLoginData::preloadPlayer(Player* player, const std::string& name)
+static const char* PLAYER_LOAD_COLUMNS = "SELECT `id`, `name`, `account_id`, `group_id`, `deletion`, `sex`, `vocation`, `experience`, `level`, `maglevel`, `health`, `healthmax`, `blessings`, `mana`, `manamax`, `manaspent`, `soul`, `lookbody`, `lookfeet`, `lookhead`, `looklegs`, `looktype`, `posx`, `posy`, `posz`, `cap`, `lastlogin`, `lastlogout`, `lastip`, `conditions`, `skulltime`, `skull`, `town_id`, `balance`, `skill_fist`, `skill_fist_tries`, `skill_club`, `skill_club_tries`, `skill_sword`, `skill_sword_tries`, `skill_axe`, `skill_axe_tries`, `skill_dist`, `skill_dist_tries`, `skill_shielding`, `skill_shielding_tries`, `skill_fishing`, `skill_fishing_tries` FROM `players`";
+
+bool IOLoginData::loadPlayerById(Player* player, uint32_t id)
 {
-	Database* db = Database::getInstance();
+	std::ostringstream query;
+	query << PLAYER_LOAD_COLUMNS << " WHERE `id` = " << id;
+	return loadPlayer(player, Database::getInstance()->storeQuery(query.str()));
+}
 
+bool IOLoginData::loadPlayerByName(Player* player, const std::string& name)
+{
+	Database* db = Database::getInstance();
 	std::ostringstream query;
-	query << "SELECT `id`, `account_id`, `group_id`, `deletion`, (SELECT `type` FROM `accounts` WHERE `accounts`.`id` = `account_id`) AS `account_type`";
-	if (!g_config.getBoolean(ConfigManager::FREE_PREMIUM)) {
-		query << ", (SELECT `premdays` FROM `accounts` WHERE `accounts`.`id` = `account_id`) AS `premium_days`";
-	}
-	query << " FROM `players` WHERE `name` = " << db->escapeString(name);
-	DBResult_ptr result = db->storeQuery(query.str());
-	if (!result) {
-		return false;
-	}
+	query << PLAYER_LOAD_COLUMNS << " WHERE `name` = " << db->escapeString(name);
+	return loadPlayer(player, db->storeQuery(query.str()));
+}
 
-	if (result->getNumber<uint64_t>("deletion") != 0) {
+bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
+{
+	PlayerLoadRecord record;
+	if (!fetchPlayer(*Database::getInstance(), result, record)) {
 		return false;
 	}
+	return loadPlayer(player, record);
+}
 
-	player->setGUID(result->getNumber<uint32_t>("id"));
-	Group* group = g_game.groups.getGroup(result->getNumber<uint16_t>("group_id"));
-	if (!group) {
-		std::cout << "[Error - IOLoginData::preloadPlayer] " << player->name << " has Group ID " << result->getNumber<uint16_t>("group_id") << " which doesn't exist." << std::endl;
-		return false;
+PlayerLoadRecord::~PlayerLoadRecord()
+{
+	for (const auto& it : inventory) {
+		it.second->decrementReferenceCounter();
 	}
-	player->setGroup(group);
-	player->accountNumber = result->getNumber<uint32_t>("account_id");
-	player->accountType = static_cast<AccountType_t>(result->getNumber<uint16_t>("account_type"));
-	if (!g_config.getBoolean(ConfigManager::FREE_PREMIUM)) {
-		player->premiumDays = result->getNumber<uint16_t>("premium_days");
-	} else {
-		player->premiumDays = std::numeric_limits<uint16_t>::max();
+
+	for (const auto& it : depotLockers) {
+		it.second->decrementReferenceCounter();
 	}
-	return true;
 }
 
-bool IOLoginData::loadPlayerById(Player* player, uint32_t id)
+bool IOLoginData::fetchPlayerByName(Database& db, const std::string& name, PlayerLoadRecord& record)
 {
 	std::ostringstream query;
-	query << "SELECT `id`, `name`, `account_id`, `group_id`, `sex`, `vocation`, `experience`, `level`, `maglevel`, `health`, `healthmax`, `blessings`, `mana`, `manamax`, `manaspent`, `soul`, `lookbody`, `lookfeet`, `lookhead`, `looklegs`, `looktype`, `posx`, `posy`, `posz`, `cap`, `lastlogin`, `lastlogout`, `lastip`, `conditions`, `skulltime`, `skull`, `town_id`, `balance`, `skill_fist`, `skill_fist_tries`, `skill_club`, `skill_club_tries`, `skill_sword`, `skill_sword_tries`, `skill_axe`, `skill_axe_tries`, `skill_dist`, `skill_dist_tries`, `skill_shielding`, `skill_shielding_tries`, `skill_fishing`, `skill_fishing_tries` FROM `players` WHERE `id` = " << id;
-	return loadPlayer(player, Database::getInstance()->storeQuery(query.str()));
+	query << PLAYER_LOAD_COLUMNS << " WHERE `name` = " << db.escapeString(name);
+	DBResult_ptr result = db.storeQuery(query.str());
+	if (!result || result->getNumber<uint64_t>("deletion") != 0) {
+		return false;
+	}
+
+	if (!fetchPlayer(db, result, record)) {
+		return false;
+	}
+
+	uint32_t guid = result->getNumber<uint32_t>("id");
+	record.namelocked = IOBan::isPlayerNamelocked(db, guid);
+	record.banned = IOBan::isAccountBanned(db, record.account.id, record.banInfo);
+	return true;
 }
 
-bool IOLoginData::loadPlayerByName(Player* player, const std::string& name)
+bool IOLoginData::fetchPlayer(Database& db, DBResult_ptr result, PlayerLoadRecord& record)
 {
-	Database* db = Database::getInstance();
+	// runs on any thread: nothing in here may touch game state
+	if (!result) {
+		return false;
+	}
+
+	record.result = result;
+
+	uint32_t guid = result->getNumber<uint32_t>("id");
+	record.account = loadAccount(result->getNumber<uint32_t>("account_id"), &db);
+
+	//Update premium days
+	Game::updatePremium(record.account, &db);
+
 	std::ostringstream query;
-	query << "SELECT `id`, `name`, `account_id`, `group_id`, `sex`, `vocation`, `experience`, `level`, `maglevel`, `health`, `healthmax`, `blessings`, `mana`, `manamax`, `manaspent`, `soul`, `lookbody`, `lookfeet`, `lookhead`, `looklegs`, `looktype`, `posx`, `posy`, `posz`, `cap`, `lastlogin`, `lastlogout`, `lastip`, `conditions`, `skulltime`, `skull`, `town_id`, `balance`, `skill_fist`, `skill_fist_tries`, `skill_club`, `skill_club_tries`, `skill_sword`, `skill_sword_tries`, `skill_axe`, `skill_axe_tries`, `skill_dist`, `skill_dist_tries`, `skill_shielding`, `skill_shielding_tries`, `skill_fishing`, `skill_fishing_tries` FROM `players` WHERE `name` = " << db->escapeString(name);
-	return loadPlayer(player, db->storeQuery(query.str()));
+	query << "SELECT `date` FROM `player_murders` WHERE `player_id` = " << guid << " ORDER BY `date` ASC";
+	if ((result = db.storeQuery(query.str()))) {
+		do {
+			record.murders.push_back(result->getNumber<time_t>("date"));
+		} while (result->next());
+	}
+
+	query.str(std::string());
+	query << "SELECT `guild_id`, `rank_id`, `nick` FROM `guild_membership` WHERE `player_id` = " << guid;
+	if ((result = db.storeQuery(query.str()))) {
+		record.guildId = result->getNumber<uint32_t>("guild_id");
+		record.guildRankId = result->getNumber<uint32_t>("rank_id");
+		record.guildNick = result->getString("nick");
+
+		// the guild may not be loaded yet, whether it is can only be told on
+		// the game thread, so everything needed to create it is read here
+		query.str(std::string());
+		query << "SELECT `name` FROM `guilds` WHERE `id` = " << record.guildId;
+		if ((result = db.storeQuery(query.str()))) {
+			record.guildName = result->getString("name");
+		}
+
+		query.str(std::string());
+		query << "SELECT `id`, `name`, `level` FROM `guild_ranks` WHERE `guild_id` = " << record.guildId << " OR `id` = " << record.guildRankId;
+		if ((result = db.storeQuery(query.str()))) {
+			do {
+				record.guildRanks.push_back({result->getNumber<uint32_t>("id"), result->getString("name"), static_cast<uint8_t>(result->getNumber<uint16_t>("level"))});
+			} while (result->next());
+		}
+
+		IOGuild::getWarList(db, record.guildId, record.guildWars);
+
+		query.str(std::string());
+		query << "SELECT COUNT(*) AS `members` FROM `guild_membership` WHERE `guild_id` = " << record.guildId;
+		if ((result = db.storeQuery(query.str()))) {
+			record.guildMembers = result->getNumber<uint32_t>("members");
+		}
+	}
+
+	query.str(std::string());
+	query << "SELECT `player_id`, `name` FROM `player_spells` WHERE `player_id` = " << guid;
+	if ((result = db.storeQuery(query.str()))) {
+		do {
+			record.spells.push_back(result->getString("name"));
+		} while (result->next());
+	}
+
+	//load inventory items
+	ItemMap itemMap;
+
+	query.str(std::string());
+	query << "SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_items` WHERE `player_id` = " << guid << " ORDER BY `sid` DESC";
+	if ((result = db.storeQuery(query.str()))) {
+		loadItems(itemMap, result);
+
+		for (ItemMap::const_reverse_iterator it = itemMap.rbegin(), end = itemMap.rend(); it != end; ++it) {
+			const std::pair<Item*, int32_t>& pair = it->second;
+			Item* item = pair.first;
+			int32_t pid = pair.second;
+			if (pid >= 1 && pid <= 10) {
+				record.inventory.emplace_back(pid, item);
+			} else {
+				ItemMap::const_iterator it2 = itemMap.find(pid);
+				if (it2 == itemMap.end()) {
+					continue;
+				}
+
+				Container* container = it2->second.first->getContainer();
+				if (container) {
+					container->internalAddThing(item);
+				}
+			}
+		}
+	}
+
+	//load depot items
+	itemMap.clear();
+
+	query.str(std::string());
+	query << "SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_depotitems` WHERE `player_id` = " << guid << " ORDER BY `sid` DESC";
+	if ((result = db.storeQuery(query.str()))) {
+		loadItems(itemMap, result);
+
+		for (ItemMap::const_reverse_iterator it = itemMap.rbegin(), end = itemMap.rend(); it != end; ++it) {
+			const std::pair<Item*, int32_t>& pair = it->second;
+			Item* item = pair.first;
+
+			int32_t pid = pair.second;
+			if (pid >= 0 && pid < 100) {
+				Container* itemContainer = item->getContainer();
+				if (itemContainer) {
+					DepotLocker* locker = itemContainer->getDepotLocker();
+					if (locker && !record.depotLockers.emplace(pid, locker).second) {
+						locker->decrementReferenceCounter();
+					}
+				}
+			} else {
+				ItemMap::const_iterator it2 = itemMap.find(pid);
+				if (it2 == itemMap.end()) {
+					continue;
+				}
+
+				Container* container = it2->second.first->getContainer();
+				if (container) {
+					container->internalAddThing(item);
+				}
+			}
+		}
+	}
+
+	//load storage map
+	query.str(std::string());
+	query << "SELECT `key`, `value` FROM `player_storage` WHERE `player_id` = " << guid;
+	if ((result = db.storeQuery(query.str()))) {
+		do {
+			record.storage.emplace_back(result->getNumber<uint32_t>("key"), result->getNumber<int32_t>("value"));
+		} while (result->next());
+	}
+
+	//load vip
+	query.str(std::string());
+	query << "SELECT `player_id` FROM `account_viplist` WHERE `account_id` = " << record.account.id;
+	if ((result = db.storeQuery(query.str()))) {
+		do {
+			record.vips.push_back(result->getNumber<uint32_t>("player_id"));
+		} while (result->next());
+	}
+	return true;
 }
 
-bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
+bool IOLoginData::loadPlayer(Player* player, PlayerLoadRecord& record)
 {
+	DBResult_ptr result = record.result;
 	if (!result) {
 		return false;
 	}
 
-	Database* db = Database::getInstance();
-
-	uint32_t accno = result->getNumber<uint32_t>("account_id");
-	Account acc = loadAccount(accno);
+	const Account& acc = record.account;
 
 	player->setGUID(result->getNumber<uint32_t>("id"));
 	player->name = result->getString("name");
-	player->accountNumber = accno;
+	player->accountNumber = result->getNumber<uint32_t>("account_id");
 
 	player->accountType = acc.accountType;
 
-	//Update premium days
-	Game::updatePremium(acc);
-
 	if (g_config.getBoolean(ConfigManager::FREE_PREMIUM)) {
 		player->premiumDays = std::numeric_limits<uint16_t>::max();
 	} else {
 		player->premiumDays = acc.premiumDays;
 	}
-
 	Group* group = g_game.groups.getGroup(result->getNumber<uint16_t>("group_id"));
 	if (!group) {
 		std::cout << "[Error - IOLoginData::loadPlayer] " << player->name << " has Group ID " << result->getNumber<uint16_t>("group_id") << " which doesn't exist" << std::endl;
@@ -350,160 +495,70 @@ bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
 		player->skills[i].percent = Player::getPercentLevel(skillTries, nextSkillTries);
 	}
 
-	std::ostringstream query;
-
-	query << "SELECT `date` FROM `player_murders` WHERE `player_id` = " << player->getGUID() << " ORDER BY `date` ASC";
-	if ((result = db->storeQuery(query.str()))) {
-		do {
-			player->murderTimeStamps.push_back(result->getNumber<time_t>("date"));
-		} while (result->next());
+	for (time_t murder : record.murders) {
+		player->murderTimeStamps.push_back(murder);
 	}
 
-	query.str(std::string());
-	query << "SELECT `guild_id`, `rank_id`, `nick` FROM `guild_membership` WHERE `player_id` = " << player->getGUID();
-	if ((result = db->storeQuery(query.str()))) {
-		uint32_t guildId = result->getNumber<uint32_t>("guild_id");
-		uint32_t playerRankId = result->getNumber<uint32_t>("rank_id");
-		player->guildNick = result->getString("nick");
-
-		Guild* guild = g_game.getGuild(guildId);
-		if (!guild) {
-			query.str(std::string());
-			query << "SELECT `name` FROM `guilds` WHERE `id` = " << guildId;
-			if ((result = db->storeQuery(query.str()))) {
-				guild = new Guild(guildId, result->getString("name"));
-				g_game.addGuild(guild);
-
-				query.str(std::string());
-				query << "SELECT `id`, `name`, `level` FROM `guild_ranks` WHERE `guild_id` = " << guildId;
-
-				if ((result = db->storeQuery(query.str()))) {
-					do {
-						guild->addRank(result->getNumber<uint32_t>("id"), result->getString("name"), result->getNumber<uint16_t>("level"));
-					} while (result->next());
-				}
+	if (record.guildId != 0) {
+		player->guildNick = record.guildNick;
+
+		Guild* guild = g_game.getGuild(record.guildId);
+		if (!guild && !record.guildName.empty()) {
+			guild = new Guild(record.guildId, record.guildName);
+			g_game.addGuild(guild);
+
+			for (const GuildRankRow& rank : record.guildRanks) {
+				guild->addRank(rank.id, rank.name, rank.level);
 			}
 		}
 
 		if (guild) {
 			player->guild = guild;
-			const GuildRank* rank = guild->getRankById(playerRankId);
+			const GuildRank* rank = guild->getRankById(record.guildRankId);
 			if (!rank) {
-				query.str(std::string());
-				query << "SELECT `id`, `name`, `level` FROM `guild_ranks` WHERE `id` = " << playerRankId;
-
-				if ((result = db->storeQuery(query.str()))) {
-					guild->addRank(result->getNumber<uint32_t>("id"), result->getString("name"), result->getNumber<uint16_t>("level"));
+				for (const GuildRankRow& row : record.guildRanks) {
+					if (row.id == record.guildRankId) {
+						guild->addRank(row.id, row.name, row.level);
+						break;
+					}
 				}
 
-				rank = guild->getRankById(playerRankId);
+				rank = guild->getRankById(record.guildRankId);
 				if (!rank) {
 					player->guild = nullptr;
 				}
 			}
 
 			player->guildRank = rank;
-
-			IOGuild::getWarList(guildId, player->guildWarList);
-
-			query.str(std::string());
-			query << "SELECT COUNT(*) AS `members` FROM `guild_membership` WHERE `guild_id` = " << guildId;
-			if ((result = db->storeQuery(query.str()))) {
-				guild->setMemberCount(result->getNumber<uint32_t>("members"));
-			}
+			player->guildWarList = record.guildWars;
+			guild->setMemberCount(record.guildMembers);
 		}
 	}
 
-	query.str(std::string());
-	query << "SELECT `player_id`, `name` FROM `player_spells` WHERE `player_id` = " << player->getGUID();
-	if ((result = db->storeQuery(query.str()))) {
-		do {
-			player->learnedInstantSpellList.emplace_front(result->getString("name"));
-		} while (result->next());
+	for (const std::string& spell : record.spells) {
+		player->learnedInstantSpellList.emplace_front(spell);
 	}
 
-	//load inventory items
-	ItemMap itemMap;
-
-	query.str(std::string());
-	query << "SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_items` WHERE `player_id` = " << player->getGUID() << " ORDER BY `sid` DESC";
-	if ((result = db->storeQuery(query.str()))) {
-		loadItems(itemMap, result);
-
-		for (ItemMap::const_reverse_iterator it = itemMap.rbegin(), end = itemMap.rend(); it != end; ++it) {
-			const std::pair<Item*, int32_t>& pair = it->second;
-			Item* item = pair.first;
-			int32_t pid = pair.second;
-			if (pid >= 1 && pid <= 10) {
-				player->internalAddThing(pid, item);
-			} else {
-				ItemMap::const_iterator it2 = itemMap.find(pid);
-				if (it2 == itemMap.end()) {
-					continue;
-				}
-
-				Container* container = it2->second.first->getContainer();
-				if (container) {
-					container->internalAddThing(item);
-				}
-			}
-		}
+	for (const auto& it : record.inventory) {
+		player->internalAddThing(it.first, it.second);
 	}
+	record.inventory.clear();
 
-	//load depot items
-	itemMap.clear();
-
-	query.str(std::string());
-	query << "SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_depotitems` WHERE `player_id` = " << player->getGUID() << " ORDER BY `sid` DESC";
-	if ((result = db->storeQuery(query.str()))) {
-		loadItems(itemMap, result);
-
-		for (ItemMap::const_reverse_iterator it = itemMap.rbegin(), end = itemMap.rend(); it != end; ++it) {
-			const std::pair<Item*, int32_t>& pair = it->second;
-			Item* item = pair.first;
-
-			int32_t pid = pair.second;
-			if (pid >= 0 && pid < 100) {
-				Container* itemContainer = item->getContainer();
-				if (itemContainer) {
-					DepotLocker* locker = itemContainer->getDepotLocker();
-					if (locker) {
-						DepotLocker* existingLocker = player->getDepotLocker(pid, false);
-						if (!existingLocker) {
-							player->depotLockerMap[pid] = locker;
-						}
-					}
-				}
-			} else {
-				ItemMap::const_iterator it2 = itemMap.find(pid);
-				if (it2 == itemMap.end()) {
-					continue;
-				}
-
-				Container* container = it2->second.first->getContainer();
-				if (container) {
-					container->internalAddThing(item);
-				}
-			}
+	for (const auto& it : record.depotLockers) {
+		if (!player->getDepotLocker(it.first, false)) {
+			player->depotLockerMap[it.first] = it.second;
+		} else {
+			it.second->decrementReferenceCounter();
 		}
 	}
+	record.depotLockers.clear();
 
-	//load storage map
-	query.str(std::string());
-	query << "SELECT `key`, `value` FROM `player_storage` WHERE `player_id` = " << player->getGUID();
-	if ((result = db->storeQuery(query.str()))) {
-		do {
-			player->addStorageValue(result->getNumber<uint32_t>("key"), result->getNumber<int32_t>("value"));
-		} while (result->next());
+	for (const auto& it : record.storage) {
+		player->addStorageValue(it.first, it.second);
 	}
 
-	//load vip
-	query.str(std::string());
-	query << "SELECT `player_id` FROM `account_viplist` WHERE `account_id` = " << player->getAccount();
-	if ((result = db->storeQuery(query.str()))) {
-		do {
-			player->addVIPInternal(result->getNumber<uint32_t>("player_id"));
-		} while (result->next());
+	for (uint32_t vip : record.vips) {
+		player->addVIPInternal(vip);
 	}
 
 	player->updateBaseSpeed();
@@ -512,16 +567,78 @@ bool IOLoginData::loadPlayer(Player* player, DBResult_ptr result)
 	return true;
 }
 
-bool IOLoginData::saveItems(const Player* player, const ItemBlockList& itemList, DBInsert& query_insert, PropWriteStream& propWriteStream)
+// saves are versioned when they are snapshotted, a write that lost the race
+// against a newer one for the same player is dropped instead of applied
+struct PlayerSaveState {
+	uint64_t version = 0;
+	uint32_t pendingSaves = 0; // async saves whose job still exists
+	bool online = false;
+	bool hasDigest = false;
+	PlayerSaveDigest digest;
+};
+
+static std::atomic<uint64_t> playerSaveVersion{0};
+static std::mutex playerSaveLock;
+// only players that are online or still have a save queued are kept
+static std::unordered_map<uint32_t, PlayerSaveState> playerSaveStates;
+
+// call with playerSaveLock held
+static void releaseSaveStateIfIdle(uint32_t guid)
 {
-	std::ostringstream ss;
+	auto it = playerSaveStates.find(guid);
+	if (it != playerSaveStates.end() && !it->second.online && it->second.pendingSaves == 0) {
+		playerSaveStates.erase(it);
+	}
+}
 
+// keeps the state of a player alive while an async save of it is queued or
+// running, released when the job is destroyed whether it ran or not
+class PendingPlayerSave
+{
+	public:
+		explicit PendingPlayerSave(uint32_t guid) : guid(guid) {
+			std::lock_guard<std::mutex> lockGuard(playerSaveLock);
+			++playerSaveStates[guid].pendingSaves;
+		}
+		~PendingPlayerSave() {
+			std::lock_guard<std::mutex> lockGuard(playerSaveLock);
+			auto it = playerSaveStates.find(guid);
+			if (it != playerSaveStates.end()) {
+				--it->second.pendingSaves;
+				releaseSaveStateIfIdle(guid);
+			}
+		}
+
+		// non-copyable
+		PendingPlayerSave(const PendingPlayerSave&) = delete;
+		PendingPlayerSave& operator=(const PendingPlayerSave&) = delete;
+
+	private:
+		uint32_t guid;
+};
+
+static constexpr size_t PLAYER_SAVE_STRIPES = 64;
+static std::mutex playerSaveStripes[PLAYER_SAVE_STRIPES];
+
+template<typename T>
+static inline void digestValue(uint64_t& digest, const T& value)
+{
+	digest = updateDigest(digest, &value, sizeof(value));
+}
+
+static inline void digestString(uint64_t& digest, const std::string& value)
+{
+	digestValue(digest, value.length());
+	digest = updateDigest(digest, value.data(), value.length());
+}
+
+void IOLoginData::snapshotItems(const ItemBlockList& itemList, std::vector<PlayerItemRow>& rows, PropWriteStream& propWriteStream)
+{
 	typedef std::pair<Container*, int32_t> containerBlock;
 	std::list<containerBlock> queue;
 
 	int32_t runningId = 100;
 
-	Database* db = Database::getInstance();
 	for (const auto& it : itemList) {
 		int32_t pid = it.first;
 		Item* item = it.second;
@@ -533,10 +650,7 @@ bool IOLoginData::saveItems(const Player* player, const ItemBlockList& itemList,
 		size_t attributesSize;
 		const char* attributes = propWriteStream.getStream(attributesSize);
 
-		ss << player->getGUID() << ',' << pid << ',' << runningId << ',' << item->getID() << ',' << item->getSubType() << ',' << db->escapeBlob(attributes, attributesSize);
-		if (!query_insert.addRow(ss)) {
-			return false;
-		}
+		rows.push_back({pid, runningId, item->getID(), item->getSubType(), std::string(attributes, attributesSize)});
 
 		if (Container* container = item->getContainer()) {
 			queue.emplace_back(container, runningId);
@@ -563,35 +677,47 @@ bool IOLoginData::saveItems(const Player* player, const ItemBlockList& itemList,
 			size_t attributesSize;
 			const char* attributes = propWriteStream.getStream(attributesSize);
 
-			ss << player->getGUID() << ',' << parentId << ',' << runningId << ',' << item->getID() << ',' << item->getSubType() << ',' << db->escapeBlob(attributes, attributesSize);
-			if (!query_insert.addRow(ss)) {
-				return false;
-			}
+			rows.push_back({parentId, runningId, item->getID(), item->getSubType(), std::string(attributes, attributesSize)});
+		}
+	}
+}
+
+uint64_t IOLoginData::getItemsDigest(const std::vector<PlayerItemRow>& rows)
+{
+	uint64_t digest = DIGEST_OFFSET;
+	for (const PlayerItemRow& row : rows) {
+		digestValue(digest, row.pid);
+		digestValue(digest, row.sid);
+		digestValue(digest, row.itemType);
+		digestValue(digest, row.count);
+		digestString(digest, row.attributes);
+	}
+	return digest;
+}
+
+bool IOLoginData::writeItems(Database& db, uint32_t guid, const std::vector<PlayerItemRow>& rows, DBInsert& query_insert)
+{
+	std::ostringstream ss;
+	for (const PlayerItemRow& row : rows) {
+		ss << guid << ',' << row.pid << ',' << row.sid << ',' << row.itemType << ',' << row.count << ',' << db.escapeBlob(row.attributes.data(), row.attributes.length());
+		if (!query_insert.addRow(ss)) {
+			return false;
 		}
 	}
 	return query_insert.execute();
 }
 
-bool IOLoginData::savePlayer(Player* player)
+PlayerSaveRecord_ptr IOLoginData::snapshotPlayer(Player* player)
 {
 	if (player->getHealth() <= 0) {
 		player->changeHealth(1);
 	}
 
-	Database* db = Database::getInstance();
-
-	std::ostringstream query;
-	query << "SELECT `save` FROM `players` WHERE `id` = " << player->getGUID();
-	DBResult_ptr result = db->storeQuery(query.str());
-	if (!result) {
-		return false;
-	}
-
-	if (result->getNumber<uint16_t>("save") == 0) {
-		query.str(std::string());
-		query << "UPDATE `players` SET `lastlogin` = " << player->lastLoginSaved << ", `lastip` = " << player->lastIP << " WHERE `id` = " << player->getGUID();
-		return db->executeQuery(query.str());
-	}
+	auto record = std::make_shared<PlayerSaveRecord>();
+	record->guid = player->getGUID();
+	record->version = ++playerSaveVersion;
+	record->lastLoginSaved = player->lastLoginSaved;
+	record->lastIP = player->lastIP;
 
 	//serialize conditions
 	PropWriteStream propWriteStream;
@@ -604,10 +730,9 @@ bool IOLoginData::savePlayer(Player* player)
 
 	size_t conditionsSize;
 	const char* conditions = propWriteStream.getStream(conditionsSize);
+	record->conditions.assign(conditions, conditionsSize);
 
-	//First, an UPDATE query to write the player itself
-	query.str(std::string());
-	query << "UPDATE `players` SET ";
+	std::ostringstream query;
 	query << "`level` = " << player->level << ',';
 	query << "`group_id` = " << player->group->id << ',';
 	query << "`vocation` = " << player->getVocationId() << ',';
@@ -642,8 +767,6 @@ bool IOLoginData::savePlayer(Player* player)
 		query << "`lastip` = " << player->lastIP << ',';
 	}
 
-	query << "`conditions` = " << db->escapeBlob(conditions, conditionsSize) << ',';
-
 	if (g_game.getWorldType() != WORLD_TYPE_PVP_ENFORCED) {
 		query << "`skulltime` = " << player->getPlayerKillerEnd() << ',';
 
@@ -674,125 +797,288 @@ bool IOLoginData::savePlayer(Player* player)
 	query << "`skill_fishing_tries` = " << player->skills[SKILL_FISHING].tries << ',';
 
 	if (!player->isOffline()) {
-		query << "`onlinetime` = `onlinetime` + " << (time(nullptr) - player->lastLoginSaved) << ',';
+		record->onlineTime = time(nullptr) - player->lastLoginSaved;
 	}
 	query << "`blessings` = " << static_cast<uint32_t>(player->blessings);
-	query << " WHERE `id` = " << player->getGUID();
+	record->columns = query.str();
 
-	DBTransaction transaction;
-	if (!transaction.begin()) {
-		return false;
+	record->spells.assign(player->learnedInstantSpellList.begin(), player->learnedInstantSpellList.end());
+	record->murders.assign(player->murderTimeStamps.begin(), player->murderTimeStamps.end());
+
+	ItemBlockList itemList;
+	for (int32_t slotId = 1; slotId <= 10; ++slotId) {
+		Item* item = player->inventory[slotId];
+		if (item) {
+			itemList.emplace_back(slotId, item);
+		}
 	}
+	snapshotItems(itemList, record->items, propWriteStream);
 
-	if (!db->executeQuery(query.str())) {
-		return false;
+	itemList.clear();
+	for (const auto& it : player->depotLockerMap) {
+		itemList.emplace_back(it.first, it.second);
 	}
+	snapshotItems(itemList, record->depotItems, propWriteStream);
 
-	// learned spells
-	query.str(std::string());
-	query << "DELETE FROM `player_spells` WHERE `player_id` = " << player->getGUID();
-	if (!db->executeQuery(query.str())) {
-		return false;
+	record->storage.assign(player->storageMap.begin(), player->storageMap.end());
+
+	PlayerSaveDigest& digest = record->digest;
+	digest.fill(DIGEST_OFFSET);
+	digestString(digest[PLAYER_SAVE_PLAYER], record->columns);
+	digestString(digest[PLAYER_SAVE_PLAYER], record->conditions);
+	for (const std::string& spellName : record->spells) {
+		digestString(digest[PLAYER_SAVE_SPELLS], spellName);
+	}
+	for (time_t timestamp : record->murders) {
+		digestValue(digest[PLAYER_SAVE_MURDERS], timestamp);
+	}
+	digest[PLAYER_SAVE_ITEMS] = getItemsDigest(record->items);
+	digest[PLAYER_SAVE_DEPOT] = getItemsDigest(record->depotItems);
+	for (const auto& it : record->storage) {
+		digestValue(digest[PLAYER_SAVE_STORAGE], it.first);
+		digestValue(digest[PLAYER_SAVE_STORAGE], it.second);
 	}
+	return record;
+}
 
-	query.str(std::string());
+bool IOLoginData::writePlayer(Database& db, const PlayerSaveRecord& record, uint32_t* rowsWritten/* = nullptr*/)
+{
+	uint32_t rows = 0;
+	if (rowsWritten) {
+		*rowsWritten = 0;
+	}
+
+	std::lock_guard<std::mutex> stripeGuard(playerSaveStripes[record.guid % PLAYER_SAVE_STRIPES]);
+
+	std::array<bool, PLAYER_SAVE_SECTIONS> dirty;
+	{
+		std::lock_guard<std::mutex> lockGuard(playerSaveLock);
+		auto it = playerSaveStates.find(record.guid);
+		if (it != playerSaveStates.end()) {
+			PlayerSaveState& state = it->second;
+			if (state.version > record.version) {
+				// a newer snapshot of this player already reached the database
+				return true;
+			}
 
-	DBInsert spellsQuery("INSERT INTO `player_spells` (`player_id`, `name` ) VALUES ");
-	for (const std::string& spellName : player->learnedInstantSpellList) {
-		query << player->getGUID() << ',' << db->escapeString(spellName);
-		if (!spellsQuery.addRow(query)) {
-			return false;
+			bool clean = true;
+			for (size_t i = 0; i < PLAYER_SAVE_SECTIONS; ++i) {
+				dirty[i] = !state.hasDigest || state.digest[i] != record.digest[i];
+				clean = clean && !dirty[i];
+			}
+
+			if (clean) {
+				// the database already holds this content, an older snapshot
+				// still queued must not overwrite it
+				state.version = record.version;
+				return true;
+			}
+		} else {
+			// nothing is known about an offline player, write every section
+			dirty.fill(true);
 		}
 	}
 
-	if (!spellsQuery.execute()) {
+	std::ostringstream query;
+	query << "SELECT `save` FROM `players` WHERE `id` = " << record.guid;
+	DBResult_ptr result = db.storeQuery(query.str());
+	if (!result) {
 		return false;
 	}
 
-	query.str(std::string());
-	query << "DELETE FROM `player_murders` WHERE `player_id` = " << player->getGUID();
-	
-	if (!db->executeQuery(query.str())) {
+	if (result->getNumber<uint16_t>("save") == 0) {
+		query.str(std::string());
+		query << "UPDATE `players` SET `lastlogin` = " << record.lastLoginSaved << ", `lastip` = " << record.lastIP << " WHERE `id` = " << record.guid;
+		if (!db.executeQuery(query.str())) {
+			return false;
+		}
+
+		if (rowsWritten) {
+			*rowsWritten = 1;
+		}
+		return true;
+	}
+
+	DBTransaction transaction(&db);
+	if (!transaction.begin()) {
 		return false;
 	}
 
-	query.str(std::string());
+	//First, an UPDATE query to write the player itself
+	if (dirty[PLAYER_SAVE_PLAYER]) {
+		query.str(std::string());
+		query << "UPDATE `players` SET " << record.columns << ',';
+		if (record.onlineTime >= 0) {
+			query << "`onlinetime` = `onlinetime` + " << record.onlineTime << ',';
+		}
+		query << "`conditions` = " << db.escapeBlob(record.conditions.data(), record.conditions.length());
+		query << " WHERE `id` = " << record.guid;
 
-	DBInsert murdersQuery("INSERT INTO `player_murders`(`id`, `player_id`, `date`) VALUES ");
-	for (time_t timestamp : player->murderTimeStamps) {
-		query << "NULL," << player->getGUID() << ',' << timestamp;
-		if (!murdersQuery.addRow(query)) {
+		if (!db.executeQuery(query.str())) {
 			return false;
 		}
+		++rows;
 	}
 
-	if (!murdersQuery.execute()) {
-		return false;
-	}
+	// learned spells
+	if (dirty[PLAYER_SAVE_SPELLS]) {
+		query.str(std::string());
+		query << "DELETE FROM `player_spells` WHERE `player_id` = " << record.guid;
+		if (!db.executeQuery(query.str())) {
+			return false;
+		}
 
-	//item saving
-	query.str(std::string());
-	query << "DELETE FROM `player_items` WHERE `player_id` = " << player->getGUID();
-	if (!db->executeQuery(query.str())) {
-		return false;
+		query.str(std::string());
+
+		DBInsert spellsQuery("INSERT INTO `player_spells` (`player_id`, `name` ) VALUES ", &db);
+		for (const std::string& spellName : record.spells) {
+			query << record.guid << ',' << db.escapeString(spellName);
+			if (!spellsQuery.addRow(query)) {
+				return false;
+			}
+		}
+
+		if (!spellsQuery.execute()) {
+			return false;
+		}
+		rows += record.spells.size();
 	}
 
-	DBInsert itemsQuery("INSERT INTO `player_items` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ");
+	if (dirty[PLAYER_SAVE_MURDERS]) {
+		query.str(std::string());
+		query << "DELETE FROM `player_murders` WHERE `player_id` = " << record.guid;
 
-	ItemBlockList itemList;
-	for (int32_t slotId = 1; slotId <= 10; ++slotId) {
-		Item* item = player->inventory[slotId];
-		if (item) {
-			itemList.emplace_back(slotId, item);
+		if (!db.executeQuery(query.str())) {
+			return false;
+		}
+
+		query.str(std::string());
+
+		DBInsert murdersQuery("INSERT INTO `player_murders`(`id`, `player_id`, `date`) VALUES ", &db);
+		for (time_t timestamp : record.murders) {
+			query << "NULL," << record.guid << ',' << timestamp;
+			if (!murdersQuery.addRow(query)) {
+				return false;
+			}
+		}
+
+		if (!murdersQuery.execute()) {
+			return false;
 		}
+		rows += record.murders.size();
 	}
 
-	if (!saveItems(player, itemList, itemsQuery, propWriteStream)) {
-		return false;
+	//item saving
+	if (dirty[PLAYER_SAVE_ITEMS]) {
+		query.str(std::string());
+		query << "DELETE FROM `player_items` WHERE `player_id` = " << record.guid;
+		if (!db.executeQuery(query.str())) {
+			return false;
+		}
+
+		DBInsert itemsQuery("INSERT INTO `player_items` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ", &db);
+		if (!writeItems(db, record.guid, record.items, itemsQuery)) {
+			return false;
+		}
+		rows += record.items.size();
 	}
 
 	//save depot items
-	query.str(std::string());
-	query << "DELETE FROM `player_depotitems` WHERE `player_id` = " << player->getGUID();
+	if (dirty[PLAYER_SAVE_DEPOT]) {
+		query.str(std::string());
+		query << "DELETE FROM `player_depotitems` WHERE `player_id` = " << record.guid;
 
-	if (!db->executeQuery(query.str())) {
-		return false;
+		if (!db.executeQuery(query.str())) {
+			return false;
+		}
+
+		DBInsert depotQuery("INSERT INTO `player_depotitems` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ", &db);
+		if (!writeItems(db, record.guid, record.depotItems, depotQuery)) {
+			return false;
+		}
+		rows += record.depotItems.size();
 	}
 
-	DBInsert depotQuery("INSERT INTO `player_depotitems` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ");
-	itemList.clear();
+	if (dirty[PLAYER_SAVE_STORAGE]) {
+		query.str(std::string());
+		query << "DELETE FROM `player_storage` WHERE `player_id` = " << record.guid;
+		if (!db.executeQuery(query.str())) {
+			return false;
+		}
 
-	for (const auto& it : player->depotLockerMap) {
-		itemList.emplace_back(it.first, it.second);
+		query.str(std::string());
+
+		DBInsert storageQuery("INSERT INTO `player_storage` (`player_id`, `key`, `value`) VALUES ", &db);
+
+		for (const auto& it : record.storage) {
+			query << record.guid << ',' << it.first << ',' << it.second;
+			if (!storageQuery.addRow(query)) {
+				return false;
+			}
+		}
+
+		if (!storageQuery.execute()) {
+			return false;
+		}
+		rows += record.storage.size();
 	}
 
-	if (!saveItems(player, itemList, depotQuery, propWriteStream)) {
+	//End the transaction
+	if (!transaction.commit()) {
 		return false;
 	}
 
-	query.str(std::string());
-	query << "DELETE FROM `player_storage` WHERE `player_id` = " << player->getGUID();
-	if (!db->executeQuery(query.str())) {
-		return false;
+	{
+		std::lock_guard<std::mutex> lockGuard(playerSaveLock);
+		auto it = playerSaveStates.find(record.guid);
+		if (it != playerSaveStates.end()) {
+			PlayerSaveState& state = it->second;
+			state.version = record.version;
+			state.hasDigest = true;
+			state.digest = record.digest;
+		}
 	}
 
-	query.str(std::string());
+	if (rowsWritten) {
+		*rowsWritten = rows;
+	}
+	return true;
+}
 
-	DBInsert storageQuery("INSERT INTO `player_storage` (`player_id`, `key`, `value`) VALUES ");
+void IOLoginData::resetSaveDigest(uint32_t guid)
+{
+	// the rows may have been changed behind our back while the player was away,
+	// the next save writes every section again
+	std::lock_guard<std::mutex> lockGuard(playerSaveLock);
+	PlayerSaveState& state = playerSaveStates[guid];
+	state.online = true;
+	state.hasDigest = false;
+}
 
-	for (const auto& it : player->storageMap) {
-		query << player->getGUID() << ',' << it.first << ',' << it.second;
-		if (!storageQuery.addRow(query)) {
-			return false;
-		}
+void IOLoginData::releaseSaveState(uint32_t guid)
+{
+	std::lock_guard<std::mutex> lockGuard(playerSaveLock);
+	auto it = playerSaveStates.find(guid);
+	if (it != playerSaveStates.end()) {
+		it->second.online = false;
+		releaseSaveStateIfIdle(guid);
 	}
+}
 
-	if (!storageQuery.execute()) {
-		return false;
-	}
+bool IOLoginData::savePlayer(Player* player)
+{
+	PlayerSaveRecord_ptr record = snapshotPlayer(player);
+	return writePlayer(*Database::getInstance(), *record);
+}
 
-	//End the transaction
-	return transaction.commit();
+void IOLoginData::savePlayerAsync(Player* player, std::function<void(bool, uint32_t)> callback/* = nullptr*/)
+{
+	PlayerSaveRecord_ptr record = snapshotPlayer(player);
+	auto rowsWritten = std::make_shared<uint32_t>(0);
+	auto pending = std::make_shared<PendingPlayerSave>(record->guid);
+	g_databaseTasks.addJob(record->guid, [record, rowsWritten, pending](Database& db) {
+		return writePlayer(db, *record, rowsWritten.get());
+	}, callback ? [callback, rowsWritten](bool success) { callback(success, *rowsWritten); } : std::function<void(bool)>());
 }
 
 std::string IOLoginData::getNameByGuid(uint32_t guid)
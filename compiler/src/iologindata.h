@@ -21,29 +21,126 @@
 #define FS_IOLOGINDATA_H_28B0440BEC594654AC0F4E1A5E42B2EF
 
 #include "account.h"
+#include "ban.h"
 #include "player.h"
 #include "database.h"
 
 typedef std::list<std::pair<int32_t, Item*>> ItemBlockList;
 
+struct PlayerItemRow {
+	int32_t pid;
+	int32_t sid;
+	uint16_t itemType;
+	uint16_t count;
+	std::string attributes;
+};
+
+enum PlayerSaveSection_t : uint8_t {
+	PLAYER_SAVE_PLAYER,
+	PLAYER_SAVE_SPELLS,
+	PLAYER_SAVE_MURDERS,
+	PLAYER_SAVE_ITEMS,
+	PLAYER_SAVE_DEPOT,
+	PLAYER_SAVE_STORAGE,
+
+	PLAYER_SAVE_SECTIONS
+};
+
+typedef std::array<uint64_t, PLAYER_SAVE_SECTIONS> PlayerSaveDigest;
+
+// Everything a save writes, copied out of the player on the game thread so the
+// queries can run on any connection without touching live objects
+struct PlayerSaveRecord {
+	uint32_t guid = 0;
+	uint64_t version = 0;
+	time_t lastLoginSaved = 0;
+	uint32_t lastIP = 0;
+
+	// numeric `players` column assignments, conditions are escaped at write time
+	std::string columns;
+	std::string conditions;
+	// seconds added to `onlinetime`, -1 for offline players, kept out of the digest
+	int64_t onlineTime = -1;
+
+	// content hash per section, sections matching the last committed save are skipped
+	PlayerSaveDigest digest = {};
+
+	std::vector<std::string> spells;
+	std::vector<time_t> murders;
+	std::vector<PlayerItemRow> items;
+	std::vector<PlayerItemRow> depotItems;
+	std::vector<std::pair<uint32_t, int32_t>> storage;
+};
+
+typedef std::shared_ptr<const PlayerSaveRecord> PlayerSaveRecord_ptr;
+
+struct GuildRankRow {
+	uint32_t id;
+	std::string name;
+	uint8_t level;
+};
+
+// Everything a load reads, fetched on any connection with the item trees
+// already built, applied to a Player on the game thread
+struct PlayerLoadRecord {
+	PlayerLoadRecord() = default;
+	~PlayerLoadRecord();
+
+	// non-copyable, owns the items until they are handed to a player
+	PlayerLoadRecord(const PlayerLoadRecord&) = delete;
+	PlayerLoadRecord& operator=(const PlayerLoadRecord&) = delete;
+
+	DBResult_ptr result; // the `players` row
+	Account account;
+
+	bool namelocked = false;
+	bool banned = false;
+	BanInfo banInfo;
+
+	uint32_t guildId = 0;
+	uint32_t guildRankId = 0;
+	std::string guildNick;
+	std::string guildName; // empty if the guild row is gone
+	std::vector<GuildRankRow> guildRanks;
+	GuildWarList guildWars;
+	uint32_t guildMembers = 0;
+
+	std::vector<time_t> murders;
+	std::vector<std::string> spells;
+	std::vector<std::pair<int32_t, Item*>> inventory;
+	std::map<uint32_t, DepotLocker*> depotLockers;
+	std::vector<std::pair<uint32_t, int32_t>> storage;
+	std::vector<uint32_t> vips;
+};
+
+typedef std::shared_ptr<PlayerLoadRecord> PlayerLoadRecord_ptr;
+
 class IOLoginData
 {
 	public:
-		static Account loadAccount(uint32_t accno);
-		static bool saveAccount(const Account& acc);
+		static Account loadAccount(uint32_t accno, Database* db = Database::getInstance());
+		static bool saveAccount(const Account& acc, Database* db = Database::getInstance());
 
-		static bool loginserverAuthentication(uint32_t accountNumber, const std::string& password, Account& account);
+		static bool loginserverAuthentication(uint32_t accountNumber, const std::string& password, Account& account, Database* db = Database::getInstance());
 		static uint32_t gameworldAuthentication(uint32_t accountNumber, const std::string& password, std::string& characterName);
 
 		static AccountType_t getAccountType(uint32_t accountId);
 		static void setAccountType(uint32_t accountId, AccountType_t accountType);
 		static void updateOnlineStatus(uint32_t guid, bool login);
-		static bool preloadPlayer(Player* player, const std::string& name);
 
 		static bool loadPlayerById(Player* player, uint32_t id);
 		static bool loadPlayerByName(Player* player, const std::string& name);
 		static bool loadPlayer(Player* player, DBResult_ptr result);
+		static bool loadPlayer(Player* player, PlayerLoadRecord& record);
+		static bool fetchPlayer(Database& db, DBResult_ptr result, PlayerLoadRecord& record);
+		static bool fetchPlayerByName(Database& db, const std::string& name, PlayerLoadRecord& record);
 		static bool savePlayer(Player* player);
+		static void savePlayerAsync(Player* player, std::function<void(bool, uint32_t)> callback = nullptr);
+		static PlayerSaveRecord_ptr snapshotPlayer(Player* player);
+		static bool writePlayer(Database& db, const PlayerSaveRecord& record, uint32_t* rowsWritten = nullptr);
+		static void resetSaveDigest(uint32_t guid);
+		// the player logged out, its save state goes away once no save is queued
+		static void releaseSaveState(uint32_t guid);
 		static uint32_t getGuidByName(const std::string& name);
 		static bool getGuidByNameEx(uint32_t& guid, bool& specialVip, std::string& name);
 		static std::string getNameByGuid(uint32_t guid);
@@ -62,7 +159,9 @@ class IOLoginData
 		typedef std::map<uint32_t, std::pair<Item*, uint32_t>> ItemMap;
 
 		static void loadItems(ItemMap& itemMap, DBResult_ptr result);
-		static bool saveItems(const Player* player, const ItemBlockList& itemList, DBInsert& query_insert, PropWriteStream& stream);
+		static void snapshotItems(const ItemBlockList& itemList, std::vector<PlayerItemRow>& rows, PropWriteStream& stream);
+		static bool writeItems(Database& db, uint32_t guid, const std::vector<PlayerItemRow>& rows, DBInsert& query_insert);
+		static uint64_t getItemsDigest(const std::vector<PlayerItemRow>& rows);
 };
 
 #endif
@@ -23,6 +23,14 @@
 
 #include "bed.h"
 
+#include <atomic>
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 /*
 	OTBM_ROOTV1
 	|
@@ -47,6 +55,28 @@
 	|--- OTBM_ITEM_DEF (not implemented)
 */
 
+static uint64_t getPeakMemoryUsage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	//kilobytes on Linux and the BSDs
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
 Tile* IOMap::createTile(Item*& ground, Item* item, uint16_t x, uint16_t y, uint8_t z)
 {
 	if (!ground) {
@@ -70,7 +100,7 @@ bool IOMap::loadMap(Map* map, const std::string& identifier)
 {
 	int64_t start = OTSYS_TIME();
 
-	FileLoader f;
+	MappedFileLoader f;
 	if (!f.openFile(identifier.c_str(), "OTBM")) {
 		std::ostringstream ss;
 		ss << "Could not open the file " << identifier << '.';
@@ -81,7 +111,7 @@ bool IOMap::loadMap(Map* map, const std::string& identifier)
 	uint32_t type;
 	PropStream propStream;
 
-	NODE root = f.getChildNode(nullptr, type);
+	MAPPED_NODE root = f.getChildNode(nullptr, type);
 	if (!f.getProps(root, propStream)) {
 		setLastErrorString("Could not read root property.");
 		return false;
@@ -111,7 +141,7 @@ bool IOMap::loadMap(Map* map, const std::string& identifier)
 	map->width = root_header.width;
 	map->height = root_header.height;
 
-	NODE nodeMap = f.getChildNode(root, type);
+	MAPPED_NODE nodeMap = f.getChildNode(root, type);
 	if (type != OTBM_MAP_DATA) {
 		setLastErrorString("Could not read data node.");
 		return false;
@@ -161,7 +191,9 @@ bool IOMap::loadMap(Map* map, const std::string& identifier)
 		}
 	}
 
-	NODE nodeMapData = f.getChildNode(nodeMap, type);
+	std::vector<const uint8_t*> areas;
+
+	MAPPED_NODE nodeMapData = f.getChildNode(nodeMap, type);
 	while (nodeMapData != NO_NODE) {
 		if (f.getError() != ERROR_NONE) {
 			setLastErrorString("Invalid map node.");
@@ -169,216 +201,10 @@ bool IOMap::loadMap(Map* map, const std::string& identifier)
 		}
 
 		if (type == OTBM_TILE_AREA) {
-			if (!f.getProps(nodeMapData, propStream)) {
-				setLastErrorString("Invalid map node.");
-				return false;
-			}
-
-			OTBM_Destination_coords area_coord;
-			if (!propStream.read(area_coord)) {
-				setLastErrorString("Invalid map node.");
-				return false;
-			}
-
-			uint16_t base_x = area_coord.x;
-			uint16_t base_y = area_coord.y;
-			uint16_t z = area_coord.z;
-
-			NODE nodeTile = f.getChildNode(nodeMapData, type);
-			while (nodeTile != NO_NODE) {
-				if (f.getError() != ERROR_NONE) {
-					setLastErrorString("Could not read node data.");
-					return false;
-				}
-
-				if (type != OTBM_TILE && type != OTBM_HOUSETILE) {
-					setLastErrorString("Unknown tile node.");
-					return false;
-				}
-
-				if (!f.getProps(nodeTile, propStream)) {
-					setLastErrorString("Could not read node data.");
-					return false;
-				}
-
-				OTBM_Tile_coords tile_coord;
-				if (!propStream.read(tile_coord)) {
-					setLastErrorString("Could not read tile position.");
-					return false;
-				}
-
-				uint16_t x = base_x + tile_coord.x;
-				uint16_t y = base_y + tile_coord.y;
-
-				bool isHouseTile = false;
-				House* house = nullptr;
-				Tile* tile = nullptr;
-				Item* ground_item = nullptr;
-				uint32_t tileflags = TILESTATE_NONE;
-
-				if (type == OTBM_HOUSETILE) {
-					uint32_t houseId;
-					if (!propStream.read<uint32_t>(houseId)) {
-						std::ostringstream ss;
-						ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Could not read house id.";
-						setLastErrorString(ss.str());
-						return false;
-					}
-
-					house = map->houses.addHouse(houseId);
-					if (!house) {
-						std::ostringstream ss;
-						ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Could not create house id: " << houseId;
-						setLastErrorString(ss.str());
-						return false;
-					}
-
-					tile = new HouseTile(x, y, z, house);
-					house->addTile(static_cast<HouseTile*>(tile));
-					isHouseTile = true;
-				}
-
-				//read tile attributes
-				while (propStream.read<uint8_t>(attribute)) {
-					switch (attribute) {
-						case OTBM_ATTR_TILE_FLAGS: {
-							uint32_t flags;
-							if (!propStream.read<uint32_t>(flags)) {
-								std::ostringstream ss;
-								ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Failed to read tile flags.";
-								setLastErrorString(ss.str());
-								return false;
-							}
-
-							if ((flags & OTBM_TILEFLAG_PROTECTIONZONE) != 0) {
-								tileflags |= TILESTATE_PROTECTIONZONE;
-							} else if ((flags & OTBM_TILEFLAG_NOPVPZONE) != 0) {
-								tileflags |= TILESTATE_NOPVPZONE;
-							} else if ((flags & OTBM_TILEFLAG_PVPZONE) != 0) {
-								tileflags |= TILESTATE_PVPZONE;
-							}
-							
-							if ((flags & OTBM_TILEFLAG_REFRESH) != 0) {
-								tileflags |= TILESTATE_REFRESH;
-							}
-
-							if ((flags & OTBM_TILEFLAG_NOLOGOUT) != 0) {
-								tileflags |= TILESTATE_NOLOGOUT;
-							}
-							break;
-						}
-
-						case OTBM_ATTR_ITEM: {
-							Item* item = Item::CreateItem(propStream);
-							if (!item) {
-								std::ostringstream ss;
-								ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Failed to create item.";
-								setLastErrorString(ss.str());
-								return false;
-							}
-
-							if (isHouseTile && item->isMoveable()) {
-								//std::cout << "[Warning - IOMap::loadMap] Moveable item with ID: " << item->getID() << ", in house: " << house->getId() << ", at position [x: " << x << ", y: " << y << ", z: " << z << "]." << std::endl;
-								delete item;
-							} else {
-								if (item->getItemCount() <= 0) {
-									item->setItemCount(1);
-								}
-
-								if (tile) {
-									tile->internalAddThing(item);
-									item->startDecaying();
-									item->setLoadedFromMap(true);
-								} else if (item->isGroundTile()) {
-									delete ground_item;
-									ground_item = item;
-								} else {
-									tile = createTile(ground_item, item, x, y, z);
-									tile->internalAddThing(item);
-									item->startDecaying();
-									item->setLoadedFromMap(true);
-								}
-							}
-							break;
-						}
-
-						default:
-							std::ostringstream ss;
-							ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Unknown tile attribute.";
-							setLastErrorString(ss.str());
-							return false;
-					}
-				}
-
-				NODE nodeItem = f.getChildNode(nodeTile, type);
-				while (nodeItem) {
-					if (type != OTBM_ITEM) {
-						std::ostringstream ss;
-						ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Unknown node type.";
-						setLastErrorString(ss.str());
-						return false;
-					}
-
-					PropStream stream;
-					if (!f.getProps(nodeItem, stream)) {
-						setLastErrorString("Invalid item node.");
-						return false;
-					}
-
-					Item* item = Item::CreateItem(stream);
-					if (!item) {
-						std::ostringstream ss;
-						ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Failed to create item.";
-						setLastErrorString(ss.str());
-						return false;
-					}
-
-					if (!item->unserializeItemNode(f, nodeItem, stream)) {
-						std::ostringstream ss;
-						ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Failed to load item " << item->getID() << '.';
-						setLastErrorString(ss.str());
-						delete item;
-						return false;
-					}
-
-					if (isHouseTile && item->isMoveable()) {
-						//std::cout << "[Warning - IOMap::loadMap] Moveable item with ID: " << item->getID() << ", in house: " << house->getId() << ", at position [x: " << x << ", y: " << y << ", z: " << z << "]." << std::endl;
-						delete item;
-					} else {
-						if (item->getItemCount() <= 0) {
-							item->setItemCount(1);
-						}
-
-						if (tile) {
-							tile->internalAddThing(item);
-							item->startDecaying();
-							item->setLoadedFromMap(true);
-						} else if (item->isGroundTile()) {
-							delete ground_item;
-							ground_item = item;
-						} else {
-							tile = createTile(ground_item, item, x, y, z);
-							tile->internalAddThing(item);
-							item->startDecaying();
-							item->setLoadedFromMap(true);
-						}
-					}
-
-					nodeItem = f.getNextNode(nodeItem, type);
-				}
-
-				if (!tile) {
-					tile = createTile(ground_item, nullptr, x, y, z);
-				}
-
-				tile->setFlag(static_cast<tileflags_t>(tileflags));
-
-				map->setTile(x, y, z, tile);
-
-				nodeTile = f.getNextNode(nodeTile, type);
-			}
+			//decoded later on the loader threads
+			areas.push_back(f.getNodePosition(nodeMapData));
 		} else if (type == OTBM_TOWNS) {
-			NODE nodeTown = f.getChildNode(nodeMapData, type);
+			MAPPED_NODE nodeTown = f.getChildNode(nodeMapData, type);
 			while (nodeTown != NO_NODE) {
 				if (type != OTBM_TOWN) {
 					setLastErrorString("Unknown town node.");
@@ -421,7 +247,7 @@ bool IOMap::loadMap(Map* map, const std::string& identifier)
 				nodeTown = f.getNextNode(nodeTown, type);
 			}
 		} else if (type == OTBM_WAYPOINTS) {
-			NODE nodeWaypoint = f.getChildNode(nodeMapData, type);
+			MAPPED_NODE nodeWaypoint = f.getChildNode(nodeMapData, type);
 			while (nodeWaypoint != NO_NODE) {
 				if (type != OTBM_WAYPOINT) {
 					setLastErrorString("Unknown waypoint node.");
@@ -457,6 +283,349 @@ bool IOMap::loadMap(Map* map, const std::string& identifier)
 		nodeMapData = f.getNextNode(nodeMapData, type);
 	}
 
-	std::cout << "> Map loading time: " << (OTSYS_TIME() - start) / (1000.) << " seconds." << std::endl;
+	//a truncated or malformed node ends the walk early, so check once more
+	if (f.getError() != ERROR_NONE) {
+		setLastErrorString("Invalid map node.");
+		return false;
+	}
+
+	size_t threads = std::max<int32_t>(0, g_config.getNumber(ConfigManager::MAP_LOADER_THREADS));
+	if (threads == 0) {
+		threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+	}
+	threads = std::max<size_t>(1, std::min(threads, (areas.size() + MAP_AREAS_PER_CHUNK - 1) / MAP_AREAS_PER_CHUNK));
+
+	if (!loadAreas(map, f, areas, threads)) {
+		return false;
+	}
+
+	int64_t elapsed = std::max<int64_t>(1, OTSYS_TIME() - start);
+	std::cout << "> Map loading time: " << elapsed / (1000.) << " seconds";
+	std::cout << " (" << threads << " thread" << (threads != 1 ? "s" : "") << ", " << std::fixed << std::setprecision(1) << (f.getSize() / (1024. * 1024.)) / (elapsed / 1000.) << " MB/s";
+	if (uint64_t peak = getPeakMemoryUsage()) {
+		std::cout << ", peak RSS " << peak / (1024 * 1024) << " MB";
+	}
+	std::cout << ")." << std::defaultfloat << std::endl;
+	return true;
+}
+
+bool IOMap::loadAreas(Map* map, MappedFileLoader& f, const std::vector<const uint8_t*>& areas, size_t threads)
+{
+	std::vector<AreaChunk> chunks((areas.size() + MAP_AREAS_PER_CHUNK - 1) / MAP_AREAS_PER_CHUNK);
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		chunks[i].first = i * MAP_AREAS_PER_CHUNK;
+		chunks[i].last = std::min(areas.size(), chunks[i].first + MAP_AREAS_PER_CHUNK);
+	}
+
+	//chunks are claimed in file order, so every chunk before a failed one
+	//has been decoded by the time the workers are joined
+	std::atomic<size_t> nextChunk{0};
+	auto worker = [&]() {
+		MappedFileLoader loader;
+		loader.attach(f);
+
+		size_t i;
+		while ((i = nextChunk.fetch_add(1, std::memory_order_relaxed)) < chunks.size()) {
+			decodeAreas(loader, areas, chunks[i]);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < threads; ++i) {
+		workers.emplace_back(worker);
+	}
+	worker();
+
+	for (std::thread& thread : workers) {
+		thread.join();
+	}
+
+	//houses, tiles and everything that touches the game are handled here,
+	//in file order, so the result does not depend on the thread count
+	bool success = true;
+	for (AreaChunk& chunk : chunks) {
+		if (!commitAreas(map, f, chunk)) {
+			success = false;
+			break;
+		}
+
+		if (!chunk.error.empty()) {
+			setLastErrorString(chunk.error);
+			success = false;
+			break;
+		}
+	}
+
+	if (!success) {
+		for (AreaChunk& chunk : chunks) {
+			for (StagedItem& staged : chunk.items) {
+				delete staged.item;
+			}
+		}
+	}
+	return success;
+}
+
+void IOMap::decodeAreas(MappedFileLoader& f, const std::vector<const uint8_t*>& areas, AreaChunk& chunk)
+{
+	uint32_t type;
+	uint8_t attribute;
+	PropStream propStream;
+
+	for (size_t i = chunk.first; i < chunk.last; ++i) {
+		MAPPED_NODE nodeArea = f.getNodeAt(areas[i], type);
+		if (!f.getProps(nodeArea, propStream)) {
+			chunk.error = "Invalid map node.";
+			return;
+		}
+
+		OTBM_Destination_coords area_coord;
+		if (!propStream.read(area_coord)) {
+			chunk.error = "Invalid map node.";
+			return;
+		}
+
+		uint16_t base_x = area_coord.x;
+		uint16_t base_y = area_coord.y;
+		uint16_t z = area_coord.z;
+
+		MAPPED_NODE nodeTile = f.getChildNode(nodeArea, type);
+		while (nodeTile != NO_NODE) {
+			if (type != OTBM_TILE && type != OTBM_HOUSETILE) {
+				chunk.error = "Unknown tile node.";
+				return;
+			}
+
+			if (!f.getProps(nodeTile, propStream)) {
+				chunk.error = "Could not read node data.";
+				return;
+			}
+
+			OTBM_Tile_coords tile_coord;
+			if (!propStream.read(tile_coord)) {
+				chunk.error = "Could not read tile position.";
+				return;
+			}
+
+			StagedTile tile;
+			tile.x = base_x + tile_coord.x;
+			tile.y = base_y + tile_coord.y;
+			tile.z = z;
+			tile.houseId = 0;
+			tile.flags = TILESTATE_NONE;
+			tile.firstItem = chunk.items.size();
+			tile.isHouseTile = type == OTBM_HOUSETILE;
+
+			uint16_t x = tile.x;
+			uint16_t y = tile.y;
+
+			if (tile.isHouseTile && !propStream.read<uint32_t>(tile.houseId)) {
+				std::ostringstream ss;
+				ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Could not read house id.";
+				chunk.error = ss.str();
+				return;
+			}
+
+			//read tile attributes
+			while (propStream.read<uint8_t>(attribute)) {
+				switch (attribute) {
+					case OTBM_ATTR_TILE_FLAGS: {
+						uint32_t flags;
+						if (!propStream.read<uint32_t>(flags)) {
+							std::ostringstream ss;
+							ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Failed to read tile flags.";
+							chunk.error = ss.str();
+							return;
+						}
+
+						if ((flags & OTBM_TILEFLAG_PROTECTIONZONE) != 0) {
+							tile.flags |= TILESTATE_PROTECTIONZONE;
+						} else if ((flags & OTBM_TILEFLAG_NOPVPZONE) != 0) {
+							tile.flags |= TILESTATE_NOPVPZONE;
+						} else if ((flags & OTBM_TILEFLAG_PVPZONE) != 0) {
+							tile.flags |= TILESTATE_PVPZONE;
+						}
+
+						if ((flags & OTBM_TILEFLAG_REFRESH) != 0) {
+							tile.flags |= TILESTATE_REFRESH;
+						}
+
+						if ((flags & OTBM_TILEFLAG_NOLOGOUT) != 0) {
+							tile.flags |= TILESTATE_NOLOGOUT;
+						}
+						break;
+					}
+
+					case OTBM_ATTR_ITEM: {
+						Item* item = Item::CreateItem(propStream);
+						if (!item) {
+							std::ostringstream ss;
+							ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Failed to create item.";
+							chunk.error = ss.str();
+							return;
+						}
+
+						chunk.items.push_back({item, nullptr});
+						break;
+					}
+
+					default:
+						std::ostringstream ss;
+						ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Unknown tile attribute.";
+						chunk.error = ss.str();
+						return;
+				}
+			}
+
+			MAPPED_NODE nodeItem = f.getChildNode(nodeTile, type);
+			while (nodeItem) {
+				if (type != OTBM_ITEM) {
+					std::ostringstream ss;
+					ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Unknown node type.";
+					chunk.error = ss.str();
+					return;
+				}
+
+				PropStream stream;
+				if (!f.getProps(nodeItem, stream)) {
+					chunk.error = "Invalid item node.";
+					return;
+				}
+
+				//a bed looks up its sleeper in the database and registers it
+				//with the game, so it is left to the loading thread
+				uint16_t id;
+				PropStream peek = stream;
+				if (peek.read<uint16_t>(id) && Item::items[id].isBed()) {
+					chunk.items.push_back({nullptr, f.getNodePosition(nodeItem)});
+					nodeItem = f.getNextNode(nodeItem, type);
+					continue;
+				}
+
+				Item* item = Item::CreateItem(stream);
+				if (!item) {
+					std::ostringstream ss;
+					ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Failed to create item.";
+					chunk.error = ss.str();
+					return;
+				}
+
+				if (!item->unserializeItemNode(f, nodeItem, stream)) {
+					std::ostringstream ss;
+					ss << "[x:" << x << ", y:" << y << ", z:" << z << "] Failed to load item " << item->getID() << '.';
+					chunk.error = ss.str();
+					delete item;
+					return;
+				}
+
+				chunk.items.push_back({item, nullptr});
+				nodeItem = f.getNextNode(nodeItem, type);
+			}
+
+			if (f.getError() != ERROR_NONE) {
+				chunk.error = "Could not read node data.";
+				return;
+			}
+
+			tile.itemCount = chunk.items.size() - tile.firstItem;
+			chunk.tiles.push_back(tile);
+
+			nodeTile = f.getNextNode(nodeTile, type);
+		}
+
+		if (f.getError() != ERROR_NONE) {
+			chunk.error = "Could not read node data.";
+			return;
+		}
+	}
+}
+
+bool IOMap::commitAreas(Map* map, MappedFileLoader& f, AreaChunk& chunk)
+{
+	for (const StagedTile& staged : chunk.tiles) {
+		uint16_t x = staged.x;
+		uint16_t y = staged.y;
+		uint8_t z = staged.z;
+
+		House* house = nullptr;
+		Tile* tile = nullptr;
+		Item* ground_item = nullptr;
+
+		if (staged.isHouseTile) {
+			house = map->houses.addHouse(staged.houseId);
+			if (!house) {
+				std::ostringstream ss;
+				ss << "[x:" << x << ", y:" << y << ", z:" << static_cast<uint16_t>(z) << "] Could not create house id: " << staged.houseId;
+				setLastErrorString(ss.str());
+				return false;
+			}
+
+			tile = new HouseTile(x, y, z, house);
+			house->addTile(static_cast<HouseTile*>(tile));
+		}
+
+		for (uint32_t i = staged.firstItem, end = staged.firstItem + staged.itemCount; i < end; ++i) {
+			Item* item = chunk.items[i].item;
+			chunk.items[i].item = nullptr;
+
+			if (!item) {
+				uint32_t type;
+				MAPPED_NODE nodeItem = f.getNodeAt(chunk.items[i].node, type);
+
+				PropStream stream;
+				if (!f.getProps(nodeItem, stream)) {
+					setLastErrorString("Invalid item node.");
+					return false;
+				}
+
+				item = Item::CreateItem(stream);
+				if (!item) {
+					std::ostringstream ss;
+					ss << "[x:" << x << ", y:" << y << ", z:" << static_cast<uint16_t>(z) << "] Failed to create item.";
+					setLastErrorString(ss.str());
+					return false;
+				}
+
+				if (!item->unserializeItemNode(f, nodeItem, stream)) {
+					std::ostringstream ss;
+					ss << "[x:" << x << ", y:" << y << ", z:" << static_cast<uint16_t>(z) << "] Failed to load item " << item->getID() << '.';
+					setLastErrorString(ss.str());
+					delete item;
+					return false;
+				}
+			}
+
+			if (staged.isHouseTile && item->isMoveable()) {
+				//std::cout << "[Warning - IOMap::loadMap] Moveable item with ID: " << item->getID() << ", in house: " << house->getId() << ", at position [x: " << x << ", y: " << y << ", z: " << z << "]." << std::endl;
+				delete item;
+			} else {
+				if (item->getItemCount() <= 0) {
+					item->setItemCount(1);
+				}
+
+				if (tile) {
+					tile->internalAddThing(item);
+					item->startDecaying();
+					item->setLoadedFromMap(true);
+				} else if (item->isGroundTile()) {
+					delete ground_item;
+					ground_item = item;
+				} else {
+					tile = createTile(ground_item, item, x, y, z);
+					tile->internalAddThing(item);
+					item->startDecaying();
+					item->setLoadedFromMap(true);
+				}
+			}
+		}
+
+		if (!tile) {
+			tile = createTile(ground_item, nullptr, x, y, z);
+		}
+
+		tile->setFlag(static_cast<tileflags_t>(staged.flags));
+
+		map->setTile(x, y, z, tile);
+	}
 	return true;
 }
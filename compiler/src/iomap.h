@@ -109,10 +109,43 @@ struct OTBM_Tile_coords {
 
 #pragma pack()
 
+// tile areas are decoded in chunks of this many on the loader threads
+static constexpr size_t MAP_AREAS_PER_CHUNK = 16;
+
 class IOMap
 {
 	static Tile* createTile(Item*& ground, Item* item, uint16_t x, uint16_t y, uint8_t z);
 
+	// a tile decoded by a loader thread, its items are in AreaChunk::items
+	struct StagedTile {
+		uint32_t houseId;
+		uint32_t flags;
+		uint32_t firstItem;
+		uint32_t itemCount;
+		uint16_t x;
+		uint16_t y;
+		uint8_t z;
+		bool isHouseTile;
+	};
+
+	// either a decoded item or the node of one the loading thread decodes
+	struct StagedItem {
+		Item* item;
+		const uint8_t* node;
+	};
+
+	struct AreaChunk {
+		size_t first = 0;
+		size_t last = 0;
+		std::vector<StagedTile> tiles;
+		std::vector<StagedItem> items;
+		std::string error;
+	};
+
+	static void decodeAreas(MappedFileLoader& f, const std::vector<const uint8_t*>& areas, AreaChunk& chunk);
+	bool loadAreas(Map* map, MappedFileLoader& f, const std::vector<const uint8_t*>& areas, size_t threads);
+	bool commitAreas(Map* map, MappedFileLoader& f, AreaChunk& chunk);
+
 	public:
 		bool loadMap(Map* map, const std::string& identifier);
 
@@ -64,42 +64,114 @@ void IOMapSerialize::loadHouseItems(Map* map)
 	std::cout << "> Loaded house items in: " << (OTSYS_TIME() - start) / (1000.) << " s" << std::endl;
 }
 
-bool IOMapSerialize::saveHouseItems()
+bool IOMapSerialize::removeStaleHouses()
 {
-	int64_t start = OTSYS_TIME();
+	// saves only rewrite the rows of houses that changed, rows of houses no
+	// longer on the map would otherwise stay forever and be loaded again
+	std::string houseIds;
+	for (const auto& it : g_game.map.houses.getHouses()) {
+		if (!houseIds.empty()) {
+			houseIds.push_back(',');
+		}
+		houseIds.append(std::to_string(it.first));
+	}
+
 	Database* db = Database::getInstance();
-	std::ostringstream query;
+	std::string condition;
+	if (!houseIds.empty()) {
+		condition = " WHERE `house_id` NOT IN (" + houseIds + ')';
+	}
 
-	//Start the transaction
 	DBTransaction transaction;
 	if (!transaction.begin()) {
 		return false;
 	}
 
-	//clear old tile data
-	if (!db->executeQuery("DELETE FROM `tile_store`")) {
+	if (!db->executeQuery("DELETE FROM `tile_store`" + condition)) {
 		return false;
 	}
 
-	DBInsert stmt("INSERT INTO `tile_store` (`house_id`, `data`) VALUES ");
+	if (!db->executeQuery("DELETE FROM `house_lists`" + condition)) {
+		return false;
+	}
+	return transaction.commit();
+}
+
+bool IOMapSerialize::saveHouseItems()
+{
+	int64_t start = OTSYS_TIME();
+	Database* db = Database::getInstance();
+	std::ostringstream query;
+
+	// serialize everything first, only houses whose tiles differ from the
+	// last committed save are written
+	struct HouseItemsRecord {
+		House* house;
+		uint64_t digest;
+		std::vector<std::string> tiles;
+	};
+	std::vector<HouseItemsRecord> changed;
 
 	PropWriteStream stream;
-	for (const auto& it : g_game.map.houses.getHouses()) {
-		//save house items
+	const HouseMap& houses = g_game.map.houses.getHouses();
+	for (const auto& it : houses) {
 		House* house = it.second;
+
+		HouseItemsRecord record{house, DIGEST_OFFSET, {}};
 		for (HouseTile* tile : house->getTiles()) {
 			saveTile(stream, tile);
 
 			size_t attributesSize;
 			const char* attributes = stream.getStream(attributesSize);
 			if (attributesSize > 0) {
-				query << house->getId() << ',' << db->escapeBlob(attributes, attributesSize);
-				if (!stmt.addRow(query)) {
-					return false;
-				}
+				record.digest = updateDigest(record.digest, attributes, attributesSize);
+				record.tiles.emplace_back(attributes, attributesSize);
 				stream.clear();
 			}
 		}
+
+		if (record.digest != house->getSavedDigest(HOUSE_SAVE_ITEMS)) {
+			changed.push_back(std::move(record));
+		}
+	}
+
+	if (changed.empty()) {
+		std::cout << "> Saved house items in: " << (OTSYS_TIME() - start) / (1000.) << " s (no changes)" << std::endl;
+		return true;
+	}
+
+	//Start the transaction
+	DBTransaction transaction;
+	if (!transaction.begin()) {
+		return false;
+	}
+
+	//clear old tile data of the changed houses
+	query << "DELETE FROM `tile_store` WHERE `house_id` IN (";
+	for (size_t i = 0; i < changed.size(); ++i) {
+		if (i != 0) {
+			query << ',';
+		}
+		query << changed[i].house->getId();
+	}
+	query << ')';
+
+	if (!db->executeQuery(query.str())) {
+		return false;
+	}
+	query.str(std::string());
+
+	DBInsert stmt("INSERT INTO `tile_store` (`house_id`, `data`) VALUES ");
+
+	size_t rows = 0;
+	for (const HouseItemsRecord& record : changed) {
+		for (const std::string& tile : record.tiles) {
+			query << record.house->getId() << ',' << db->escapeBlob(tile.data(), tile.length());
+			if (!stmt.addRow(query)) {
+				return false;
+			}
+		}
+		rows += record.tiles.size();
 	}
 
 	if (!stmt.execute()) {
@@ -108,8 +180,14 @@ bool IOMapSerialize::saveHouseItems()
 
 	//End the transaction
 	bool success = transaction.commit();
-	std::cout << "> Saved house items in: " <<
-	          (OTSYS_TIME() - start) / (1000.) << " s" << std::endl;
+	if (success) {
+		for (const HouseItemsRecord& record : changed) {
+			record.house->setSavedDigest(HOUSE_SAVE_ITEMS, record.digest);
+		}
+	}
+
+	std::cout << "> Saved house items in: " << (OTSYS_TIME() - start) / (1000.) << " s (" <<
+	          changed.size() << " of " << houses.size() << " houses, " << rows << " tiles)" << std::endl;
 	return success;
 }
 
@@ -302,71 +380,124 @@ bool IOMapSerialize::saveHouseInfo()
 {
 	Database* db = Database::getInstance();
 
-	DBTransaction transaction;
-	if (!transaction.begin()) {
-		return false;
-	}
+	std::ostringstream query;
+	std::ostringstream listQuery;
 
-	if (!db->executeQuery("DELETE FROM `house_lists`")) {
-		return false;
-	}
+	// rows are buffered until the transaction is open, a full DBInsert
+	// buffer flushes on its own
+	std::vector<std::pair<House*, uint64_t>> changedInfo;
+	std::vector<std::pair<House*, uint64_t>> changedLists;
+	std::vector<std::string> infoRows;
+	std::vector<std::string> listRows;
+	std::string changedListIds;
 
-	std::ostringstream query;
 	for (const auto& it : g_game.map.houses.getHouses()) {
 		House* house = it.second;
-		query << "SELECT `id` FROM `houses` WHERE `id` = " << house->getId();
-		DBResult_ptr result = db->storeQuery(query.str());
-		if (result) {
-			query.str(std::string());
-			query << "UPDATE `houses` SET `owner` = " << house->getOwner() << ", `paid` = " << house->getPaidUntil() << ", `warnings` = " << house->getPayRentWarnings() << ", `name` = " << db->escapeString(house->getName()) << ", `town_id` = " << house->getTownId() << ", `rent` = " << house->getRent() << ", `size` = " << house->getTiles().size() << ", `beds` = " << house->getBedCount() << " WHERE `id` = " << house->getId();
-		} else {
-			query.str(std::string());
-			query << "INSERT INTO `houses` (`id`, `owner`, `paid`, `warnings`, `name`, `town_id`, `rent`, `size`, `beds`) VALUES (" << house->getId() << ',' << house->getOwner() << ',' << house->getPaidUntil() << ',' << house->getPayRentWarnings() << ',' << db->escapeString(house->getName()) << ',' << house->getTownId() << ',' << house->getRent() << ',' << house->getTiles().size() << ',' << house->getBedCount() << ')';
-		}
 
-		db->executeQuery(query.str());
+		query << house->getId() << ',' << house->getOwner() << ',' << house->getPaidUntil() << ',' << house->getPayRentWarnings() << ',' << db->escapeString(house->getName()) << ',' << house->getTownId() << ',' << house->getRent() << ',' << house->getTiles().size() << ',' << house->getBedCount();
+		std::string row = query.str();
 		query.str(std::string());
-	}
 
-	DBInsert stmt("INSERT INTO `house_lists` (`house_id` , `listid` , `list`) VALUES ");
-
-	for (const auto& it : g_game.map.houses.getHouses()) {
-		House* house = it.second;
+		uint64_t digest = updateDigest(DIGEST_OFFSET, row.data(), row.length());
+		if (digest != house->getSavedDigest(HOUSE_SAVE_INFO)) {
+			changedInfo.emplace_back(house, digest);
+			infoRows.push_back(std::move(row));
+		}
 
+		std::vector<std::string> lists;
 		std::string listText;
 		if (house->getAccessList(GUEST_LIST, listText) && !listText.empty()) {
-			query << house->getId() << ',' << GUEST_LIST << ',' << db->escapeString(listText);
-			if (!stmt.addRow(query)) {
-				return false;
-			}
+			listQuery << house->getId() << ',' << GUEST_LIST << ',' << db->escapeString(listText);
+			lists.push_back(listQuery.str());
+			listQuery.str(std::string());
 
 			listText.clear();
 		}
 
 		if (house->getAccessList(SUBOWNER_LIST, listText) && !listText.empty()) {
-			query << house->getId() << ',' << SUBOWNER_LIST << ',' << db->escapeString(listText);
-			if (!stmt.addRow(query)) {
-				return false;
-			}
+			listQuery << house->getId() << ',' << SUBOWNER_LIST << ',' << db->escapeString(listText);
+			lists.push_back(listQuery.str());
+			listQuery.str(std::string());
 
 			listText.clear();
 		}
 
 		for (Door* door : house->getDoors()) {
 			if (door->getAccessList(listText) && !listText.empty()) {
-				query << house->getId() << ',' << door->getDoorId() << ',' << db->escapeString(listText);
-				if (!stmt.addRow(query)) {
-					return false;
-				}
+				listQuery << house->getId() << ',' << door->getDoorId() << ',' << db->escapeString(listText);
+				lists.push_back(listQuery.str());
+				listQuery.str(std::string());
 
 				listText.clear();
 			}
 		}
+
+		digest = DIGEST_OFFSET;
+		for (const std::string& list : lists) {
+			digest = updateDigest(digest, list.data(), list.length() + 1);
+		}
+
+		if (digest != house->getSavedDigest(HOUSE_SAVE_LISTS)) {
+			changedLists.emplace_back(house, digest);
+			if (!changedListIds.empty()) {
+				changedListIds.push_back(',');
+			}
+			changedListIds.append(std::to_string(house->getId()));
+
+			listRows.insert(listRows.end(), std::make_move_iterator(lists.begin()), std::make_move_iterator(lists.end()));
+		}
 	}
 
-	if (!stmt.execute()) {
+	if (changedInfo.empty() && changedLists.empty()) {
+		return true;
+	}
+
+	DBTransaction transaction;
+	if (!transaction.begin()) {
 		return false;
 	}
 
-	return transaction.commit();
+	// one multi-row upsert for every house whose row changed
+	DBInsert houseStmt("INSERT INTO `houses` (`id`, `owner`, `paid`, `warnings`, `name`, `town_id`, `rent`, `size`, `beds`) VALUES ");
+	houseStmt.setUpsert({"owner", "paid", "warnings", "name", "town_id", "rent", "size", "beds"});
+	for (const std::string& row : infoRows) {
+		if (!houseStmt.addRow(row)) {
+			return false;
+		}
+	}
+
+	if (!houseStmt.execute()) {
+		return false;
+	}
+
+	if (!changedLists.empty()) {
+		query << "DELETE FROM `house_lists` WHERE `house_id` IN (" << changedListIds << ')';
+		if (!db->executeQuery(query.str())) {
+			return false;
+		}
+		query.str(std::string());
+
+		DBInsert listStmt("INSERT INTO `house_lists` (`house_id` , `listid` , `list`) VALUES ");
+		for (const std::string& row : listRows) {
+			if (!listStmt.addRow(row)) {
+				return false;
+			}
+		}
+
+		if (!listStmt.execute()) {
+			return false;
+		}
+	}
+
+	if (!transaction.commit()) {
+		return false;
+	}
+
+	for (const auto& it : changedInfo) {
+		it.first->setSavedDigest(HOUSE_SAVE_INFO, it.second);
+	}
+	for (const auto& it : changedLists) {
+		it.first->setSavedDigest(HOUSE_SAVE_LISTS, it.second);
+	}
+	return true;
 }
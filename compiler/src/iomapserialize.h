@@ -30,6 +30,8 @@ class IOMapSerialize
 		static bool saveHouseItems();
 		static bool loadHouseInfo();
 		static bool saveHouseInfo();
+		// drops stored tiles and lists of houses the map no longer has
+		static bool removeStaleHouses();
 
 	protected:
 		static void saveItem(PropWriteStream& stream, const Item* item);
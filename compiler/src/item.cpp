@@ -666,7 +666,7 @@ bool Item::unserializeAttr(PropStream& propStream)
 	return true;
 }
 
-bool Item::unserializeItemNode(FileLoader&, NODE, PropStream& propStream)
+bool Item::unserializeItemNode(MappedFileLoader&, MAPPED_NODE, PropStream& propStream)
 {
 	return unserializeAttr(propStream);
 }
@@ -23,11 +23,161 @@
 #include "spells.h"
 #include "movement.h"
 #include "script.h"
+#include "datacache.h"
+#include "condition.h"
 
 #include "pugicast.h"
 
 extern MoveEvents* g_moveEvents;
 
+// bump whenever ItemType or the items.srv parser changes
+static constexpr uint32_t ITEMS_CACHE_VERSION = 1;
+
+namespace {
+
+struct ItemCacheWriter {
+	PropWriteStream& stream;
+
+	template <typename T>
+	void operator()(const T& value) {
+		static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+		stream.write<T>(value);
+	}
+	void operator()(const std::string& value) {
+		stream.writeString(value);
+	}
+};
+
+struct ItemCacheReader {
+	PropStream& stream;
+	bool success = true;
+
+	template <typename T>
+	void operator()(T& value) {
+		success = success && stream.read<T>(value);
+	}
+	void operator()(std::string& value) {
+		success = success && stream.readString(value);
+	}
+};
+
+// every plain member of ItemType, the same list writes and reads the cache
+template <typename Type, typename Visitor>
+void visitItemType(Type& type, Visitor& visit)
+{
+	visit(type.group);
+	visit(type.type);
+	visit(type.id);
+	visit(type.stackable);
+
+	visit(type.name);
+	visit(type.article);
+	visit(type.pluralName);
+	visit(type.description);
+	visit(type.runeSpellName);
+	visit(type.vocationString);
+
+	visit(type.weight);
+	visit(type.decayTime);
+	visit(type.wieldInfo);
+	visit(type.minReqLevel);
+	visit(type.minReqMagicLevel);
+	visit(type.charges);
+	visit(type.attackStrength);
+	visit(type.attackVariation);
+	visit(type.manaConsumption);
+	visit(type.vocations);
+	visit(type.decayTo);
+	visit(type.attack);
+	visit(type.defense);
+	visit(type.extraDefense);
+	visit(type.armor);
+	visit(type.luck);
+	visit(type.luckGold);
+	visit(type.luckJewel);
+	visit(type.luckRune);
+	visit(type.luckCharge);
+	visit(type.rotateTo);
+	visit(type.runeMagLevel);
+	visit(type.runeLevel);
+	visit(type.nutrition);
+	visit(type.destroyTarget);
+
+	visit(type.combatType);
+	visit(type.damageType);
+
+	visit(type.transformToOnUse);
+	visit(type.transformToFree);
+	visit(type.disguiseId);
+	visit(type.destroyTo);
+	visit(type.maxTextLen);
+	visit(type.writeOnceItemId);
+	visit(type.transformEquipTo);
+	visit(type.transformDeEquipTo);
+	visit(type.maxItems);
+	visit(type.slotPosition);
+	visit(type.speed);
+
+	visit(type.magicEffect);
+	visit(type.bedPartnerDir);
+	visit(type.weaponType);
+	visit(type.ammoType);
+	visit(type.shootType);
+	visit(type.corpseType);
+	visit(type.fluidSource);
+
+	visit(type.fragility);
+	visit(type.alwaysOnTopOrder);
+	visit(type.lightLevel);
+	visit(type.lightColor);
+	visit(type.shootRange);
+	visit(type.weaponSpecialEffect);
+	visit(type.effectItem);
+	visit(type.radiusItem);
+	visit(type.count);
+	visit(type.damageA);
+	visit(type.damageB);
+	visit(type.delay);
+
+	visit(type.collisionEvent);
+	visit(type.separationEvent);
+	visit(type.useEvent);
+	visit(type.multiUseEvent);
+	visit(type.distUse);
+	visit(type.disguise);
+	visit(type.forceUse);
+	visit(type.changeUse);
+	visit(type.destroy);
+	visit(type.corpse);
+	visit(type.hasHeight);
+	visit(type.walkStack);
+	visit(type.blockSolid);
+	visit(type.blockPickupable);
+	visit(type.blockProjectile);
+	visit(type.blockPathFind);
+	visit(type.allowPickupable);
+	visit(type.showDuration);
+	visit(type.showCharges);
+	visit(type.showAttributes);
+	visit(type.replaceable);
+	visit(type.pickupable);
+	visit(type.rotatable);
+	visit(type.useable);
+	visit(type.moveable);
+	visit(type.alwaysOnTop);
+	visit(type.canReadText);
+	visit(type.canWriteText);
+	visit(type.isVertical);
+	visit(type.isHorizontal);
+	visit(type.isHangable);
+	visit(type.allowDistRead);
+	visit(type.lookThrough);
+	visit(type.stopTime);
+	visit(type.showCount);
+}
+
+}
+
 Items::Items()
 {
 	items.reserve(6000);
@@ -53,11 +203,108 @@ bool Items::reload()
 
 bool Items::loadItems()
 {
-	ScriptReader script;
-	if (!script.open("data/items/items.srv")) {
+	DataCache cache("data/items/items.srv", ITEMS_CACHE_VERSION);
+
+	PropStream propStream;
+	if (!cache.load(propStream) || !unserializeItems(propStream)) {
+		items.clear();
+
+		ScriptReader script;
+		if (!script.open("data/items/items.srv") || !parseItems(script)) {
+			return false;
+		}
+
+		if (script.Errors == 0) {
+			PropWriteStream propWriteStream;
+			serializeItems(propWriteStream);
+			cache.save(propWriteStream, script.IncludedFiles);
+		}
+	}
+
+	items.shrink_to_fit();
+
+	for (ItemType& type : items) {
+		std::string& name = type.name;
+		extractArticleAndName(name, type.article, type.name);
+		nameToItems.insert({ asLowerCaseString(type.name), type.id });
+		if (!name.empty()) {
+			if (type.stackable) {
+				type.showCount = true;
+				type.pluralName = pluralizeString(name);
+			}
+		}
+	}
+	return true;
+}
+
+void Items::serializeItems(PropWriteStream& propWriteStream) const
+{
+	ItemCacheWriter writer{propWriteStream};
+
+	propWriteStream.write<uint32_t>(items.size());
+	for (const ItemType& type : items) {
+		visitItemType(type, writer);
+
+		propWriteStream.write<uint8_t>(type.abilities ? 1 : 0);
+		if (type.abilities) {
+			writer(*type.abilities);
+		}
+
+		propWriteStream.write<uint8_t>(type.conditionDamage ? 1 : 0);
+		if (type.conditionDamage) {
+			type.conditionDamage->serialize(propWriteStream);
+			propWriteStream.write<uint8_t>(CONDITIONATTR_END);
+			propWriteStream.write<int32_t>(type.conditionDamage->getHitDamage());
+		}
+	}
+}
+
+bool Items::unserializeItems(PropStream& propStream)
+{
+	ItemCacheReader reader{propStream};
+
+	uint32_t count;
+	if (!propStream.read<uint32_t>(count)) {
 		return false;
 	}
 
+	items.clear();
+	items.resize(count);
+	for (ItemType& type : items) {
+		visitItemType(type, reader);
+
+		uint8_t hasAbilities = 0;
+		reader(hasAbilities);
+		if (hasAbilities) {
+			reader(type.getAbilities());
+		}
+
+		uint8_t hasCondition = 0;
+		reader(hasCondition);
+		if (hasCondition && reader.success) {
+			Condition* condition = Condition::createCondition(propStream);
+			if (!condition || condition->getId() != CONDITIONID_COMBAT || !condition->unserialize(propStream)) {
+				delete condition;
+				return false;
+			}
+
+			//only damage types are written here
+			type.conditionDamage.reset(static_cast<ConditionDamage*>(condition));
+
+			int32_t hitDamage = 0;
+			reader(hitDamage);
+			type.conditionDamage->setParam(CONDITION_PARAM_HIT_DAMAGE, hitDamage);
+		}
+
+		if (!reader.success) {
+			return false;
+		}
+	}
+	return propStream.size() == 0;
+}
+
+bool Items::parseItems(ScriptReader& script)
+{
 	std::string identifier;
 	uint16_t id = 0;
 	while (true) {
@@ -621,19 +868,6 @@ bool Items::loadItems()
 	}
 
 	script.close();
-	items.shrink_to_fit();
-
-	for (ItemType& type : items) {
-		std::string& name = type.name;
-		extractArticleAndName(name, type.article, type.name);
-		nameToItems.insert({ asLowerCaseString(type.name), type.id });
-		if (!name.empty()) {
-			if (type.stackable) {
-				type.showCount = true;
-				type.pluralName = pluralizeString(name);
-			}
-		}
-	}
 	return true;
 }
 
@@ -107,6 +107,7 @@ struct Abilities {
 };
 
 class ConditionDamage;
+class ScriptReader;
 
 class ItemType
 {
@@ -332,6 +333,12 @@ class Items
 		nameMap nameToItems;
 
 	protected:
+		bool parseItems(ScriptReader& script);
+
+		// everything parseItems produces, for the data cache
+		void serializeItems(PropWriteStream& propWriteStream) const;
+		bool unserializeItems(PropStream& propStream);
+
 		std::vector<ItemType> items;
 };
 #endif
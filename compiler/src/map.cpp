@@ -25,8 +25,10 @@
 #include "creature.h"
 #include "monster.h"
 #include "game.h"
+#include "configmanager.h"
 
 extern Game g_game;
+extern ConfigManager g_config;
 
 bool Map::loadMap(const std::string& identifier, bool loadHouses)
 {
@@ -36,6 +38,11 @@ bool Map::loadMap(const std::string& identifier, bool loadHouses)
 		return false;
 	}
 
+	//the same map must give the same checksum whatever mapLoaderThreads is
+	if (g_config.getBoolean(ConfigManager::MAP_CHECKSUM)) {
+		std::cout << "> Map checksum: " << std::hex << std::setw(16) << std::setfill('0') << getChecksum() << std::dec << std::setfill(' ') << std::endl;
+	}
+
 	Npcs::loadNpcs();
 	if (!IOMap::loadSpawns(this)) {
 		std::cout << "[Warning - Map::loadMap] Failed to load spawn data." << std::endl;
@@ -46,6 +53,10 @@ bool Map::loadMap(const std::string& identifier, bool loadHouses)
 			std::cout << "[Warning - Map::loadMap] Failed to load house data." << std::endl;
 		}
 
+		if (!IOMapSerialize::removeStaleHouses()) {
+			std::cout << "[Warning - Map::loadMap] Failed to remove stale house data." << std::endl;
+		}
+
 		IOMapSerialize::loadHouseInfo();
 		IOMapSerialize::loadHouseItems(this);
 	}
@@ -94,6 +105,55 @@ Tile* Map::getTile(uint16_t x, uint16_t y, uint8_t z) const
 	return floor->tiles[x & FLOOR_MASK][y & FLOOR_MASK];
 }
 
+void Map::getFloorTiles(int32_t x, int32_t y, uint8_t z, int32_t width, int32_t height, Tile** tiles) const
+{
+	std::fill(tiles, tiles + width * height, nullptr);
+	if (z >= MAP_MAX_LAYERS) {
+		return;
+	}
+
+	const int32_t x1 = std::max<int32_t>(0, x);
+	const int32_t y1 = std::max<int32_t>(0, y);
+	const int32_t x2 = std::min<int32_t>(0xFFFF, x + width - 1);
+	const int32_t y2 = std::min<int32_t>(0xFFFF, y + height - 1);
+	if (x1 > x2 || y1 > y2) {
+		return;
+	}
+
+	const int32_t startx = x1 - (x1 % FLOOR_SIZE);
+	const int32_t starty = y1 - (y1 % FLOOR_SIZE);
+
+	const QTreeLeafNode* leafS = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, startx, starty);
+	const QTreeLeafNode* leafE;
+
+	for (int32_t ny = starty; ny <= y2; ny += FLOOR_SIZE) {
+		leafE = leafS;
+		for (int32_t nx = startx; nx <= x2; nx += FLOOR_SIZE) {
+			if (leafE) {
+				if (const Floor* floor = leafE->getFloor(z)) {
+					const int32_t fromX = std::max<int32_t>(nx, x1), toX = std::min<int32_t>(nx + FLOOR_MASK, x2);
+					const int32_t fromY = std::max<int32_t>(ny, y1), toY = std::min<int32_t>(ny + FLOOR_MASK, y2);
+					for (int32_t tx = fromX; tx <= toX; ++tx) {
+						Tile** column = tiles + (tx - x) * height;
+						for (int32_t ty = fromY; ty <= toY; ++ty) {
+							column[ty - y] = floor->tiles[tx & FLOOR_MASK][ty & FLOOR_MASK];
+						}
+					}
+				}
+				leafE = leafE->leafE;
+			} else {
+				leafE = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, nx + FLOOR_SIZE, ny);
+			}
+		}
+
+		if (leafS) {
+			leafS = leafS->leafS;
+		} else {
+			leafS = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, startx, ny + FLOOR_SIZE);
+		}
+	}
+}
+
 void Map::setTile(uint16_t x, uint16_t y, uint8_t z, Tile* newTile)
 {
 	if (z >= MAP_MAX_LAYERS) {
@@ -273,6 +333,11 @@ void Map::moveCreature(Creature& creature, Tile& newTile, bool forceTeleport/* =
 	//add the creature
 	newTile.addThing(&creature);
 
+	if (creature.getPlayer()) {
+		// the floor may have changed without switching leaves
+		new_leaf->updatePlayerFloors();
+	}
+
 	if (!teleport) {
 		if (oldPos.y > newPos.y) {
 			creature.setDirection(DIRECTION_NORTH);
@@ -328,6 +393,13 @@ void Map::getSpectatorsInternal(SpectatorVec& list, const Position& centerPos, i
 	int32_t endx2 = x2 - (x2 % FLOOR_SIZE);
 	int32_t endy2 = y2 - (y2 % FLOOR_SIZE);
 
+	// leaves without players on the requested floors are skipped for player queries
+	const uint16_t floorMask = static_cast<uint16_t>(((1 << (maxRangeZ + 1)) - 1) & ~((1 << minRangeZ) - 1));
+
+	// a creature is in exactly one leaf, so only entries that were in the list
+	// before this query have to be checked for duplicates
+	const size_t existing = list.size();
+
 	const QTreeLeafNode* startLeaf = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, startx1, starty1);
 	const QTreeLeafNode* leafS = startLeaf;
 	const QTreeLeafNode* leafE;
@@ -336,19 +408,23 @@ void Map::getSpectatorsInternal(SpectatorVec& list, const Position& centerPos, i
 		leafE = leafS;
 		for (int_fast32_t nx = startx1; nx <= endx2; nx += FLOOR_SIZE) {
 			if (leafE) {
-				const CreatureVector& node_list = (onlyPlayers ? leafE->player_list : leafE->creature_list);
-				for (Creature* creature : node_list) {
-					const Position& cpos = creature->getPosition();
-					if (minRangeZ > cpos.z || maxRangeZ < cpos.z) {
-						continue;
-					}
+				if (!onlyPlayers || (leafE->playerFloors & floorMask) != 0) {
+					const CreatureVector& node_list = (onlyPlayers ? leafE->player_list : leafE->creature_list);
+					for (Creature* creature : node_list) {
+						const Position& cpos = creature->getPosition();
+						if (minRangeZ > cpos.z || maxRangeZ < cpos.z) {
+							continue;
+						}
 
-					int_fast16_t offsetZ = Position::getOffsetZ(centerPos, cpos);
-					if ((min_y + offsetZ) > cpos.y || (max_y + offsetZ) < cpos.y || (min_x + offsetZ) > cpos.x || (max_x + offsetZ) < cpos.x) {
-						continue;
-					}
+						int_fast16_t offsetZ = Position::getOffsetZ(centerPos, cpos);
+						if ((min_y + offsetZ) > cpos.y || (max_y + offsetZ) < cpos.y || (min_x + offsetZ) > cpos.x || (max_x + offsetZ) < cpos.x) {
+							continue;
+						}
 
-					list.insert(creature);
+						if (existing == 0 || std::find(list.begin(), list.begin() + existing, creature) == list.begin() + existing) {
+							list.push_back(creature);
+						}
+					}
 				}
 				leafE = leafE->leafE;
 			} else {
@@ -364,103 +440,111 @@ void Map::getSpectatorsInternal(SpectatorVec& list, const Position& centerPos, i
 	}
 }
 
+static void getSpectatorRangeZ(const Position& centerPos, bool multifloor, int32_t& minRangeZ, int32_t& maxRangeZ)
+{
+	if (multifloor) {
+		if (centerPos.z > 7) {
+			//underground
+
+			//8->15
+			minRangeZ = std::max<int32_t>(centerPos.getZ() - 2, 0);
+			maxRangeZ = std::min<int32_t>(centerPos.getZ() + 2, MAP_MAX_LAYERS - 1);
+		} else if (centerPos.z == 6) {
+			minRangeZ = 0;
+			maxRangeZ = 8;
+		} else if (centerPos.z == 7) {
+			minRangeZ = 0;
+			maxRangeZ = 9;
+		} else {
+			minRangeZ = 0;
+			maxRangeZ = 7;
+		}
+	} else {
+		minRangeZ = centerPos.z;
+		maxRangeZ = centerPos.z;
+	}
+}
+
 void Map::getSpectators(SpectatorVec& list, const Position& centerPos, bool multifloor /*= false*/, bool onlyPlayers /*= false*/, int32_t minRangeX /*= 0*/, int32_t maxRangeX /*= 0*/, int32_t minRangeY /*= 0*/, int32_t maxRangeY /*= 0*/)
 {
 	if (centerPos.z >= MAP_MAX_LAYERS) {
 		return;
 	}
 
-	bool foundCache = false;
-	bool cacheResult = false;
-
 	minRangeX = (minRangeX == 0 ? -maxViewportX : -minRangeX);
 	maxRangeX = (maxRangeX == 0 ? maxViewportX : maxRangeX);
 	minRangeY = (minRangeY == 0 ? -maxViewportY : -minRangeY);
 	maxRangeY = (maxRangeY == 0 ? maxViewportY : maxRangeY);
 
-	if (minRangeX == -maxViewportX && maxRangeX == maxViewportX && minRangeY == -maxViewportY && maxRangeY == maxViewportY && multifloor) {
-		if (onlyPlayers) {
-			auto it = playersSpectatorCache.find(centerPos);
-			if (it != playersSpectatorCache.end()) {
-				if (!list.empty()) {
-					const SpectatorVec& cachedList = it->second;
-					list.insert(cachedList.begin(), cachedList.end());
-				} else {
-					list = it->second;
-				}
+	int32_t minRangeZ;
+	int32_t maxRangeZ;
+	getSpectatorRangeZ(centerPos, multifloor, minRangeZ, maxRangeZ);
 
-				foundCache = true;
-			}
-		}
+	getSpectatorsInternal(list, centerPos, minRangeX, maxRangeX, minRangeY, maxRangeY, minRangeZ, maxRangeZ, onlyPlayers);
+}
+
+std::string Map::benchmarkSpectators(const Position& centerPos, uint32_t iterations)
+{
+	// the previous implementation: an unordered_set filled tile by tile from the
+	// leaf lists, the position cache never survived more than one task anyway
+	auto legacyScan = [this](std::unordered_set<Creature*>& list, const Position& pos, bool multifloor, bool onlyPlayers) {
+		int32_t minRangeZ, maxRangeZ;
+		getSpectatorRangeZ(pos, multifloor, minRangeZ, maxRangeZ);
+
+		int32_t startx = std::max<int32_t>(0, pos.x - maxViewportX + pos.z - maxRangeZ);
+		int32_t starty = std::max<int32_t>(0, pos.y - maxViewportY + pos.z - maxRangeZ);
+		for (int32_t ny = starty - (starty % FLOOR_SIZE); ny <= pos.y + maxViewportY + pos.z - minRangeZ; ny += FLOOR_SIZE) {
+			for (int32_t nx = startx - (startx % FLOOR_SIZE); nx <= pos.x + maxViewportX + pos.z - minRangeZ; nx += FLOOR_SIZE) {
+				const QTreeLeafNode* leaf = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, nx, ny);
+				if (!leaf) {
+					continue;
+				}
 
-		if (!foundCache) {
-			auto it = spectatorCache.find(centerPos);
-			if (it != spectatorCache.end()) {
-				if (!onlyPlayers) {
-					if (!list.empty()) {
-						const SpectatorVec& cachedList = it->second;
-						list.insert(cachedList.begin(), cachedList.end());
-					} else {
-						list = it->second;
+				for (Creature* creature : (onlyPlayers ? leaf->player_list : leaf->creature_list)) {
+					const Position& cpos = creature->getPosition();
+					if (minRangeZ > cpos.z || maxRangeZ < cpos.z) {
+						continue;
 					}
-				} else {
-					const SpectatorVec& cachedList = it->second;
-					for (Creature* spectator : cachedList) {
-						if (spectator->getPlayer()) {
-							list.insert(spectator);
-						}
+
+					int32_t offsetZ = Position::getOffsetZ(pos, cpos);
+					if (std::abs(cpos.x - offsetZ - pos.x) <= maxViewportX && std::abs(cpos.y - offsetZ - pos.y) <= maxViewportY) {
+						list.insert(creature);
 					}
 				}
-
-				foundCache = true;
-			} else {
-				cacheResult = true;
 			}
 		}
-	}
+	};
 
-	if (!foundCache) {
-		int32_t minRangeZ;
-		int32_t maxRangeZ;
+	std::vector<Position> positions;
+	positions.reserve(iterations);
+	for (uint32_t i = 0; i < iterations; ++i) {
+		positions.emplace_back(centerPos.x + uniform_random(-50, 50), centerPos.y + uniform_random(-50, 50), centerPos.z);
+	}
 
-		if (multifloor) {
-			if (centerPos.z > 7) {
-				//underground
+	std::ostringstream ss;
+	for (bool onlyPlayers : {false, true}) {
+		size_t found = 0, legacyFound = 0;
 
-				//8->15
-				minRangeZ = std::max<int32_t>(centerPos.getZ() - 2, 0);
-				maxRangeZ = std::min<int32_t>(centerPos.getZ() + 2, MAP_MAX_LAYERS - 1);
-			} else if (centerPos.z == 6) {
-				minRangeZ = 0;
-				maxRangeZ = 8;
-			} else if (centerPos.z == 7) {
-				minRangeZ = 0;
-				maxRangeZ = 9;
-			} else {
-				minRangeZ = 0;
-				maxRangeZ = 7;
-			}
-		} else {
-			minRangeZ = centerPos.z;
-			maxRangeZ = centerPos.z;
+		int64_t start = OTSYS_TIME();
+		for (const Position& pos : positions) {
+			SpectatorVec list;
+			getSpectators(list, pos, true, onlyPlayers);
+			found += list.size();
 		}
+		int64_t elapsed = OTSYS_TIME() - start;
 
-		getSpectatorsInternal(list, centerPos, minRangeX, maxRangeX, minRangeY, maxRangeY, minRangeZ, maxRangeZ, onlyPlayers);
-
-		if (cacheResult) {
-			if (onlyPlayers) {
-				playersSpectatorCache[centerPos] = list;
-			} else {
-				spectatorCache[centerPos] = list;
-			}
+		start = OTSYS_TIME();
+		for (const Position& pos : positions) {
+			std::unordered_set<Creature*> list;
+			legacyScan(list, pos, true, onlyPlayers);
+			legacyFound += list.size();
 		}
-	}
-}
+		int64_t legacyElapsed = OTSYS_TIME() - start;
 
-void Map::clearSpectatorCache()
-{
-	spectatorCache.clear();
-	playersSpectatorCache.clear();
+		ss << (onlyPlayers ? "players" : "creatures") << ": " << iterations << " queries, "
+		   << elapsed << " ms (" << found << " found) vs unordered_set " << legacyElapsed << " ms (" << legacyFound << " found)\n";
+	}
+	return ss.str();
 }
 
 bool Map::canThrowObjectTo(const Position& fromPos, const Position& toPos, bool checkLineOfSight /*= true*/,
@@ -570,12 +654,101 @@ const Tile* Map::canWalkTo(const Creature& creature, const Position& pos) const
 	return tile;
 }
 
-bool Map::getPathMatching(const Creature& creature, std::forward_list<Direction>& dirList, const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp) const
+namespace {
+
+// the node set the search used before AStarNodes, a linear scan for the best
+// open node and an unordered_map lookup, kept for /benchmark path
+class LegacyAStarNodes
+{
+	public:
+		LegacyAStarNodes(uint32_t x, uint32_t y) : nodes(), openNodes() {
+			curNode = 1;
+			closedNodes = 0;
+			openNodes[0] = true;
+
+			AStarNode& startNode = nodes[0];
+			startNode.parent = nullptr;
+			startNode.x = x;
+			startNode.y = y;
+			startNode.f = 0;
+			nodeTable[(x << 16) | y] = nodes;
+		}
+
+		AStarNode* createOpenNode(AStarNode* parent, uint32_t x, uint32_t y, int_fast32_t f) {
+			if (curNode >= MAX_NODES) {
+				return nullptr;
+			}
+
+			size_t retNode = curNode++;
+			openNodes[retNode] = true;
+
+			AStarNode* node = nodes + retNode;
+			nodeTable[(x << 16) | y] = node;
+			node->parent = parent;
+			node->x = x;
+			node->y = y;
+			node->f = f;
+			return node;
+		}
+
+		AStarNode* getBestNode() {
+			int32_t best_node_f = std::numeric_limits<int32_t>::max();
+			int32_t best_node = -1;
+			for (size_t i = 0; i < curNode; i++) {
+				if (openNodes[i] && nodes[i].f < best_node_f) {
+					best_node_f = nodes[i].f;
+					best_node = i;
+				}
+			}
+
+			if (best_node >= 0) {
+				return nodes + best_node;
+			}
+			return nullptr;
+		}
+
+		void closeNode(AStarNode* node) {
+			openNodes[node - nodes] = false;
+			++closedNodes;
+		}
+
+		void openNode(AStarNode* node) {
+			size_t index = node - nodes;
+			if (!openNodes[index]) {
+				openNodes[index] = true;
+				--closedNodes;
+			}
+		}
+
+		int_fast32_t getClosedNodes() const {
+			return closedNodes;
+		}
+
+		AStarNode* getNodeByPosition(uint32_t x, uint32_t y) {
+			auto it = nodeTable.find((x << 16) | y);
+			if (it == nodeTable.end()) {
+				return nullptr;
+			}
+			return it->second;
+		}
+
+	private:
+		AStarNode nodes[MAX_NODES];
+		bool openNodes[MAX_NODES];
+		std::unordered_map<uint32_t, AStarNode*> nodeTable;
+		size_t curNode;
+		int_fast32_t closedNodes;
+};
+
+}
+
+template<typename Nodes>
+static bool findPathMatching(const Map& map, const Creature& creature, std::forward_list<Direction>& dirList, const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp)
 {
 	Position pos = creature.getPosition();
 	Position endPos;
 
-	AStarNodes nodes(pos.x, pos.y);
+	Nodes nodes(pos.x, pos.y);
 
 	int32_t bestMatch = 0;
 
@@ -667,9 +840,9 @@ bool Map::getPathMatching(const Creature& creature, std::forward_list<Direction>
 			const Tile* tile;
 			AStarNode* neighborNode = nodes.getNodeByPosition(pos.x, pos.y);
 			if (neighborNode) {
-				tile = getTile(pos.x, pos.y, pos.z);
+				tile = map.getTile(pos.x, pos.y, pos.z);
 			} else {
-				tile = canWalkTo(creature, pos);
+				tile = map.canWalkTo(creature, pos);
 				if (!tile) {
 					continue;
 				}
@@ -745,21 +918,99 @@ bool Map::getPathMatching(const Creature& creature, std::forward_list<Direction>
 	return true;
 }
 
+bool Map::getPathMatching(const Creature& creature, std::forward_list<Direction>& dirList, const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp) const
+{
+	if (pathCache.getPath(*this, creature, dirList, pathCondition, fpp)) {
+		return true;
+	}
+	return findPathMatching<AStarNodes>(*this, creature, dirList, pathCondition, fpp);
+}
+
+std::string Map::benchmarkPathfinding(const Creature& creature, uint32_t iterations) const
+{
+	// random targets and options around the creature, the same searches run
+	// through AStarNodes and the node set it replaced, the results must match
+	const Position& centerPos = creature.getPosition();
+
+	std::vector<std::pair<Position, FindPathParams>> searches;
+	searches.reserve(iterations);
+	for (uint32_t i = 0; i < iterations; ++i) {
+		FindPathParams fpp;
+		fpp.fullPathSearch = boolean_random();
+		fpp.clearSight = boolean_random();
+		fpp.allowDiagonal = boolean_random();
+		fpp.keepDistance = boolean_random(0.25);
+		fpp.maxSearchDist = boolean_random() ? 0 : 12;
+		fpp.maxTargetDist = uniform_random(1, 4);
+		fpp.minTargetDist = fpp.keepDistance ? fpp.maxTargetDist : uniform_random(0, fpp.maxTargetDist);
+		searches.emplace_back(Position(centerPos.x + uniform_random(-20, 20), centerPos.y + uniform_random(-20, 20), centerPos.z), fpp);
+	}
+
+	std::vector<std::forward_list<Direction>> paths(iterations), legacyPaths(iterations);
+	std::vector<bool> found(iterations), legacyFound(iterations);
+
+	int64_t start = OTSYS_TIME();
+	for (uint32_t i = 0; i < iterations; ++i) {
+		found[i] = findPathMatching<AStarNodes>(*this, creature, paths[i], FrozenPathingConditionCall(searches[i].first), searches[i].second);
+	}
+	int64_t elapsed = OTSYS_TIME() - start;
+
+	start = OTSYS_TIME();
+	for (uint32_t i = 0; i < iterations; ++i) {
+		legacyFound[i] = findPathMatching<LegacyAStarNodes>(*this, creature, legacyPaths[i], FrozenPathingConditionCall(searches[i].first), searches[i].second);
+	}
+	int64_t legacyElapsed = OTSYS_TIME() - start;
+
+	uint32_t foundCount = 0, mismatches = 0;
+	for (uint32_t i = 0; i < iterations; ++i) {
+		if (found[i]) {
+			++foundCount;
+		}
+		if (found[i] != legacyFound[i] || paths[i] != legacyPaths[i]) {
+			++mismatches;
+		}
+	}
+
+	std::ostringstream ss;
+	ss << iterations << " searches, " << foundCount << " found, " << mismatches << " differ from the legacy search\n"
+	   << "heap: " << elapsed << " ms vs linear scan " << legacyElapsed << " ms\n";
+	return ss.str();
+}
+
 // AStarNodes
 
+static AStarArena& getAStarArena()
+{
+	static thread_local AStarArena arena;
+	return arena;
+}
+
+static inline uint32_t getNodeTableSlot(uint32_t key)
+{
+	return (key * 2654435761u) >> (32 - NODE_TABLE_BITS);
+}
+
 AStarNodes::AStarNodes(uint32_t x, uint32_t y)
-	: nodes(), openNodes()
+	: arena(getAStarArena()), nodes(arena.nodes)
 {
+	if (++arena.generation == 0) {
+		std::fill(std::begin(arena.tableStamps), std::end(arena.tableStamps), 0);
+		arena.generation = 1;
+	}
+
 	curNode = 1;
 	closedNodes = 0;
-	openNodes[0] = true;
 
 	AStarNode& startNode = nodes[0];
 	startNode.parent = nullptr;
 	startNode.x = x;
 	startNode.y = y;
 	startNode.f = 0;
-	nodeTable[(x << 16) | y] = nodes;
+	insertTable(x, y, 0);
+
+	arena.heap[0] = 0;
+	arena.heapIndex[0] = 0;
+	heapSize = 1;
 }
 
 AStarNode* AStarNodes::createOpenNode(AStarNode* parent, uint32_t x, uint32_t y, int_fast32_t f)
@@ -769,43 +1020,44 @@ AStarNode* AStarNodes::createOpenNode(AStarNode* parent, uint32_t x, uint32_t y,
 	}
 
 	size_t retNode = curNode++;
-	openNodes[retNode] = true;
 
 	AStarNode* node = nodes + retNode;
-	nodeTable[(x << 16) | y] = node;
+	insertTable(x, y, retNode);
 	node->parent = parent;
 	node->x = x;
 	node->y = y;
 	node->f = f;
+
+	arena.heap[heapSize] = retNode;
+	arena.heapIndex[retNode] = heapSize;
+	siftUp(heapSize++);
 	return node;
 }
 
 AStarNode* AStarNodes::getBestNode()
 {
-	if (curNode == 0) {
+	if (heapSize == 0) {
 		return nullptr;
 	}
-
-	int32_t best_node_f = std::numeric_limits<int32_t>::max();
-	int32_t best_node = -1;
-	for (size_t i = 0; i < curNode; i++) {
-		if (openNodes[i] && nodes[i].f < best_node_f) {
-			best_node_f = nodes[i].f;
-			best_node = i;
-		}
-	}
-
-	if (best_node >= 0) {
-		return nodes + best_node;
-	}
-	return nullptr;
+	return nodes + arena.heap[0];
 }
 
 void AStarNodes::closeNode(AStarNode* node)
 {
 	size_t index = node - nodes;
 	assert(index < MAX_NODES);
-	openNodes[index] = false;
+
+	int_fast32_t pos = arena.heapIndex[index];
+	assert(pos >= 0);
+	arena.heapIndex[index] = -1;
+
+	if (pos != --heapSize) {
+		int16_t last = arena.heap[heapSize];
+		arena.heap[pos] = last;
+		arena.heapIndex[last] = pos;
+		siftUp(pos);
+		siftDown(arena.heapIndex[last]);
+	}
 	++closedNodes;
 }
 
@@ -813,9 +1065,15 @@ void AStarNodes::openNode(AStarNode* node)
 {
 	size_t index = node - nodes;
 	assert(index < MAX_NODES);
-	if (!openNodes[index]) {
-		openNodes[index] = true;
+
+	// the node only ever gets cheaper here, so moving it up is enough
+	if (arena.heapIndex[index] < 0) {
+		arena.heap[heapSize] = index;
+		arena.heapIndex[index] = heapSize;
+		siftUp(heapSize++);
 		--closedNodes;
+	} else {
+		siftUp(arena.heapIndex[index]);
 	}
 }
 
@@ -826,11 +1084,77 @@ int_fast32_t AStarNodes::getClosedNodes() const
 
 AStarNode* AStarNodes::getNodeByPosition(uint32_t x, uint32_t y)
 {
-	auto it = nodeTable.find((x << 16) | y);
-	if (it == nodeTable.end()) {
-		return nullptr;
+	const uint32_t key = (x << 16) | y;
+	for (uint32_t slot = getNodeTableSlot(key); arena.tableStamps[slot] == arena.generation; slot = (slot + 1) & (NODE_TABLE_SIZE - 1)) {
+		if (arena.tableKeys[slot] == key) {
+			return nodes + arena.tableNodes[slot];
+		}
+	}
+	return nullptr;
+}
+
+void AStarNodes::insertTable(uint32_t x, uint32_t y, int16_t index)
+{
+	const uint32_t key = (x << 16) | y;
+	uint32_t slot = getNodeTableSlot(key);
+	while (arena.tableStamps[slot] == arena.generation) {
+		slot = (slot + 1) & (NODE_TABLE_SIZE - 1);
+	}
+
+	arena.tableKeys[slot] = key;
+	arena.tableNodes[slot] = index;
+	arena.tableStamps[slot] = arena.generation;
+}
+
+bool AStarNodes::isBetter(int_fast32_t lhs, int_fast32_t rhs) const
+{
+	// ties go to the older node, the same order the linear scan used to pick
+	if (nodes[lhs].f != nodes[rhs].f) {
+		return nodes[lhs].f < nodes[rhs].f;
+	}
+	return lhs < rhs;
+}
+
+void AStarNodes::siftUp(int_fast32_t pos)
+{
+	int16_t index = arena.heap[pos];
+	while (pos > 0) {
+		int_fast32_t parent = (pos - 1) / 2;
+		if (!isBetter(index, arena.heap[parent])) {
+			break;
+		}
+
+		arena.heap[pos] = arena.heap[parent];
+		arena.heapIndex[arena.heap[pos]] = pos;
+		pos = parent;
+	}
+	arena.heap[pos] = index;
+	arena.heapIndex[index] = pos;
+}
+
+void AStarNodes::siftDown(int_fast32_t pos)
+{
+	int16_t index = arena.heap[pos];
+	while (true) {
+		int_fast32_t child = pos * 2 + 1;
+		if (child >= heapSize) {
+			break;
+		}
+
+		if (child + 1 < heapSize && isBetter(arena.heap[child + 1], arena.heap[child])) {
+			++child;
+		}
+
+		if (!isBetter(arena.heap[child], index)) {
+			break;
+		}
+
+		arena.heap[pos] = arena.heap[child];
+		arena.heapIndex[arena.heap[pos]] = pos;
+		pos = child;
 	}
-	return it->second;
+	arena.heap[pos] = index;
+	arena.heapIndex[index] = pos;
 }
 
 int_fast32_t AStarNodes::getMapWalkCost(AStarNode* node, const Position& neighborPos)
@@ -940,6 +1264,7 @@ void QTreeLeafNode::addCreature(Creature* c)
 
 	if (c->getPlayer()) {
 		player_list.push_back(c);
+		playerFloors |= 1 << c->getPosition().z;
 	}
 }
 
@@ -955,7 +1280,93 @@ void QTreeLeafNode::removeCreature(Creature* c)
 		assert(iter != player_list.end());
 		*iter = player_list.back();
 		player_list.pop_back();
+		updatePlayerFloors();
+	}
+}
+
+void QTreeLeafNode::updatePlayerFloors()
+{
+	playerFloors = 0;
+	for (Creature* player : player_list) {
+		playerFloors |= 1 << player->getPosition().z;
+	}
+}
+
+static uint64_t updateItemDigest(uint64_t digest, const Item* item, PropWriteStream& propWriteStream)
+{
+	uint16_t id = item->getID();
+	digest = updateDigest(digest, &id, sizeof(id));
+
+	propWriteStream.clear();
+	item->serializeAttr(propWriteStream);
+
+	size_t attributesSize;
+	const char* attributes = propWriteStream.getStream(attributesSize);
+	digest = updateDigest(digest, attributes, attributesSize);
+
+	if (const Container* container = item->getContainer()) {
+		uint32_t size = container->size();
+		digest = updateDigest(digest, &size, sizeof(size));
+		for (const Item* containerItem : container->getItemList()) {
+			digest = updateItemDigest(digest, containerItem, propWriteStream);
+		}
 	}
+	return digest;
+}
+
+uint64_t Map::getChecksum() const
+{
+	uint64_t digest = DIGEST_OFFSET;
+	PropWriteStream propWriteStream;
+
+	std::vector<const QTreeNode*> nodes {
+		&root
+	};
+	do {
+		const QTreeNode* node = nodes.back();
+		nodes.pop_back();
+		if (node->isLeaf()) {
+			const QTreeLeafNode* leafNode = static_cast<const QTreeLeafNode*>(node);
+			for (uint8_t z = 0; z < MAP_MAX_LAYERS; ++z) {
+				Floor* floor = leafNode->getFloor(z);
+				if (!floor) {
+					continue;
+				}
+
+				for (auto& row : floor->tiles) {
+					for (auto tile : row) {
+						if (!tile) {
+							continue;
+						}
+
+						const Position& pos = tile->getPosition();
+						uint32_t tileInfo[] = {pos.x, pos.y, pos.z, tile->getFlags(), 0};
+						if (HouseTile* houseTile = dynamic_cast<HouseTile*>(tile)) {
+							tileInfo[4] = houseTile->getHouse()->getId();
+						}
+						digest = updateDigest(digest, tileInfo, sizeof(tileInfo));
+
+						if (const Item* ground = tile->getGround()) {
+							digest = updateItemDigest(digest, ground, propWriteStream);
+						}
+
+						if (const TileItemVector* itemList = tile->getItemList()) {
+							for (const Item* item : *itemList) {
+								digest = updateItemDigest(digest, item, propWriteStream);
+							}
+						}
+					}
+				}
+			}
+		} else {
+			for (auto childNode : node->child) {
+				if (childNode) {
+					nodes.push_back(childNode);
+				}
+			}
+		}
+	} while (!nodes.empty());
+	return digest;
 }
 
 uint32_t Map::clean() const
@@ -29,6 +29,7 @@
 #include "town.h"
 #include "house.h"
 #include "spawn.h"
+#include "pathcache.h"
 
 class Creature;
 class Player;
@@ -46,15 +47,36 @@ struct AStarNode {
 };
 
 static constexpr int32_t MAX_NODES = 512;
+static constexpr int32_t NODE_TABLE_BITS = 10;
+static constexpr int32_t NODE_TABLE_SIZE = (1 << NODE_TABLE_BITS);
+static_assert(NODE_TABLE_SIZE >= MAX_NODES * 2, "node table load factor must stay below 0.5");
 
 static constexpr int32_t MAP_NORMALWALKCOST = 10;
 static constexpr int32_t MAP_DIAGONALWALKCOST = 25;
 
+// per-thread storage reused by every search, the lookup table is reset by
+// bumping the generation instead of clearing it
+struct AStarArena {
+	AStarNode nodes[MAX_NODES];
+	int16_t heap[MAX_NODES];
+	int16_t heapIndex[MAX_NODES];
+
+	uint32_t tableKeys[NODE_TABLE_SIZE];
+	uint32_t tableStamps[NODE_TABLE_SIZE];
+	int16_t tableNodes[NODE_TABLE_SIZE];
+	uint32_t generation = 0;
+};
+
 class AStarNodes
 {
 	public:
+		// open nodes come out by lowest cost, ties by creation order
 		AStarNodes(uint32_t x, uint32_t y);
 
+		// non-copyable
+		AStarNodes(const AStarNodes&) = delete;
+		AStarNodes& operator=(const AStarNodes&) = delete;
+
 		AStarNode* createOpenNode(AStarNode* parent, uint32_t x, uint32_t y, int_fast32_t f);
 		AStarNode* getBestNode();
 		void closeNode(AStarNode* node);
@@ -66,15 +88,18 @@ class AStarNodes
 		static int_fast32_t getTileWalkCost(const Creature& creature, const Tile* tile);
 
 	private:
-		AStarNode nodes[MAX_NODES];
-		bool openNodes[MAX_NODES];
-		std::unordered_map<uint32_t, AStarNode*> nodeTable;
+		bool isBetter(int_fast32_t lhs, int_fast32_t rhs) const;
+		void siftUp(int_fast32_t pos);
+		void siftDown(int_fast32_t pos);
+		void insertTable(uint32_t x, uint32_t y, int16_t index);
+
+		AStarArena& arena;
+		AStarNode* nodes;
 		size_t curNode;
+		int_fast32_t heapSize = 0;
 		int_fast32_t closedNodes;
 };
 
-typedef std::map<Position, SpectatorVec> SpectatorCache;
-
 static constexpr int32_t FLOOR_BITS = 3;
 static constexpr int32_t FLOOR_SIZE = (1 << FLOOR_BITS);
 static constexpr int32_t FLOOR_MASK = (FLOOR_SIZE - 1);
@@ -151,6 +176,7 @@ class QTreeLeafNode final : public QTreeNode
 
 		void addCreature(Creature* c);
 		void removeCreature(Creature* c);
+		void updatePlayerFloors();
 
 	protected:
 		static bool newLeaf;
@@ -159,6 +185,8 @@ class QTreeLeafNode final : public QTreeNode
 		Floor* array[MAP_MAX_LAYERS] = {};
 		CreatureVector creature_list;
 		CreatureVector player_list;
+		// bit z is set when a player of player_list stands on floor z
+		uint16_t playerFloors = 0;
 
 		friend class Map;
 		friend class QTreeNode;
@@ -179,6 +207,12 @@ class Map
 
 		uint32_t clean() const;
 
+		/**
+		  * Digest of every tile with its flags, house and items, walked in
+		  * position order, so two loads of the same map can be compared.
+		  */
+		uint64_t getChecksum() const;
+
 		/**
 		  * Load a map.
 		  * \returns true if the map was loaded successfully
@@ -200,6 +234,14 @@ class Map
 			return getTile(pos.x, pos.y, pos.z);
 		}
 
+		/**
+		  * Get all tiles of an area on one floor, walking the quadtree leaves
+		  * row by row instead of descending once per tile.
+		  * \param tiles receives width * height pointers in column order,
+		  * tiles[nx * height + ny], nullptr where there is no tile
+		  */
+		void getFloorTiles(int32_t x, int32_t y, uint8_t z, int32_t width, int32_t height, Tile** tiles) const;
+
 		/**
 		  * Set a single tile.
 		  */
@@ -223,7 +265,8 @@ class Map
 		                   int32_t minRangeX = 0, int32_t maxRangeX = 0,
 		                   int32_t minRangeY = 0, int32_t maxRangeY = 0);
 
-		void clearSpectatorCache();
+		// compares getSpectators against a plain unordered_set based scan around centerPos
+		std::string benchmarkSpectators(const Position& centerPos, uint32_t iterations);
 
 		/**
 		  * Checks if you can throw an object to that position
@@ -252,6 +295,9 @@ class Map
 
 		bool getPathMatching(const Creature& creature, std::forward_list<Direction>& dirList,
 		                     const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp) const;
+		// runs the same random searches around creature through AStarNodes and
+		// the linear scan it replaced and reports any path that differs
+		std::string benchmarkPathfinding(const Creature& creature, uint32_t iterations) const;
 
 		std::map<std::string, Position> waypoints;
 
@@ -263,11 +309,11 @@ class Map
 		Towns towns;
 		Houses houses;
 	protected:
-		SpectatorCache spectatorCache;
-		SpectatorCache playersSpectatorCache;
-
 		QTreeNode root;
 
+		// shared by monsters chasing the same creature, see getPathMatching
+		mutable PathCache pathCache;
+
 		std::string spawnfile;
 		std::string housefile;
 
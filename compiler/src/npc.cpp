@@ -27,11 +27,23 @@
 #include "spawn.h"
 #include "script.h"
 #include "behaviourdatabase.h"
+#include "datacache.h"
 
 extern Game g_game;
 
 uint32_t Npc::npcAutoID = 0x80000000;
 
+static constexpr uint32_t NPC_CACHE_VERSION = 2;
+
+// keys an npc script sets, see NpcType::fields
+enum NpcScriptField_t : uint8_t {
+	NPC_FIELD_NAME = 1 << 0,
+	NPC_FIELD_OUTFIT = 1 << 1,
+	NPC_FIELD_HOME = 1 << 2,
+	NPC_FIELD_RADIUS = 1 << 3,
+	NPC_FIELD_BEHAVIOUR = 1 << 4,
+};
+
 void Npcs::loadNpcs()
 {
 	std::cout << ">> Loading npcs..." << std::endl;
@@ -55,8 +67,13 @@ void Npcs::loadNpcs()
 	}
 }
 
+std::map<std::string, std::shared_ptr<const NpcType>> Npcs::npcTypes;
+
 void Npcs::reload()
 {
+	// every script is read again, once for all the npcs sharing it
+	npcTypes.clear();
+
 	const std::map<uint32_t, Npc*>& npcs = g_game.getNpcs();
 
 	for (const auto& it : npcs) {
@@ -102,19 +119,8 @@ void Npc::removeList()
 	g_game.removeNpc(this);
 }
 
-bool Npc::load()
+static bool parseNpcType(ScriptReader& script, NpcType& npcType)
 {
-	if (loaded) {
-		return true;
-	}
-
-	reset();
-
-	ScriptReader script;
-	if (!script.open(filename)) {
-		return false;
-	}
-
 	//int startMonth = -1, startDay = -1, endMonth = -1, endDay = -1;
 
 	while (true) {
@@ -133,41 +139,47 @@ bool Npc::load()
 		script.readSymbol('=');
 
 		if (ident == "name") {
-			name = script.readString();
+			npcType.name = script.readString();
+			npcType.fields |= NPC_FIELD_NAME;
 		}
 		else if (ident == "outfit") {
 			script.readSymbol('(');
 			uint8_t* c;
-			currentOutfit.lookType = script.readNumber();
+			npcType.outfit.lookType = script.readNumber();
 			script.readSymbol(',');
-			if (currentOutfit.lookType > 0) {
+			if (npcType.outfit.lookType > 0) {
 				c = script.readBytesequence();
-				currentOutfit.lookHead = c[0];
-				currentOutfit.lookBody = c[1];
-				currentOutfit.lookLegs = c[2];
-				currentOutfit.lookFeet = c[3];
+				npcType.outfit.lookHead = c[0];
+				npcType.outfit.lookBody = c[1];
+				npcType.outfit.lookLegs = c[2];
+				npcType.outfit.lookFeet = c[3];
 			}
 			else {
-				currentOutfit.lookTypeEx = script.readNumber();
+				npcType.outfit.lookTypeEx = script.readNumber();
 			}
 			script.readSymbol(')');
+			npcType.fields |= NPC_FIELD_OUTFIT;
 		}
 		else if (ident == "home") {
-			script.readCoordinate(masterPos.x, masterPos.y, masterPos.z);
+			script.readCoordinate(npcType.masterPos.x, npcType.masterPos.y, npcType.masterPos.z);
+			npcType.fields |= NPC_FIELD_HOME;
 		}
 		else if (ident == "radius") {
-			masterRadius = script.readNumber();
+			npcType.masterRadius = script.readNumber();
+			npcType.fields |= NPC_FIELD_RADIUS;
 		}
 		else if (ident == "behaviour") {
-			if (behaviourDatabase) {
+			if (npcType.program) {
 				script.error("behaviour database already defined");
 				return false;
 			}
 
-			behaviourDatabase = new BehaviourDatabase(this);
-			if (!behaviourDatabase->loadDatabase(script)) {
+			std::shared_ptr<BehaviourProgram> program = std::make_shared<BehaviourProgram>();
+			if (!program->loadDatabase(script)) {
 				return false;
 			}
+			npcType.program = program;
+			npcType.fields |= NPC_FIELD_BEHAVIOUR;
 		}/*
 		else if (ident == "startmonth") {
 			startMonth = script.readNumber();
@@ -201,8 +213,165 @@ bool Npc::load()
 		}
 	}*/
 
-	// NPC is not supposed to appear at this time
-	script.close();
+	return true;
+}
+
+static void serializeNpcType(PropWriteStream& propWriteStream, const NpcType& npcType)
+{
+	propWriteStream.write<uint8_t>(npcType.fields);
+	if (npcType.fields & NPC_FIELD_NAME) {
+		propWriteStream.writeString(npcType.name);
+	}
+
+	if (npcType.fields & NPC_FIELD_OUTFIT) {
+		propWriteStream.write<uint16_t>(npcType.outfit.lookType);
+		if (npcType.outfit.lookType > 0) {
+			propWriteStream.write<uint8_t>(npcType.outfit.lookHead);
+			propWriteStream.write<uint8_t>(npcType.outfit.lookBody);
+			propWriteStream.write<uint8_t>(npcType.outfit.lookLegs);
+			propWriteStream.write<uint8_t>(npcType.outfit.lookFeet);
+		} else {
+			propWriteStream.write<uint16_t>(npcType.outfit.lookTypeEx);
+		}
+	}
+
+	if (npcType.fields & NPC_FIELD_HOME) {
+		propWriteStream.write<uint16_t>(npcType.masterPos.x);
+		propWriteStream.write<uint16_t>(npcType.masterPos.y);
+		propWriteStream.write<uint8_t>(npcType.masterPos.z);
+	}
+
+	if (npcType.fields & NPC_FIELD_RADIUS) {
+		propWriteStream.write<uint32_t>(npcType.masterRadius);
+	}
+
+	if (npcType.fields & NPC_FIELD_BEHAVIOUR) {
+		npcType.program->serialize(propWriteStream);
+	}
+}
+
+static bool unserializeNpcType(PropStream& propStream, NpcType& npcType)
+{
+	if (!propStream.read<uint8_t>(npcType.fields)) {
+		return false;
+	}
+
+	if ((npcType.fields & NPC_FIELD_NAME) && !propStream.readString(npcType.name)) {
+		return false;
+	}
+
+	Outfit_t& outfit = npcType.outfit;
+	if (npcType.fields & NPC_FIELD_OUTFIT) {
+		if (!propStream.read<uint16_t>(outfit.lookType)) {
+			return false;
+		}
+
+		if (outfit.lookType > 0) {
+			if (!propStream.read<uint8_t>(outfit.lookHead) || !propStream.read<uint8_t>(outfit.lookBody) ||
+				!propStream.read<uint8_t>(outfit.lookLegs) || !propStream.read<uint8_t>(outfit.lookFeet)) {
+				return false;
+			}
+		} else if (!propStream.read<uint16_t>(outfit.lookTypeEx)) {
+			return false;
+		}
+	}
+
+	Position& masterPos = npcType.masterPos;
+	if (npcType.fields & NPC_FIELD_HOME) {
+		if (!propStream.read<uint16_t>(masterPos.x) || !propStream.read<uint16_t>(masterPos.y) || !propStream.read<uint8_t>(masterPos.z)) {
+			return false;
+		}
+	}
+
+	if ((npcType.fields & NPC_FIELD_RADIUS) && !propStream.read<uint32_t>(npcType.masterRadius)) {
+		return false;
+	}
+
+	if (npcType.fields & NPC_FIELD_BEHAVIOUR) {
+		std::shared_ptr<BehaviourProgram> program = std::make_shared<BehaviourProgram>();
+		if (!program->unserialize(propStream)) {
+			return false;
+		}
+		npcType.program = program;
+	}
+
+	return propStream.size() == 0;
+}
+
+std::shared_ptr<const NpcType> Npcs::getNpcType(const std::string& filename)
+{
+	auto it = npcTypes.find(filename);
+	if (it != npcTypes.end()) {
+		return it->second;
+	}
+
+	DataCache cache(filename, NPC_CACHE_VERSION);
+
+	std::shared_ptr<NpcType> npcType = std::make_shared<NpcType>();
+
+	PropStream propStream;
+	if (!cache.load(propStream) || !unserializeNpcType(propStream, *npcType)) {
+		npcType = std::make_shared<NpcType>();
+
+		ScriptReader script;
+		if (!script.open(filename) || !parseNpcType(script, *npcType)) {
+			return nullptr;
+		}
+
+		script.close();
+
+		if (script.Errors == 0) {
+			PropWriteStream propWriteStream;
+			serializeNpcType(propWriteStream, *npcType);
+			cache.save(propWriteStream, script.IncludedFiles);
+		}
+	}
+
+	npcTypes[filename] = npcType;
+	return npcType;
+}
+
+bool Npc::load()
+{
+	if (loaded) {
+		return true;
+	}
+
+	reset();
+
+	std::shared_ptr<const NpcType> npcType = Npcs::getNpcType(filename);
+	if (!npcType) {
+		return false;
+	}
+
+	// a reload keeps whatever the script leaves out
+	if (npcType->fields & NPC_FIELD_NAME) {
+		name = npcType->name;
+	}
+
+	if (npcType->fields & NPC_FIELD_OUTFIT) {
+		currentOutfit.lookType = npcType->outfit.lookType;
+		if (currentOutfit.lookType > 0) {
+			currentOutfit.lookHead = npcType->outfit.lookHead;
+			currentOutfit.lookBody = npcType->outfit.lookBody;
+			currentOutfit.lookLegs = npcType->outfit.lookLegs;
+			currentOutfit.lookFeet = npcType->outfit.lookFeet;
+		} else {
+			currentOutfit.lookTypeEx = npcType->outfit.lookTypeEx;
+		}
+	}
+
+	if (npcType->fields & NPC_FIELD_HOME) {
+		masterPos = npcType->masterPos;
+	}
+
+	if (npcType->fields & NPC_FIELD_RADIUS) {
+		masterRadius = npcType->masterRadius;
+	}
+
+	if (npcType->program) {
+		behaviourDatabase = new BehaviourDatabase(this, npcType->program);
+	}
 	return true;
 }
 
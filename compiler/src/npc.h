@@ -27,12 +27,31 @@
 class Npc;
 class Player;
 class BehaviourDatabase;
+class BehaviourProgram;
+
+// what an .npc script defines, read once and shared by every npc created
+// from it until the npcs are reloaded
+struct NpcType
+{
+	uint8_t fields = 0; // keys the script sets
+	std::string name;
+	Outfit_t outfit;
+	Position masterPos;
+	uint32_t masterRadius = 0;
+	std::shared_ptr<const BehaviourProgram> program;
+};
 
 class Npcs
 {
 	public:
 		static void loadNpcs();
 		static void reload();
+
+		// nullptr when the script can not be loaded
+		static std::shared_ptr<const NpcType> getNpcType(const std::string& filename);
+
+	private:
+		static std::map<std::string, std::shared_ptr<const NpcType>> npcTypes;
 };
 
 class Npc final : public Creature
@@ -30,6 +30,7 @@
 #include "configmanager.h"
 #include "scriptmanager.h"
 #include "rsa.h"
+#include "xtea.h"
 #include "protocolspectator.h"
 
 #include "protocollogin.h"
@@ -171,6 +172,8 @@ void mainLoader(int, char*[], ServiceManager* services)
 	const char* q("7630979195970404721891201847792002125535401292779123937207447574596692788513647179235335529307251350570728407373705564708871762033017096809910315212884101");
 	g_RSA.setKey(p, q);
 
+	std::cout << ">> XTEA kernel: " << xtea::getKernelName() << std::endl;
+
 	std::cout << ">> Establishing database connection..." << std::flush;
 
 	Database* db = Database::getInstance();
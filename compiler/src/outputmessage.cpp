@@ -23,8 +23,10 @@
 #include "protocol.h"
 #include "lockfree.h"
 #include "scheduler.h"
+#include "configmanager.h"
 
 extern Scheduler g_scheduler;
+extern ConfigManager g_config;
 
 const uint16_t OUTPUTMESSAGE_FREE_LIST_CAPACITY = 2048;
 const std::chrono::milliseconds OUTPUTMESSAGE_AUTOSEND_DELAY {10};
@@ -39,6 +41,10 @@ class OutputMessageAllocator
 
 void OutputMessagePool::scheduleSendAll()
 {
+	if (!autoSend) {
+		return;
+	}
+
 	auto functor = std::bind(&OutputMessagePool::sendAll, this);
 	g_scheduler.addEvent(createSchedulerTask(OUTPUTMESSAGE_AUTOSEND_DELAY.count(), functor));
 }
@@ -46,11 +52,9 @@ void OutputMessagePool::scheduleSendAll()
 void OutputMessagePool::sendAll()
 {
 	//dispatcher thread
+	const uint32_t budget = std::max<int32_t>(0, g_config.getNumber(ConfigManager::OUTPUT_FLUSH_BUDGET));
 	for (auto& protocol : bufferedProtocols) {
-		auto& msg = protocol->getCurrentBuffer();
-		if (msg) {
-			protocol->send(std::move(msg));
-		}
+		protocol->flushOutputBuffers(budget);
 	}
 
 	if (!bufferedProtocols.empty()) {
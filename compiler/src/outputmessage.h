@@ -97,6 +97,11 @@ class OutputMessagePool
 		void sendAll();
 		void scheduleSendAll();
 
+		// when disabled the buffers are only flushed by explicit sendAll calls
+		void setAutoSend(bool autoSend) {
+			this->autoSend = autoSend;
+		}
+
 		static OutputMessage_ptr getOutputMessage();
 
 		void addProtocolToAutosend(Protocol_ptr protocol);
@@ -106,6 +111,7 @@ class OutputMessagePool
 		//NOTE: A vector is used here because this container is mostly read
 		//and relatively rarely modified (only when a client connects/disconnects)
 		std::vector<Protocol_ptr> bufferedProtocols;
+		bool autoSend = true;
 };
 
 
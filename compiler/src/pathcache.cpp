@@ -0,0 +1,291 @@
+/**
+ * Tibia GIMUD Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2017  Alejandro Mujica <alejandrodemujica@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "otpch.h"
+
+#include "pathcache.h"
+
+#include "combat.h"
+#include "map.h"
+#include "monster.h"
+
+static constexpr int32_t fieldNeighbors[8][2] = {
+	{-1, 0}, {0, 1}, {1, 0}, {0, -1}, {-1, -1}, {1, -1}, {1, 1}, {-1, 1}
+};
+
+static inline int32_t getFieldIndex(int32_t offsetX, int32_t offsetY)
+{
+	return (offsetY + PATH_FIELD_RADIUS) * PATH_FIELD_SIZE + (offsetX + PATH_FIELD_RADIUS);
+}
+
+static inline bool isInField(int32_t offsetX, int32_t offsetY)
+{
+	return std::abs(offsetX) <= PATH_FIELD_RADIUS && std::abs(offsetY) <= PATH_FIELD_RADIUS;
+}
+
+static inline int32_t getStepCost(int32_t dx, int32_t dy)
+{
+	return (dx != 0 && dy != 0) ? MAP_DIAGONALWALKCOST : MAP_NORMALWALKCOST;
+}
+
+static inline int8_t getSide(int32_t offset)
+{
+	return (offset > 0) - (offset < 0);
+}
+
+bool PathCache::Key::operator==(const Key& other) const
+{
+	return targetPos == other.targetPos && minTargetDist == other.minTargetDist && maxSearchDist == other.maxSearchDist &&
+	       walkProfile == other.walkProfile && sideX == other.sideX && sideY == other.sideY &&
+	       fullPathSearch == other.fullPathSearch && clearSight == other.clearSight;
+}
+
+uint32_t PathCache::getWalkProfile(const Monster& monster)
+{
+	// everything Tile::queryAdd and AStarNodes::getTileWalkCost look at when a monster walks
+	uint32_t profile = 0;
+	if (monster.canPushCreatures()) {
+		profile |= 1 << 0;
+	}
+	if (monster.isSummon()) {
+		profile |= 1 << 1;
+	}
+	if (monster.canPushItems()) {
+		profile |= 1 << 2;
+	}
+	if (monster.hasCondition(CONDITION_AGGRESSIVE)) {
+		profile |= 1 << 3;
+	}
+	if (monster.canSeeInvisibility()) {
+		profile |= 1 << 4;
+	}
+
+	for (size_t i = 0; i < COMBAT_COUNT; ++i) {
+		CombatType_t combatType = indexToCombatType(i);
+		if (monster.isImmune(combatType)) {
+			profile |= 1 << (8 + i);
+		}
+		if (monster.hasCondition(Combat::DamageToConditionType(combatType))) {
+			profile |= 1 << (20 + i);
+		}
+	}
+	return profile;
+}
+
+bool PathCache::getPath(const Map& map, const Creature& creature, std::forward_list<Direction>& dirList,
+                        const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp)
+{
+	// only melee chasing is served, every other search keeps its own rules
+	const Monster* monster = creature.getMonster();
+	if (!monster || fpp.keepDistance || !fpp.allowDiagonal || fpp.maxTargetDist != 1 ||
+	        fpp.maxSearchDist <= 0 || fpp.maxSearchDist > PATH_FIELD_MAX_SEARCH_DIST) {
+		return false;
+	}
+
+	const Position& startPos = creature.getPosition();
+	const Position& targetPos = pathCondition.getTargetPos();
+	const int32_t startX = Position::getOffsetX(startPos, targetPos);
+	const int32_t startY = Position::getOffsetY(startPos, targetPos);
+	if (startPos.z != targetPos.z || std::max(std::abs(startX), std::abs(startY)) > fpp.maxSearchDist) {
+		return false;
+	}
+
+	int32_t bestMatch = 0;
+	if (pathCondition(startPos, startPos, fpp, bestMatch)) {
+		// already in place, same as the search matching its first node
+		return true;
+	}
+
+	Key key;
+	key.targetPos = targetPos;
+	key.minTargetDist = fpp.minTargetDist;
+	key.maxSearchDist = fpp.maxSearchDist;
+	key.walkProfile = getWalkProfile(*monster);
+	key.sideX = fpp.fullPathSearch ? 0 : getSide(startX);
+	key.sideY = fpp.fullPathSearch ? 0 : getSide(startY);
+	key.fullPathSearch = fpp.fullPathSearch;
+	key.clearSight = fpp.clearSight;
+
+	const int64_t tick = OTSYS_TIME() / PATH_FIELD_TICK;
+	Field* field = getField(key, tick);
+	if (!field) {
+		return false;
+	}
+
+	if (field->tick != tick) {
+		field->key = key;
+		field->tick = tick;
+		buildField(*field, map, creature, pathCondition, fpp);
+	}
+
+	// walk down the field, the search window around the start still applies
+	auto it = dirList.before_begin();
+	int32_t x = startX;
+	int32_t y = startY;
+	for (int32_t steps = 0; steps < MAX_NODES; ++steps) {
+		int32_t bestCost = std::numeric_limits<int32_t>::max();
+		int32_t bestX = 0;
+		int32_t bestY = 0;
+		for (const auto& neighbor : fieldNeighbors) {
+			const int32_t nextX = x + neighbor[0];
+			const int32_t nextY = y + neighbor[1];
+			if (!isInField(nextX, nextY)) {
+				continue;
+			}
+
+			const int32_t index = getFieldIndex(nextX, nextY);
+			if (field->dist[index] == std::numeric_limits<int32_t>::max()) {
+				continue;
+			}
+
+			const int32_t total = getStepCost(neighbor[0], neighbor[1]) + field->cost[index] + field->dist[index];
+			if (total < bestCost) {
+				bestCost = total;
+				bestX = nextX;
+				bestY = nextY;
+			}
+		}
+
+		if (bestCost == std::numeric_limits<int32_t>::max() ||
+		        std::abs(bestX - startX) > fpp.maxSearchDist || std::abs(bestY - startY) > fpp.maxSearchDist) {
+			dirList.clear();
+			return false;
+		}
+
+		it = dirList.insert_after(it, getDirectionTo(Position(targetPos.x + x, targetPos.y + y, targetPos.z),
+		                                             Position(targetPos.x + bestX, targetPos.y + bestY, targetPos.z)));
+		x = bestX;
+		y = bestY;
+
+		if (field->dist[getFieldIndex(x, y)] == 0) {
+			return true;
+		}
+	}
+
+	dirList.clear();
+	return false;
+}
+
+PathCache::Field* PathCache::getField(const Key& key, int64_t tick)
+{
+	Field* expired = nullptr;
+	for (const auto& field : fields) {
+		if (field->tick != tick) {
+			// prefer recycling the field of a target that just stepped, its
+			// window mostly overlaps and is still hot in cache
+			if (!expired || Position::areInRange<1, 1, 0>(field->key.targetPos, key.targetPos)) {
+				expired = field.get();
+			}
+		} else if (field->key == key) {
+			return field.get();
+		}
+	}
+
+	if (expired) {
+		expired->tick = -1;
+		return expired;
+	}
+
+	if (fields.size() >= PATH_FIELD_MAX) {
+		return nullptr;
+	}
+
+	fields.emplace_back(new Field);
+	fields.back()->tick = -1;
+	return fields.back().get();
+}
+
+void PathCache::buildField(Field& field, const Map& map, const Creature& creature,
+                           const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp)
+{
+	const Position& startPos = creature.getPosition();
+	const Position& targetPos = field.key.targetPos;
+
+	for (int32_t y = -PATH_FIELD_RADIUS; y <= PATH_FIELD_RADIUS; ++y) {
+		for (int32_t x = -PATH_FIELD_RADIUS; x <= PATH_FIELD_RADIUS; ++x) {
+			const int32_t index = getFieldIndex(x, y);
+			field.dist[index] = std::numeric_limits<int32_t>::max();
+			field.cost[index] = -1;
+
+			const int32_t tileX = targetPos.x + x;
+			const int32_t tileY = targetPos.y + y;
+			if (tileX < 0 || tileY < 0 || tileX > std::numeric_limits<uint16_t>::max() || tileY > std::numeric_limits<uint16_t>::max()) {
+				continue;
+			}
+
+			// the same checks canWalkTo and the walk cache run for the creature
+			const Tile* tile = map.getTile(tileX, tileY, targetPos.z);
+			if (tile && tile->queryAdd(0, creature, 1, FLAG_PATHFINDING) == RETURNVALUE_NOERROR) {
+				field.cost[index] = AStarNodes::getTileWalkCost(creature, tile);
+			}
+		}
+	}
+
+	openList.clear();
+	for (int32_t y = -1; y <= 1; ++y) {
+		for (int32_t x = -1; x <= 1; ++x) {
+			const int32_t index = getFieldIndex(x, y);
+			if (field.cost[index] < 0) {
+				continue;
+			}
+
+			int32_t bestMatch = 0;
+			if (pathCondition(startPos, Position(targetPos.x + x, targetPos.y + y, targetPos.z), fpp, bestMatch)) {
+				field.dist[index] = 0;
+				openList.emplace_back(0, index);
+			}
+		}
+	}
+
+	// reverse search from the matching squares, a step onto a square pays that square's cost
+	auto compare = std::greater<std::pair<int32_t, int32_t>>();
+	std::make_heap(openList.begin(), openList.end(), compare);
+	while (!openList.empty()) {
+		std::pop_heap(openList.begin(), openList.end(), compare);
+		const int32_t dist = openList.back().first;
+		const int32_t index = openList.back().second;
+		openList.pop_back();
+		if (dist != field.dist[index]) {
+			continue;
+		}
+
+		const int32_t x = index % PATH_FIELD_SIZE - PATH_FIELD_RADIUS;
+		const int32_t y = index / PATH_FIELD_SIZE - PATH_FIELD_RADIUS;
+		const int32_t enterCost = dist + field.cost[index];
+		for (const auto& neighbor : fieldNeighbors) {
+			const int32_t prevX = x + neighbor[0];
+			const int32_t prevY = y + neighbor[1];
+			if (!isInField(prevX, prevY)) {
+				continue;
+			}
+
+			const int32_t prevIndex = getFieldIndex(prevX, prevY);
+			if (field.cost[prevIndex] < 0) {
+				continue;
+			}
+
+			const int32_t prevDist = enterCost + getStepCost(neighbor[0], neighbor[1]);
+			if (prevDist < field.dist[prevIndex]) {
+				field.dist[prevIndex] = prevDist;
+				openList.emplace_back(prevDist, prevIndex);
+				std::push_heap(openList.begin(), openList.end(), compare);
+			}
+		}
+	}
+}
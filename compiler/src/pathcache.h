@@ -0,0 +1,88 @@
+/**
+ * Tibia GIMUD Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2017  Alejandro Mujica <alejandrodemujica@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_PATHCACHE_H_3F0C7A52D81E4B6A9E2C5D47B19A06E3
+#define FS_PATHCACHE_H_3F0C7A52D81E4B6A9E2C5D47B19A06E3
+
+#include "position.h"
+
+class Creature;
+class FrozenPathingConditionCall;
+class Map;
+class Monster;
+struct FindPathParams;
+
+static constexpr int32_t PATH_FIELD_MAX_SEARCH_DIST = 12;
+static constexpr int32_t PATH_FIELD_RADIUS = PATH_FIELD_MAX_SEARCH_DIST + 1;
+static constexpr int32_t PATH_FIELD_SIZE = PATH_FIELD_RADIUS * 2 + 1;
+static constexpr int32_t PATH_FIELD_MAX = 64;
+static constexpr int64_t PATH_FIELD_TICK = 50;
+
+// Reverse distance fields around chased creatures. Every monster that melee
+// chases the same target with the same walking rules reads its path from one
+// field instead of running its own A*. Fields live for a single tick, so a
+// follower never sees walkability older than PATH_FIELD_TICK milliseconds.
+class PathCache
+{
+	public:
+		PathCache() = default;
+
+		// non-copyable
+		PathCache(const PathCache&) = delete;
+		PathCache& operator=(const PathCache&) = delete;
+
+		// returns false when the query is not eligible or the field has no
+		// route inside the creature's search window, the caller should then
+		// fall back to the regular search
+		bool getPath(const Map& map, const Creature& creature, std::forward_list<Direction>& dirList,
+		             const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp);
+
+	private:
+		struct Key {
+			Position targetPos;
+			int32_t minTargetDist;
+			int32_t maxSearchDist;
+			uint32_t walkProfile;
+			// sides of the target the follower stands on, only set for partial searches
+			int8_t sideX;
+			int8_t sideY;
+			bool fullPathSearch;
+			bool clearSight;
+
+			bool operator==(const Key& other) const;
+		};
+
+		struct Field {
+			Key key;
+			int64_t tick;
+			int32_t dist[PATH_FIELD_SIZE * PATH_FIELD_SIZE];
+			int32_t cost[PATH_FIELD_SIZE * PATH_FIELD_SIZE];
+		};
+
+		static uint32_t getWalkProfile(const Monster& monster);
+
+		Field* getField(const Key& key, int64_t tick);
+		void buildField(Field& field, const Map& map, const Creature& creature,
+		                const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp);
+
+		std::vector<std::unique_ptr<Field>> fields;
+		std::vector<std::pair<int32_t, int32_t>> openList;
+};
+
+#endif
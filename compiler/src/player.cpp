@@ -679,9 +679,7 @@ void Player::sendCancelMessage(ReturnValue message) const
 
 void Player::sendStats()
 {
-	if (client) {
-		client->sendStats();
-	}
+	g_game.addCreatureUpdate(this, CREATURE_UPDATE_STATS);
 }
 
 void Player::sendPing()
@@ -1021,6 +1019,7 @@ void Player::onRemoveCreature(Creature* creature, bool isLogout)
 		if (!saved) {
 			std::cout << "Error while saving player: " << getName() << std::endl;
 		}
+		IOLoginData::releaseSaveState(guid);
 	}
 }
 
@@ -212,6 +212,14 @@ class Player final : public Creature, public Cylinder
 			return client->getVersion();
 		}
 
+		std::string benchmarkMapDescription(uint32_t iterations) {
+			if (!client) {
+				return "No client connected.\n";
+			}
+
+			return client->benchmarkMapDescription(iterations);
+		}
+
 		bool hasSecureMode() const {
 			return secureMode;
 		}
@@ -780,7 +788,13 @@ class Player final : public Creature, public Cylinder
 				client->sendPingBack();
 			}
 		}
+		// queued, the packet is written once at the end of the dispatcher task
 		void sendStats();
+		void sendStatsNow() {
+			if (client) {
+				client->sendStats();
+			}
+		}
 		void sendSkills() const {
 			if (client) {
 				client->sendSkills();
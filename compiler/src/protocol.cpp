@@ -22,6 +22,7 @@
 #include "protocol.h"
 #include "outputmessage.h"
 #include "rsa.h"
+#include "xtea.h"
 
 extern RSA g_RSA;
 
@@ -46,85 +47,74 @@ void Protocol::onRecvMessage(NetworkMessage& msg)
 	parsePacket(msg);
 }
 
-OutputMessage_ptr Protocol::getOutputBuffer(int32_t size)
+OutputMessage_ptr Protocol::getOutputBuffer(int32_t size, OutputPriority_t priority /*= OUTPUT_PRIORITY_HIGH*/)
 {
 	//dispatcher thread
+	OutputMessage_ptr& outputBuffer = outputBuffers[priority];
 	if (!outputBuffer) {
 		outputBuffer = OutputMessagePool::getOutputMessage();
 	} else if ((outputBuffer->getLength() + size) > NetworkMessage::MAX_PROTOCOL_BODY_LENGTH) {
-		send(outputBuffer);
+		sendOutputBuffer(priority);
 		outputBuffer = OutputMessagePool::getOutputMessage();
 	}
 	return outputBuffer;
 }
 
-void Protocol::XTEA_encrypt(OutputMessage& msg) const
+void Protocol::flushOutputBuffers(uint32_t budget)
 {
-	const uint32_t delta = 0x61C88647;
-
-	// The message must be a multiple of 8
-	size_t paddingBytes = msg.getLength() % 8;
-	if (paddingBytes != 0) {
-		msg.addPaddingBytes(8 - paddingBytes);
+	//dispatcher thread
+	uint32_t backlog = 0;
+	if (auto connection = getConnection()) {
+		backlog = connection->getQueuedBytes();
 	}
 
-	uint8_t* buffer = msg.getOutputBuffer();
-	const size_t messageLength = msg.getLength();
-	size_t readPos = 0;
-	const uint32_t k[] = {key[0], key[1], key[2], key[3]};
-	while (readPos < messageLength) {
-		uint32_t v0;
-		memcpy(&v0, buffer + readPos, 4);
-		uint32_t v1;
-		memcpy(&v1, buffer + readPos + 4, 4);
-
-		uint32_t sum = 0;
-
-		for (int32_t i = 32; --i >= 0;) {
-			v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + k[sum & 3]);
-			sum -= delta;
-			v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + k[(sum >> 11) & 3]);
+	for (uint8_t priority = OUTPUT_PRIORITY_HIGH; priority < OUTPUT_PRIORITY_COUNT; ++priority) {
+		const OutputMessage_ptr& outputBuffer = outputBuffers[priority];
+		if (!outputBuffer) {
+			continue;
 		}
 
-		memcpy(buffer + readPos, &v0, 4);
-		readPos += 4;
-		memcpy(buffer + readPos, &v1, 4);
-		readPos += 4;
+		// movement and combat always go out, the rest waits for the socket to
+		// catch up, but not forever
+		if (priority != OUTPUT_PRIORITY_HIGH && budget != 0 && backlog >= budget &&
+		        deferredFlushes[priority] < OUTPUT_MAX_DEFERRED_FLUSHES) {
+			++deferredFlushes[priority];
+			continue;
+		}
+
+		backlog += outputBuffer->getLength();
+		sendOutputBuffer(static_cast<OutputPriority_t>(priority));
 	}
 }
 
-bool Protocol::XTEA_decrypt(NetworkMessage& msg) const
+void Protocol::sendOutputBuffer(OutputPriority_t priority)
 {
-	if (((msg.getLength() - 2) % 8) != 0) {
-		return false;
-	}
-
-	const uint32_t delta = 0x61C88647;
-
-	uint8_t* buffer = msg.getBuffer() + msg.getBufferPosition();
-	const size_t messageLength = (msg.getLength() - 6);
-	size_t readPos = 0;
-	const uint32_t k[] = {key[0], key[1], key[2], key[3]};
-	while (readPos < messageLength) {
-		uint32_t v0;
-		memcpy(&v0, buffer + readPos, 4);
-		uint32_t v1;
-		memcpy(&v1, buffer + readPos + 4, 4);
+	++outputGenerations[priority];
+	deferredFlushes[priority] = 0;
+	send(std::move(outputBuffers[priority]));
+	outputBuffers[priority] = nullptr;
+}
 
-		uint32_t sum = 0xC6EF3720;
+void Protocol::XTEA_encrypt(OutputMessage& msg) const
+{
+	// The message must be a multiple of 8
+	size_t paddingBytes = msg.getLength() % xtea::BLOCK_SIZE;
+	if (paddingBytes != 0) {
+		msg.addPaddingBytes(xtea::BLOCK_SIZE - paddingBytes);
+	}
 
-		for (int32_t i = 32; --i >= 0;) {
-			v1 -= ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + k[(sum >> 11) & 3]);
-			sum += delta;
-			v0 -= ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + k[sum & 3]);
-		}
+	xtea::encrypt(msg.getOutputBuffer(), msg.getLength(), key);
+}
 
-		memcpy(buffer + readPos, &v0, 4);
-		readPos += 4;
-		memcpy(buffer + readPos, &v1, 4);
-		readPos += 4;
+bool Protocol::XTEA_decrypt(NetworkMessage& msg) const
+{
+	if (((msg.getLength() - 2) % xtea::BLOCK_SIZE) != 0) {
+		return false;
 	}
 
+	// the encrypted part starts right after the 2-byte length header and runs to the end of the packet
+	xtea::decrypt(msg.getBuffer() + msg.getBufferPosition(), msg.getLength() - 2, key);
+
 	int innerLength = msg.get<uint16_t>();
 	if (innerLength > msg.getLength() - 4) {
 		return false;
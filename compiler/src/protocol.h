@@ -22,6 +22,18 @@
 
 #include "connection.h"
 
+// every class has its own output buffer, flushed in this order
+enum OutputPriority_t : uint8_t {
+	OUTPUT_PRIORITY_HIGH, // map, items, movement, combat and everything unclassified
+	OUTPUT_PRIORITY_UI, // text, house and outfit windows
+	OUTPUT_PRIORITY_LOW, // chat, channels and text messages
+
+	OUTPUT_PRIORITY_COUNT
+};
+
+// flushes a lower priority buffer may be held back before it is sent anyway
+static constexpr uint8_t OUTPUT_MAX_DEFERRED_FLUSHES = 50;
+
 class Protocol : public std::enable_shared_from_this<Protocol>
 {
 	public:
@@ -50,11 +62,11 @@ class Protocol : public std::enable_shared_from_this<Protocol>
 		uint32_t getIP() const;
 
 		//Use this function for autosend messages only
-		OutputMessage_ptr getOutputBuffer(int32_t size);
+		OutputMessage_ptr getOutputBuffer(int32_t size, OutputPriority_t priority = OUTPUT_PRIORITY_HIGH);
 
-		OutputMessage_ptr& getCurrentBuffer() {
-			return outputBuffer;
-		}
+		// sends the autosend buffers, lower priorities only while the
+		// connection has less than budget bytes waiting (0 = no limit)
+		void flushOutputBuffers(uint32_t budget);
 
 		void send(OutputMessage_ptr msg) const {
 			if (auto connection = getConnection()) {
@@ -86,8 +98,18 @@ class Protocol : public std::enable_shared_from_this<Protocol>
 		virtual void release() {}
 		friend class Connection;
 
-		OutputMessage_ptr outputBuffer;
+		// changes whenever the buffer of a priority is handed to the connection
+		uint32_t getOutputGeneration(OutputPriority_t priority) const {
+			return outputGenerations[priority];
+		}
+
+		OutputMessage_ptr outputBuffers[OUTPUT_PRIORITY_COUNT];
 	private:
+		void sendOutputBuffer(OutputPriority_t priority);
+
+		uint32_t outputGenerations[OUTPUT_PRIORITY_COUNT] = {};
+		uint8_t deferredFlushes[OUTPUT_PRIORITY_COUNT] = {};
+
 		const ConnectionWeak_ptr connection;
 		uint32_t key[4] = {};
 		bool encryptionEnabled = false;
@@ -42,6 +42,7 @@ extern CreatureEvents* g_creatureEvents;
 extern Chat* g_chat;
 
 ProtocolGame::LiveCastsMap ProtocolGame::liveCasts;
+PlayerLoginStats ProtocolGame::loginStats;
 
 void ProtocolGame::spectatorRelease()
 {
@@ -74,110 +75,150 @@ void ProtocolGame::login(const std::string& name, uint32_t accountId, OperatingS
 	//dispatcher thread
 	Player* foundPlayer = g_game.getPlayerByName(name);
 	if (!foundPlayer || g_config.getBoolean(ConfigManager::ALLOW_CLONES)) {
-		player = new Player(getThis());
-		player->setName(name);
+		// the rows are read and the item trees built on a database worker, the
+		// dispatcher only gets the finished record to check and place
+		auto record = std::make_shared<PlayerLoadRecord>();
+		auto fetchTime = std::make_shared<uint64_t>(0);
+		const auto queuedAt = std::chrono::steady_clock::now();
+
+		auto thisPtr = getThis();
+		g_databaseTasks.addJob(accountId, [record, fetchTime, queuedAt, name](Database& db) {
+			bool success = IOLoginData::fetchPlayerByName(db, name, *record);
+			*fetchTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - queuedAt).count();
+			return success;
+		}, [thisPtr, record, fetchTime, name, accountId, operatingSystem](bool success) {
+			thisPtr->onPlayerLoaded(record, *fetchTime, name, accountId, operatingSystem, success);
+		});
+		return;
+	}
 
-		player->incrementReferenceCounter();
-		player->setID();
+	if (eventConnect != 0 || !g_config.getBoolean(ConfigManager::REPLACE_KICK_ON_LOGIN)) {
+		//Already trying to connect
+		disconnectClient("You are already logged in.");
+		return;
+	}
 
-		if (!IOLoginData::preloadPlayer(player, name)) {
-			disconnectClient("Your character could not be loaded.");
-			return;
-		}
+	if (foundPlayer->client) {
+		foundPlayer->disconnect();
+		foundPlayer->isConnecting = true;
 
-		if (IOBan::isPlayerNamelocked(player->getGUID())) {
-			disconnectClient("Your character has been namelocked.");
-			return;
-		}
+		eventConnect = g_scheduler.addEvent(createSchedulerTask(1000, std::bind(&ProtocolGame::connect, getThis(), foundPlayer->getID(), operatingSystem)));
+	} else {
+		connect(foundPlayer->getID(), operatingSystem);
+	}
+	OutputMessagePool::getInstance().addProtocolToAutosend(shared_from_this());
+}
 
-		if (g_game.getGameState() == GAME_STATE_CLOSING && !player->hasFlag(PlayerFlag_CanAlwaysLogin)) {
-			disconnectClient("The game is just going down.\nPlease try again later.");
-			return;
-		}
+void ProtocolGame::onPlayerLoaded(PlayerLoadRecord_ptr record, uint64_t fetchTime, const std::string& name, uint32_t accountId, OperatingSystem_t operatingSystem, bool success)
+{
+	//dispatcher thread
+	if (isConnectionExpired()) {
+		return;
+	}
 
-		if (g_game.getGameState() == GAME_STATE_CLOSED && !player->hasFlag(PlayerFlag_CanAlwaysLogin)) {
-			disconnectClient("Server is currently closed.\nPlease try again later.");
-			return;
-		}
+	const auto started = std::chrono::steady_clock::now();
 
-		if (g_config.getBoolean(ConfigManager::ONE_PLAYER_ON_ACCOUNT) && player->getAccountType() < ACCOUNT_TYPE_GAMEMASTER && g_game.getPlayerByAccount(player->getAccount())) {
-			disconnectClient("You may only login with one character\nof your account at the same time.");
-			return;
-		}
+	if (!success) {
+		disconnectClient("Your character could not be loaded.");
+		return;
+	}
 
-		if (!player->hasFlag(PlayerFlag_CannotBeBanned)) {
-			BanInfo banInfo;
-			if (IOBan::isAccountBanned(accountId, banInfo)) {
-				if (banInfo.reason.empty()) {
-					banInfo.reason = "(none)";
-				}
+	if (!g_config.getBoolean(ConfigManager::ALLOW_CLONES) && g_game.getPlayerByName(name)) {
+		// logged in from another connection while the record was read
+		login(name, accountId, operatingSystem);
+		return;
+	}
 
-				std::ostringstream ss;
-				if (banInfo.expiresAt > 0) {
-					ss << "Your account has been banned until " << formatDateShort(banInfo.expiresAt) << " by " << banInfo.bannedBy << ".\n\nReason specified:\n" << banInfo.reason;
-				} else {
-					ss << "Your account has been permanently banned by " << banInfo.bannedBy << ".\n\nReason specified:\n" << banInfo.reason;
-				}
-				disconnectClient(ss.str());
-				return;
-			}
-		}
+	player = new Player(getThis());
+	player->setName(name);
 
-		if (!WaitingList::getInstance()->clientLogin(player)) {
-			uint32_t currentSlot = WaitingList::getInstance()->getClientSlot(player);
-			uint32_t retryTime = WaitingList::getTime(currentSlot);
-			std::ostringstream ss;
+	player->incrementReferenceCounter();
+	player->setID();
 
-			ss << "Too many players online.\nYou are at place "
-			   << currentSlot << " on the waiting list.";
+	if (!IOLoginData::loadPlayer(player, *record)) {
+		disconnectClient("Your character could not be loaded.");
+		return;
+	}
+	IOLoginData::resetSaveDigest(player->getGUID());
 
-			auto output = OutputMessagePool::getOutputMessage();
-			output->addByte(0x16);
-			output->addString(ss.str());
-			output->addByte(retryTime);
-			send(output);
-			disconnect();
-			return;
-		}
+	if (record->namelocked) {
+		disconnectClient("Your character has been namelocked.");
+		return;
+	}
 
-		if (!IOLoginData::loadPlayerByName(player, name)) {
-			disconnectClient("Your character could not be loaded.");
-			return;
-		}
+	if (g_game.getGameState() == GAME_STATE_CLOSING && !player->hasFlag(PlayerFlag_CanAlwaysLogin)) {
+		disconnectClient("The game is just going down.\nPlease try again later.");
+		return;
+	}
 
-		player->setOperatingSystem(operatingSystem);
+	if (g_game.getGameState() == GAME_STATE_CLOSED && !player->hasFlag(PlayerFlag_CanAlwaysLogin)) {
+		disconnectClient("Server is currently closed.\nPlease try again later.");
+		return;
+	}
 
-		if (!g_game.placeCreature(player, player->getLoginPosition())) {
-			if (!g_game.placeCreature(player, player->getTemplePosition(), false, true)) {
-				disconnectClient("Temple position is wrong. Contact the administrator.");
-				return;
-			}
-		}
+	if (g_config.getBoolean(ConfigManager::ONE_PLAYER_ON_ACCOUNT) && player->getAccountType() < ACCOUNT_TYPE_GAMEMASTER && g_game.getPlayerByAccount(player->getAccount())) {
+		disconnectClient("You may only login with one character\nof your account at the same time.");
+		return;
+	}
 
-		if (operatingSystem >= CLIENTOS_OTCLIENT_LINUX) {
-			player->registerCreatureEvent("ExtendedOpcode");
+	if (!player->hasFlag(PlayerFlag_CannotBeBanned) && record->banned) {
+		BanInfo& banInfo = record->banInfo;
+		if (banInfo.reason.empty()) {
+			banInfo.reason = "(none)";
 		}
 
-		player->lastIP = player->getIP();
-		player->lastLoginSaved = std::max<time_t>(time(nullptr), player->lastLoginSaved + 1);
-		acceptPackets = true;
-	} else {
-		if (eventConnect != 0 || !g_config.getBoolean(ConfigManager::REPLACE_KICK_ON_LOGIN)) {
-			//Already trying to connect
-			disconnectClient("You are already logged in.");
-			return;
+		std::ostringstream ss;
+		if (banInfo.expiresAt > 0) {
+			ss << "Your account has been banned until " << formatDateShort(banInfo.expiresAt) << " by " << banInfo.bannedBy << ".\n\nReason specified:\n" << banInfo.reason;
+		} else {
+			ss << "Your account has been permanently banned by " << banInfo.bannedBy << ".\n\nReason specified:\n" << banInfo.reason;
 		}
+		disconnectClient(ss.str());
+		return;
+	}
 
-		if (foundPlayer->client) {
-			foundPlayer->disconnect();
-			foundPlayer->isConnecting = true;
+	if (!WaitingList::getInstance()->clientLogin(player)) {
+		uint32_t currentSlot = WaitingList::getInstance()->getClientSlot(player);
+		uint32_t retryTime = WaitingList::getTime(currentSlot);
+		std::ostringstream ss;
 
-			eventConnect = g_scheduler.addEvent(createSchedulerTask(1000, std::bind(&ProtocolGame::connect, getThis(), foundPlayer->getID(), operatingSystem)));
-		} else {
-			connect(foundPlayer->getID(), operatingSystem);
+		ss << "Too many players online.\nYou are at place "
+		   << currentSlot << " on the waiting list.";
+
+		auto output = OutputMessagePool::getOutputMessage();
+		output->addByte(0x16);
+		output->addString(ss.str());
+		output->addByte(retryTime);
+		send(output);
+		disconnect();
+		return;
+	}
+
+	player->setOperatingSystem(operatingSystem);
+
+	if (!g_game.placeCreature(player, player->getLoginPosition())) {
+		if (!g_game.placeCreature(player, player->getTemplePosition(), false, true)) {
+			disconnectClient("Temple position is wrong. Contact the administrator.");
+			return;
 		}
 	}
+
+	if (operatingSystem >= CLIENTOS_OTCLIENT_LINUX) {
+		player->registerCreatureEvent("ExtendedOpcode");
+	}
+
+	player->lastIP = player->getIP();
+	player->lastLoginSaved = std::max<time_t>(time(nullptr), player->lastLoginSaved + 1);
+	acceptPackets = true;
+
 	OutputMessagePool::getInstance().addProtocolToAutosend(shared_from_this());
+
+	const uint64_t placeTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+	++loginStats.logins;
+	loginStats.fetchTotal += fetchTime;
+	loginStats.fetchMax = std::max(loginStats.fetchMax, fetchTime);
+	loginStats.placeTotal += placeTime;
+	loginStats.placeMax = std::max(loginStats.placeMax, placeTime);
 }
 
 void ProtocolGame::connect(uint32_t playerId, OperatingSystem_t operatingSystem)
@@ -305,7 +346,8 @@ void ProtocolGame::clearLiveCastInfo()
 		assert(g_game.getGameState() == GAME_STATE_INIT);
 		std::ostringstream query;
 		query << "TRUNCATE TABLE `live_casts`;";
-		g_databaseTasks.addTask(query.str());
+		// synchronous: keyed live cast rows may land on any database worker
+		Database::getInstance()->executeQuery(query.str());
 	});
 }
 
@@ -314,14 +356,14 @@ void ProtocolGame::registerLiveCast()
 	std::ostringstream query;
 	query << "INSERT into `live_casts` (`player_id`, `cast_name`, `password`) VALUES (" << player->getGUID() << ", '"
 		<< getLiveCastName() << "', " << isPasswordProtected() << ");";
-	g_databaseTasks.addTask(query.str());
+	g_databaseTasks.addTask(player->getGUID(), query.str());
 }
 
 void ProtocolGame::unregisterLiveCast()
 {
 	std::ostringstream query;
 	query << "DELETE FROM `live_casts` WHERE `player_id`=" << player->getGUID() << ";";
-	g_databaseTasks.addTask(query.str());
+	g_databaseTasks.addTask(player->getGUID(), query.str());
 }
 
 void ProtocolGame::updateLiveCastInfo()
@@ -330,7 +372,7 @@ void ProtocolGame::updateLiveCastInfo()
 	query << "UPDATE `live_casts` SET `cast_name`='" << getLiveCastName() << "', `password`="
 		<< isPasswordProtected() << ", `spectators`=" << getSpectatorCount()
 		<< " WHERE `player_id`=" << player->getGUID() << ";";
-	g_databaseTasks.addTask(query.str());
+	g_databaseTasks.addTask(player->getGUID(), query.str());
 }
 
 void ProtocolGame::addSpectator(ProtocolSpectator_ptr spectatorClient)
@@ -701,6 +743,33 @@ void ProtocolGame::disconnectClient(const std::string& message) const
 	disconnect();
 }
 
+namespace {
+
+// packets that never refer to map state can wait for a flush where the
+// client's socket is less busy, the order inside one class is kept
+OutputPriority_t getOutputPriority(uint8_t opcode)
+{
+	// containers, inventory and trade describe the same items as the map
+	// packets, the client has to apply them in order so they stay high
+	switch (opcode) {
+		case 0x96: case 0x97: // text and house windows
+		case 0xC8: // outfit window
+			return OUTPUT_PRIORITY_UI;
+
+		case 0xAA: // creature speak
+		case 0xAB: case 0xAC: case 0xAD: case 0xAE: case 0xAF: // channels
+		case 0xB0: case 0xB1: case 0xB2: case 0xB3: // rule violations, private channels
+		case 0xB4: // text message
+		case 0xD2: case 0xD3: case 0xD4: // vip list
+			return OUTPUT_PRIORITY_LOW;
+
+		default:
+			return OUTPUT_PRIORITY_HIGH;
+	}
+}
+
+}
+
 void ProtocolGame::writeToOutputBuffer(const NetworkMessage& msg, bool broadcast /*= true*/)
 {
 	//	auto out = getOutputBuffer(msg.getLength());
@@ -714,7 +783,8 @@ void ProtocolGame::writeToOutputBuffer(const NetworkMessage& msg, bool broadcast
 		send(std::move(out));
 	}
 	else {
-		auto out = getOutputBuffer(msg.getLength());
+		const uint8_t opcode = msg.getBuffer()[NetworkMessage::INITIAL_BUFFER_POSITION];
+		auto out = getOutputBuffer(msg.getLength(), getOutputPriority(opcode));
 		if (isLiveCaster()) {
 			out->setBroadcastMsg(true);
 		}
@@ -722,6 +792,42 @@ void ProtocolGame::writeToOutputBuffer(const NetworkMessage& msg, bool broadcast
 	}
 }
 
+void ProtocolGame::writeUpdateToOutputBuffer(const NetworkMessage& msg, uint32_t id /*= 0*/)
+{
+	const uint8_t* body = msg.getBuffer() + NetworkMessage::INITIAL_BUFFER_POSITION;
+	const uint64_t key = (static_cast<uint64_t>(body[0]) << 32) | id;
+	const OutputPriority_t priority = getOutputPriority(body[0]);
+
+	for (size_t i = 0; i < bufferedUpdates.size();) {
+		BufferedUpdate& update = bufferedUpdates[i];
+		if (update.generation != getOutputGeneration(update.priority)) {
+			// that buffer has been sent already
+			update = bufferedUpdates.back();
+			bufferedUpdates.pop_back();
+			continue;
+		}
+
+		if (update.key == key) {
+			if (update.length == msg.getLength()) {
+				memcpy(outputBuffers[priority]->getBuffer() + update.position, body, update.length);
+				return;
+			}
+
+			bufferedUpdates[i] = bufferedUpdates.back();
+			bufferedUpdates.pop_back();
+			break;
+		}
+		++i;
+	}
+
+	auto out = getOutputBuffer(msg.getLength(), priority);
+	if (isLiveCaster()) {
+		out->setBroadcastMsg(true);
+	}
+	bufferedUpdates.push_back({key, getOutputGeneration(priority), out->getBufferPosition(), msg.getLength(), priority});
+	out->append(msg);
+}
+
 /*void ProtocolGame::writeToOutputBuffer(const NetworkMessage& msg)
 {
 	auto out = getOutputBuffer(msg.getLength());
@@ -981,26 +1087,117 @@ void ProtocolGame::GetMapDescription(int32_t x, int32_t y, int32_t z, int32_t wi
 
 void ProtocolGame::GetFloorDescription(NetworkMessage& msg, int32_t x, int32_t y, int32_t z, int32_t width, int32_t height, int32_t offset, int32_t& skip)
 {
-	for (int32_t nx = 0; nx < width; nx++) {
-		for (int32_t ny = 0; ny < height; ny++) {
-			Tile* tile = g_game.map.getTile(x + nx + offset, y + ny + offset, z);
-			if (tile) {
-				if (skip >= 0) {
-					msg.addByte(skip);
+	std::array<Tile*, (Map::maxClientViewportX * 2 + 2) * (Map::maxClientViewportY * 2 + 2)> tiles;
+	assert(width * height <= static_cast<int32_t>(tiles.size()));
+	g_game.map.getFloorTiles(x + offset, y + offset, z, width, height, tiles.data());
+
+	for (int32_t i = 0, size = width * height; i < size; ++i) {
+		const Tile* tile = tiles[i];
+		if (tile) {
+			if (skip >= 0) {
+				msg.addByte(skip);
+				msg.addByte(0xFF);
+			}
+
+			skip = 0;
+			GetTileDescription(tile, msg);
+		} else if (skip == 0xFE) {
+			msg.addByte(0xFF);
+			msg.addByte(0xFF);
+			skip = -1;
+		} else {
+			++skip;
+		}
+	}
+}
+
+std::string ProtocolGame::benchmarkMapDescription(uint32_t iterations)
+{
+	// the previous floor walk, one quadtree descent per tile
+	auto legacyFloor = [this](NetworkMessage& msg, int32_t x, int32_t y, int32_t z, int32_t width, int32_t height, int32_t offset, int32_t& skip) {
+		for (int32_t nx = 0; nx < width; nx++) {
+			for (int32_t ny = 0; ny < height; ny++) {
+				Tile* tile = g_game.map.getTile(x + nx + offset, y + ny + offset, z);
+				if (tile) {
+					if (skip >= 0) {
+						msg.addByte(skip);
+						msg.addByte(0xFF);
+					}
+
+					skip = 0;
+					GetTileDescription(tile, msg);
+				} else if (skip == 0xFE) {
 					msg.addByte(0xFF);
+					msg.addByte(0xFF);
+					skip = -1;
+				} else {
+					++skip;
 				}
+			}
+		}
+	};
 
-				skip = 0;
-				GetTileDescription(tile, msg);
-			} else if (skip == 0xFE) {
-				msg.addByte(0xFF);
-				msg.addByte(0xFF);
-				skip = -1;
+	auto legacyMap = [&legacyFloor](NetworkMessage& msg, int32_t x, int32_t y, int32_t z, int32_t width, int32_t height) {
+		int32_t skip = -1;
+		int32_t startz, endz, zstep;
+		if (z > 7) {
+			startz = z - 2;
+			endz = std::min<int32_t>(MAP_MAX_LAYERS - 1, z + 2);
+			zstep = 1;
+		} else {
+			startz = 7;
+			endz = 0;
+			zstep = -1;
+		}
+
+		for (int32_t nz = startz; nz != endz + zstep; nz += zstep) {
+			legacyFloor(msg, x, y, nz, width, height, z - nz, skip);
+		}
+
+		if (skip >= 0) {
+			msg.addByte(skip);
+			msg.addByte(0xFF);
+		}
+	};
+
+	if (!player) {
+		return "No player.\n";
+	}
+
+	// describing a tile marks its creatures as known, the set has to stay the
+	// one the client really has
+	const std::unordered_set<uint32_t> knownCreatures = knownCreatureSet;
+	const Position& pos = player->getPosition();
+
+	auto run = [&](bool legacy, size_t& bytes, NetworkMessage& last) {
+		const auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < iterations; ++i) {
+			last.reset();
+			if (legacy) {
+				legacyMap(last, pos.x - 8, pos.y - 6, pos.z, 18, 14);
 			} else {
-				++skip;
+				GetMapDescription(pos.x - 8, pos.y - 6, pos.z, 18, 14, last);
 			}
+			bytes = last.getLength();
 		}
-	}
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	size_t bytes = 0, legacyBytes = 0;
+	NetworkMessage msg, legacyMsg;
+	const int64_t elapsed = run(false, bytes, msg);
+	const int64_t legacyElapsed = run(true, legacyBytes, legacyMsg);
+	knownCreatureSet = knownCreatures;
+
+	const bool identical = bytes == legacyBytes && memcmp(msg.getBuffer(), legacyMsg.getBuffer(), msg.getBufferPosition()) == 0;
+
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(2);
+	ss << "map description at " << pos << ": " << bytes << " bytes, "
+	   << (iterations != 0 ? static_cast<double>(elapsed) / iterations : 0.) << " us vs per-tile lookup "
+	   << (iterations != 0 ? static_cast<double>(legacyElapsed) / iterations : 0.) << " us"
+	   << (identical ? "" : " (OUTPUT DIFFERS)") << "\n";
+	return ss.str();
 }
 
 void ProtocolGame::checkCreatureAsKnown(uint32_t id, bool& known, uint32_t& removedKnown)
@@ -1501,14 +1698,14 @@ void ProtocolGame::sendCreatureLight(const Creature* creature)
 
 	NetworkMessage msg;
 	AddCreatureLight(msg, creature);
-	writeToOutputBuffer(msg);
+	writeUpdateToOutputBuffer(msg, creature->getID());
 }
 
 void ProtocolGame::sendWorldLight(const LightInfo& lightInfo)
 {
 	NetworkMessage msg;
 	AddWorldLight(msg, lightInfo);
-	writeToOutputBuffer(msg);
+	writeUpdateToOutputBuffer(msg);
 }
 
 void ProtocolGame::sendCreatureShield(const Creature* creature)
@@ -1604,7 +1801,7 @@ void ProtocolGame::sendStats()
 {
 	NetworkMessage msg;
 	AddPlayerStats(msg);
-	writeToOutputBuffer(msg);
+	writeUpdateToOutputBuffer(msg);
 }
 
 void ProtocolGame::sendTextMessage(const TextMessage& message)
@@ -1687,7 +1884,7 @@ void ProtocolGame::sendIcons(uint16_t icons)
 	NetworkMessage msg;
 	msg.addByte(0xA2);
 	msg.addByte(static_cast<uint8_t>(icons));
-	writeToOutputBuffer(msg);
+	writeUpdateToOutputBuffer(msg);
 }
 
 void ProtocolGame::sendContainer(uint8_t cid, const Container* container, bool hasParent, uint16_t firstIndex)
@@ -1836,7 +2033,7 @@ void ProtocolGame::sendChangeSpeed(const Creature* creature, uint32_t speed)
 	msg.addByte(0x8F);
 	msg.add<uint32_t>(creature->getID());
 	msg.add<uint16_t>(speed);
-	writeToOutputBuffer(msg);
+	writeUpdateToOutputBuffer(msg, creature->getID());
 }
 
 void ProtocolGame::sendCancelWalk()
@@ -1851,7 +2048,7 @@ void ProtocolGame::sendSkills()
 {
 	NetworkMessage msg;
 	AddPlayerSkills(msg);
-	writeToOutputBuffer(msg);
+	writeUpdateToOutputBuffer(msg);
 }
 
 void ProtocolGame::sendPing()
@@ -1902,7 +2099,7 @@ void ProtocolGame::sendCreatureHealth(const Creature* creature)
 	msg.addByte(0x8C);
 	msg.add<uint32_t>(creature->getID());
 	msg.addByte(std::ceil((static_cast<double>(creature->getHealth()) / std::max<int32_t>(creature->getMaxHealth(), 1)) * 100));
-	writeToOutputBuffer(msg);
+	writeUpdateToOutputBuffer(msg, creature->getID());
 }
 
 //tile
@@ -2303,6 +2500,13 @@ void ProtocolGame::AddCreature(NetworkMessage& msg, const Creature* creature, bo
 {
 	const Player* otherPlayer = creature->getPlayer();
 
+	// the description carries health, light and speed, a buffered update
+	// from before it must not be overwritten with a newer value
+	const uint32_t creatureId = creature->getID();
+	bufferedUpdates.erase(std::remove_if(bufferedUpdates.begin(), bufferedUpdates.end(), [creatureId](const BufferedUpdate& update) {
+		return static_cast<uint32_t>(update.key) == creatureId;
+	}), bufferedUpdates.end());
+
 	if (known) {
 		msg.add<uint16_t>(0x62);
 		msg.add<uint32_t>(creature->getID());
@@ -36,7 +36,9 @@ class Connection;
 class Quest;
 class ProtocolGame;
 class ProtocolSpectator;
+struct PlayerLoadRecord;
 typedef std::shared_ptr<ProtocolGame> ProtocolGame_ptr;
+typedef std::shared_ptr<PlayerLoadRecord> PlayerLoadRecord_ptr;
 
 extern Game g_game;
 
@@ -57,6 +59,15 @@ struct LiveInfo {
 };
 static std::vector<LiveInfo> spectInfo;
 
+// times in microseconds, only touched on the dispatcher thread
+struct PlayerLoginStats {
+	uint64_t logins = 0;
+	uint64_t fetchTotal = 0; // queueing the load until a database worker finished reading the player
+	uint64_t fetchMax = 0;
+	uint64_t placeTotal = 0; // applying the record and placing the player on the dispatcher
+	uint64_t placeMax = 0;
+};
+
 class ProtocolGame final : public Protocol
 {
 	public:
@@ -74,10 +85,17 @@ class ProtocolGame final : public Protocol
 		void login(const std::string& name, uint32_t accnumber, OperatingSystem_t operatingSystem);
 		void logout(bool displayEffect, bool forced);
 
+		static const PlayerLoginStats& getLoginStats() {
+			return loginStats;
+		}
+
 		uint16_t getVersion() const {
 			return version;
 		}
 
+		// compares GetMapDescription of the player's view against the per-tile lookup
+		std::string benchmarkMapDescription(uint32_t iterations);
+
 		void deleteLiveInfoSpect(const std::string& liveName, const std::string& spectName, const std::string& spectIp);
 		void spectatelogout();
 		void spectate(const std::string& liveCastName, const std::string& password);
@@ -168,9 +186,14 @@ class ProtocolGame final : public Protocol
 			return std::static_pointer_cast<ProtocolGame>(shared_from_this());
 		}
 		void connect(uint32_t playerId, OperatingSystem_t operatingSystem);
+		// second half of login, runs once a database worker has read the player
+		void onPlayerLoaded(PlayerLoadRecord_ptr record, uint64_t fetchTime, const std::string& name, uint32_t accountId, OperatingSystem_t operatingSystem, bool success);
 		void sendUpdateRequest();
 		void disconnectClient(const std::string& message) const;
 		void writeToOutputBuffer(const NetworkMessage& msg, bool broadcast = true); //live
+		// for packets that carry a full state (stats, health of creature id, ...),
+		// an older one still waiting in the buffer is overwritten instead
+		void writeUpdateToOutputBuffer(const NetworkMessage& msg, uint32_t id = 0);
 
 		void release() final;
 		void spectatorRelease();
@@ -346,6 +369,7 @@ class ProtocolGame final : public Protocol
 
 		void parseSpectatorPacket(NetworkMessage& msg);
 
+		static PlayerLoginStats loginStats;
 		static LiveCastsMap liveCasts; ///< Armazena todos os elencos disponveis.
 		std::atomic<bool> isCaster { false }; ///< Determina se este objeto \ref ProtocolGame est Casting
 		/// lista de espectadores \warning Esta varivel s deve ser acessada aps o bloqueio \ref liveCastLock
@@ -373,6 +397,16 @@ class ProtocolGame final : public Protocol
 		std::unordered_set<uint32_t> knownCreatureSet;
 		Player* player = nullptr;
 
+		// state updates written to a buffer that has not been sent yet
+		struct BufferedUpdate {
+			uint64_t key;
+			uint32_t generation;
+			NetworkMessage::MsgSize_t position;
+			NetworkMessage::MsgSize_t length;
+			OutputPriority_t priority;
+		};
+		std::vector<BufferedUpdate> bufferedUpdates;
+
 		uint32_t eventConnect = 0;
 		uint16_t version = CLIENT_VERSION_MIN;
 
@@ -25,14 +25,18 @@
 #include "tasks.h"
 
 #include "configmanager.h"
+#include "databasetasks.h"
 #include "iologindata.h"
 #include "ban.h"
 #include "game.h"
 
 extern ConfigManager g_config;
+extern DatabaseTasks g_databaseTasks;
 extern IPList serverIPs;
 extern Game g_game;
 
+std::atomic<uint32_t> ProtocolLogin::pendingLogins{0};
+
 void ProtocolLogin::sendUpdateRequest()
 {
 	auto output = OutputMessagePool::getOutputMessage();
@@ -100,10 +104,9 @@ void ProtocolLogin::getCastingStreamsList()
 	disconnect();
 }
 
-void ProtocolLogin::getCharacterList(uint32_t accountNumber, const std::string& password)
+void ProtocolLogin::sendCharacterList(bool authenticated, const Account& account)
 {
-	Account account;
-	if (!IOLoginData::loginserverAuthentication(accountNumber, password, account)) {
+	if (!authenticated) {
 		disconnectClient("Account number or password is not correct.");
 		return;
 	}
@@ -221,5 +224,24 @@ void ProtocolLogin::onRecvFirstMessage(NetworkMessage& msg)
 			g_dispatcher.addTask(createTask(std::bind(&ProtocolLogin::getCastingStreamsList, thisPtr)));
 		return;
 	}
-	g_dispatcher.addTask(createTask(std::bind(&ProtocolLogin::getCharacterList, thisPtr, accountNumber, password)));
+
+	const uint32_t maxPendingLogins = g_config.getNumber(ConfigManager::MAX_PENDING_LOGINS);
+	if (pendingLogins.fetch_add(1) >= maxPendingLogins && maxPendingLogins != 0) {
+		pendingLogins.fetch_sub(1);
+		disconnectClient("Too many players are logging in right now.\nPlease try again in a moment.");
+		return;
+	}
+
+	// released once the reply is built, or right away if the job is never queued
+	std::shared_ptr<void> pendingLogin(nullptr, [](void*) { pendingLogins.fetch_sub(1); });
+
+	// authentication only needs the database, keep it away from the dispatcher
+	// so a login storm does not lag the game, the reply reads config and game
+	// state and is built back on the dispatcher
+	auto account = std::make_shared<Account>();
+	g_databaseTasks.addJob(accountNumber, [account, accountNumber, password](Database& db) {
+		return IOLoginData::loginserverAuthentication(accountNumber, password, *account, &db);
+	}, [thisPtr, account, pendingLogin](bool success) {
+		thisPtr->sendCharacterList(success, *account);
+	});
 }
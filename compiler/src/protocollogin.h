@@ -20,8 +20,11 @@
 #ifndef FS_PROTOCOLLOGIN_H_1238F4B473074DF2ABC595C29E81C46D
 #define FS_PROTOCOLLOGIN_H_1238F4B473074DF2ABC595C29E81C46D
 
+#include <atomic>
+
 #include "protocol.h"
 
+struct Account;
 class NetworkMessage;
 class OutputMessage;
 
@@ -44,8 +47,12 @@ class ProtocolLogin : public Protocol
 		void sendUpdateRequest();
 		void disconnectClient(const std::string& message);
 
-		void getCharacterList(uint32_t accountNumber, const std::string& password);
+		// runs on the dispatcher once the database worker has checked the password
+		void sendCharacterList(bool authenticated, const Account& account);
 		void getCastingStreamsList();
+
+		// logins handed to the database workers and not answered yet
+		static std::atomic<uint32_t> pendingLogins;
 };
 
 #endif
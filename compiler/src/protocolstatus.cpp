@@ -21,13 +21,17 @@
 
 #include "protocolstatus.h"
 #include "configmanager.h"
+#include "databasetasks.h"
 #include "game.h"
 #include "outputmessage.h"
+#include "protocolgame.h"
 
 extern ConfigManager g_config;
+extern DatabaseTasks g_databaseTasks;
 extern Game g_game;
 
 std::map<uint32_t, int64_t> ProtocolStatus::ipConnectMap;
+std::mutex ProtocolStatus::ipConnectLock;
 const uint64_t ProtocolStatus::start = OTSYS_TIME();
 
 enum RequestedInfo_t : uint16_t {
@@ -39,23 +43,29 @@ enum RequestedInfo_t : uint16_t {
 	REQUEST_EXT_PLAYERS_INFO = 1 << 5,
 	REQUEST_PLAYER_STATUS_INFO = 1 << 6,
 	REQUEST_SERVER_SOFTWARE_INFO = 1 << 7,
+	REQUEST_DATABASE_INFO = 1 << 8,
+	REQUEST_LOGIN_INFO = 1 << 9,
+	REQUEST_NETWORK_INFO = 1 << 10,
 };
 
 void ProtocolStatus::onRecvFirstMessage(NetworkMessage& msg)
 {
 	uint32_t ip = getIP();
-	if (ip != 0x0100007F) {
-		std::string ipStr = convertIPToString(ip);
-		if (ipStr != g_config.getString(ConfigManager::IP)) {
-			std::map<uint32_t, int64_t>::const_iterator it = ipConnectMap.find(ip);
-			if (it != ipConnectMap.end() && (OTSYS_TIME() < (it->second + g_config.getNumber(ConfigManager::STATUSQUERY_TIMEOUT)))) {
-				disconnect();
-				return;
+	{
+		std::lock_guard<std::mutex> lockClass(ipConnectLock);
+		if (ip != 0x0100007F) {
+			std::string ipStr = convertIPToString(ip);
+			if (ipStr != g_config.getString(ConfigManager::IP)) {
+				std::map<uint32_t, int64_t>::const_iterator it = ipConnectMap.find(ip);
+				if (it != ipConnectMap.end() && (OTSYS_TIME() < (it->second + g_config.getNumber(ConfigManager::STATUSQUERY_TIMEOUT)))) {
+					disconnect();
+					return;
+				}
 			}
 		}
-	}
 
-	ipConnectMap[ip] = OTSYS_TIME();
+		ipConnectMap[ip] = OTSYS_TIME();
+	}
 
 	switch (msg.getByte()) {
 		//XML info protocol
@@ -162,6 +172,30 @@ void ProtocolStatus::sendStatusString()
 	map.append_attribute("width") = std::to_string(mapWidth).c_str();
 	map.append_attribute("height") = std::to_string(mapHeight).c_str();
 
+	const DatabaseTasksStats dbStats = g_databaseTasks.getStats();
+	pugi::xml_node database = tsqp.append_child("database");
+	database.append_attribute("workers") = std::to_string(dbStats.workers).c_str();
+	database.append_attribute("queued") = std::to_string(dbStats.queued).c_str();
+	database.append_attribute("processed") = std::to_string(dbStats.processed).c_str();
+	database.append_attribute("waittotal") = std::to_string(dbStats.waitTotal).c_str();
+	database.append_attribute("waitmax") = std::to_string(dbStats.waitMax).c_str();
+	database.append_attribute("runtotal") = std::to_string(dbStats.runTotal).c_str();
+
+	const PlayerLoginStats& loginStats = ProtocolGame::getLoginStats();
+	pugi::xml_node logins = tsqp.append_child("logins");
+	logins.append_attribute("total") = std::to_string(loginStats.logins).c_str();
+	logins.append_attribute("fetchtotal") = std::to_string(loginStats.fetchTotal).c_str();
+	logins.append_attribute("fetchmax") = std::to_string(loginStats.fetchMax).c_str();
+	logins.append_attribute("placetotal") = std::to_string(loginStats.placeTotal).c_str();
+	logins.append_attribute("placemax") = std::to_string(loginStats.placeMax).c_str();
+
+	const ConnectionQueueStats queueStats = ConnectionManager::getInstance().getQueueStats();
+	pugi::xml_node network = tsqp.append_child("network");
+	network.append_attribute("connections") = std::to_string(queueStats.connections).c_str();
+	network.append_attribute("queuedmessages") = std::to_string(queueStats.queuedMessages).c_str();
+	network.append_attribute("queuedbytes") = std::to_string(queueStats.queuedBytes).c_str();
+	network.append_attribute("maxqueuedbytes") = std::to_string(queueStats.maxQueuedBytes).c_str();
+
 	pugi::xml_node motd = tsqp.append_child("motd");
 	motd.text() = g_config.getString(ConfigManager::MOTD).c_str();
 
@@ -242,6 +276,36 @@ void ProtocolStatus::sendInfo(uint16_t requestedInfo, const std::string& charact
 		output->addString(STATUS_SERVER_VERSION);
 		output->addString(CLIENT_VERSION_STR);
 	}
+
+	if (requestedInfo & REQUEST_DATABASE_INFO) {
+		output->addByte(0x40); // database queue info, times in microseconds
+		const DatabaseTasksStats dbStats = g_databaseTasks.getStats();
+		output->add<uint32_t>(dbStats.workers);
+		output->add<uint32_t>(dbStats.queued);
+		output->add<uint64_t>(dbStats.processed);
+		output->add<uint64_t>(dbStats.waitTotal);
+		output->add<uint64_t>(dbStats.waitMax);
+		output->add<uint64_t>(dbStats.runTotal);
+	}
+
+	if (requestedInfo & REQUEST_LOGIN_INFO) {
+		output->addByte(0x41); // game world login timings, in microseconds
+		const PlayerLoginStats& loginStats = ProtocolGame::getLoginStats();
+		output->add<uint64_t>(loginStats.logins);
+		output->add<uint64_t>(loginStats.fetchTotal);
+		output->add<uint64_t>(loginStats.fetchMax);
+		output->add<uint64_t>(loginStats.placeTotal);
+		output->add<uint64_t>(loginStats.placeMax);
+	}
+
+	if (requestedInfo & REQUEST_NETWORK_INFO) {
+		output->addByte(0x42); // output backlog over all connections
+		const ConnectionQueueStats queueStats = ConnectionManager::getInstance().getQueueStats();
+		output->add<uint32_t>(queueStats.connections);
+		output->add<uint64_t>(queueStats.queuedMessages);
+		output->add<uint64_t>(queueStats.queuedBytes);
+		output->add<uint32_t>(queueStats.maxQueuedBytes);
+	}
 	send(output);
 	disconnect();
 }
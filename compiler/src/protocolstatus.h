@@ -44,7 +44,9 @@ class ProtocolStatus final : public Protocol
 		static const uint64_t start;
 
 	protected:
+		// network threads run in parallel
 		static std::map<uint32_t, int64_t> ipConnectMap;
+		static std::mutex ipConnectLock;
 };
 
 #endif
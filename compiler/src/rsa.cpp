@@ -20,25 +20,60 @@
 #include "otpch.h"
 
 #include "rsa.h"
+#include "tools.h"
+
+namespace {
+
+// per-thread temporaries, allocated once at full size so a decrypt does not
+// touch the allocator
+struct Scratch {
+	Scratch() {
+		mpz_init2(c, 1024);
+		mpz_init2(m1, 1024);
+		mpz_init2(m2, 1024);
+		mpz_init2(h, 1024);
+	}
+	~Scratch() {
+		mpz_clear(c);
+		mpz_clear(m1);
+		mpz_clear(m2);
+		mpz_clear(h);
+	}
+
+	// non-copyable
+	Scratch(const Scratch&) = delete;
+	Scratch& operator=(const Scratch&) = delete;
+
+	mpz_t c, m1, m2, h;
+};
+
+thread_local Scratch scratch;
+
+}
 
 RSA::RSA()
 {
-	mpz_init(n);
-	mpz_init2(d, 1024);
+	mpz_init2(p, 512);
+	mpz_init2(q, 512);
+	mpz_init2(dp, 512);
+	mpz_init2(dq, 512);
+	mpz_init2(qInv, 512);
 }
 
 RSA::~RSA()
 {
-	mpz_clear(n);
-	mpz_clear(d);
+	mpz_clear(p);
+	mpz_clear(q);
+	mpz_clear(dp);
+	mpz_clear(dq);
+	mpz_clear(qInv);
 }
 
 void RSA::setKey(const char* pString, const char* qString)
 {
-	mpz_t p, q, e;
-	mpz_init2(p, 1024);
-	mpz_init2(q, 1024);
+	mpz_t e, d;
 	mpz_init(e);
+	mpz_init2(d, 1024);
 
 	mpz_set_str(p, pString, 10);
 	mpz_set_str(q, qString, 10);
@@ -46,9 +81,6 @@ void RSA::setKey(const char* pString, const char* qString)
 	// e = 65537
 	mpz_set_ui(e, 65537);
 
-	// n = p * q
-	mpz_mul(n, p, q);
-
 	mpz_t p_1, q_1, pq_1;
 	mpz_init2(p_1, 1024);
 	mpz_init2(q_1, 1024);
@@ -63,30 +95,134 @@ void RSA::setKey(const char* pString, const char* qString)
 	// d = e^-1 mod (p - 1)(q - 1)
 	mpz_invert(d, e, pq_1);
 
+	// dp = d mod (p - 1), dq = d mod (q - 1), qInv = q^-1 mod p
+	mpz_mod(dp, d, p_1);
+	mpz_mod(dq, d, q_1);
+	mpz_invert(qInv, q, p);
+
 	mpz_clear(p_1);
 	mpz_clear(q_1);
 	mpz_clear(pq_1);
 
-	mpz_clear(p);
-	mpz_clear(q);
 	mpz_clear(e);
+	mpz_clear(d);
 }
 
-void RSA::decrypt(char* msg) const 
+void RSA::decrypt(char* msg) const
 {
-	mpz_t c, m;
-	mpz_init2(c, 1024);
-	mpz_init2(m, 1024);
+	mpz_t& c = scratch.c;
+	mpz_t& m1 = scratch.m1;
+	mpz_t& m2 = scratch.m2;
+	mpz_t& h = scratch.h;
 
 	mpz_import(c, 128, 1, 1, 0, 0, msg);
 
-	// m = c^d mod n
-	mpz_powm(m, c, d, n);
+	// m1 = c^dp mod p, m2 = c^dq mod q
+	mpz_powm(m1, c, dp, p);
+	mpz_powm(m2, c, dq, q);
+
+	// h = qInv * (m1 - m2) mod p
+	mpz_sub(h, m1, m2);
+	mpz_mul(h, h, qInv);
+	mpz_mod(h, h, p);
 
-	size_t count = (mpz_sizeinbase(m, 2) + 7) / 8;
+	// m = m2 + h * q
+	mpz_mul(h, h, q);
+	mpz_add(m1, m2, h);
+
+	size_t count = (mpz_sizeinbase(m1, 2) + 7) / 8;
 	memset(msg, 0, 128 - count);
-	mpz_export(msg + (128 - count), nullptr, 1, 1, 0, 0, m);
+	mpz_export(msg + (128 - count), nullptr, 1, 1, 0, 0, m1);
+}
 
-	mpz_clear(c);
+std::string RSA::benchmark(uint32_t iterations) const
+{
+	// the key is only kept in CRT form, rebuild n and d for the plain modexp
+	mpz_t n, e, d, p_1, q_1, m, c, plain;
+	mpz_init2(n, 1024);
+	mpz_init(e);
+	mpz_init2(d, 1024);
+	mpz_init2(p_1, 512);
+	mpz_init2(q_1, 512);
+	mpz_init2(m, 1024);
+	mpz_init2(c, 1024);
+	mpz_init2(plain, 1024);
+
+	mpz_mul(n, p, q);
+	mpz_set_ui(e, 65537);
+	mpz_sub_ui(p_1, p, 1);
+	mpz_sub_ui(q_1, q, 1);
+	mpz_mul(d, p_1, q_1);
+	mpz_invert(d, e, d);
+
+	// random messages with a leading zero byte like the client sends, so they
+	// are always below n
+	std::mt19937& generator = getRandomGenerator();
+	std::uniform_int_distribution<uint16_t> randomByte(0, 0xFF);
+	std::vector<std::array<char, 128>> messages(iterations), ciphertexts(iterations);
+	for (uint32_t i = 0; i < iterations; ++i) {
+		std::array<char, 128>& message = messages[i];
+		message[0] = 0;
+		for (size_t j = 1; j < message.size(); ++j) {
+			message[j] = static_cast<char>(randomByte(generator));
+		}
+
+		mpz_import(m, 128, 1, 1, 0, 0, message.data());
+		mpz_powm(c, m, e, n);
+
+		std::array<char, 128>& ciphertext = ciphertexts[i];
+		size_t count = (mpz_sizeinbase(c, 2) + 7) / 8;
+		memset(ciphertext.data(), 0, 128 - count);
+		mpz_export(ciphertext.data() + (128 - count), nullptr, 1, 1, 0, 0, c);
+	}
+
+	uint32_t mismatches = 0;
+
+	std::vector<std::array<char, 128>> buffers = ciphertexts;
+	int64_t start = OTSYS_TIME();
+	for (std::array<char, 128>& buffer : buffers) {
+		decrypt(buffer.data());
+	}
+	int64_t elapsed = OTSYS_TIME() - start;
+
+	for (uint32_t i = 0; i < iterations; ++i) {
+		if (buffers[i] != messages[i]) {
+			++mismatches;
+		}
+	}
+
+	buffers = ciphertexts;
+	start = OTSYS_TIME();
+	for (std::array<char, 128>& buffer : buffers) {
+		mpz_import(c, 128, 1, 1, 0, 0, buffer.data());
+		mpz_powm(plain, c, d, n);
+
+		size_t count = (mpz_sizeinbase(plain, 2) + 7) / 8;
+		memset(buffer.data(), 0, 128 - count);
+		mpz_export(buffer.data() + (128 - count), nullptr, 1, 1, 0, 0, plain);
+	}
+	int64_t plainElapsed = OTSYS_TIME() - start;
+
+	for (uint32_t i = 0; i < iterations; ++i) {
+		if (buffers[i] != messages[i]) {
+			++mismatches;
+		}
+	}
+
+	mpz_clear(n);
+	mpz_clear(e);
+	mpz_clear(d);
+	mpz_clear(p_1);
+	mpz_clear(q_1);
 	mpz_clear(m);
+	mpz_clear(c);
+	mpz_clear(plain);
+
+	std::ostringstream ss;
+	ss << iterations << " random messages " << (mismatches == 0 ? "match" : "DIFFER") << " after both decrypts";
+	if (mismatches != 0) {
+		ss << " (" << mismatches << " mismatches)";
+	}
+	ss << "\ncrt: " << elapsed << " ms vs plain modexp " << plainElapsed << " ms\n";
+	return ss.str();
 }
@@ -35,9 +35,15 @@ class RSA
 		void setKey(const char* pString, const char* qString);
 		void decrypt(char* msg) const;
 
+		// times decrypt against a plain c^d mod n and checks both give back the
+		// message, for /benchmark rsa
+		std::string benchmark(uint32_t iterations) const;
+
 	private:
 		//use only GMP
-		mpz_t n, d;
+		// private key in CRT form: m = m2 + q * (qInv * (m1 - m2) mod p)
+		// with m1 = c^dp mod p and m2 = c^dq mod q
+		mpz_t p, q, dp, dq, qInv;
 };
 
 #endif
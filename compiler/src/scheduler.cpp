@@ -23,79 +23,225 @@
 
 void Scheduler::threadMain()
 {
+	std::vector<Task*> dueTasks;
 	std::unique_lock<std::mutex> eventLockUnique(eventLock, std::defer_lock);
 	while (getState() != THREAD_STATE_TERMINATED) {
-		std::cv_status ret = std::cv_status::no_timeout;
-
 		eventLockUnique.lock();
-		if (eventList.empty()) {
-			eventSignal.wait(eventLockUnique);
-		} else {
-			ret = eventSignal.wait_until(eventLockUnique, eventList.top()->getCycle());
-		}
 
-		// the mutex is locked again now...
-		if (ret == std::cv_status::timeout) {
-			// ok we had a timeout, so there has to be an event we have to execute...
-			SchedulerTask* task = eventList.top();
-			eventList.pop();
-
-			// check if the event was stopped
-			auto it = eventIds.find(task->getEventId());
-			if (it == eventIds.end()) {
-				eventLockUnique.unlock();
-				delete task;
-				continue;
+		advance(getTick(std::chrono::system_clock::now(), false));
+		if (readyTasks.empty()) {
+			wakeupTick = getNextTick();
+			if (wakeupTick == std::numeric_limits<uint64_t>::max()) {
+				eventSignal.wait(eventLockUnique);
+			} else {
+				eventSignal.wait_until(eventLockUnique, wheelStart + std::chrono::milliseconds(wakeupTick * SCHEDULER_TICK));
 			}
-			eventIds.erase(it);
+
+			// the mutex is locked again now, from here on the wheel is checked again anyway
+			wakeupTick = 0;
 			eventLockUnique.unlock();
+			continue;
+		}
+
+		dueTasks.swap(readyTasks);
+		eventLockUnique.unlock();
 
+		for (Task* task : dueTasks) {
 			task->setDontExpire();
-			g_dispatcher.addTask(task, true);
-		} else {
-			eventLockUnique.unlock();
 		}
+
+		// every event of this wakeup reaches the dispatcher at once
+		g_dispatcher.addTasks(dueTasks);
+		dueTasks.clear();
 	}
 }
 
-uint32_t Scheduler::addEvent(SchedulerTask* task)
+uint64_t Scheduler::getTick(std::chrono::system_clock::time_point time, bool roundUp) const
 {
-	bool do_signal = false;
-	eventLock.lock();
+	static constexpr int64_t tickDuration = std::chrono::microseconds(std::chrono::milliseconds(SCHEDULER_TICK)).count();
 
-	if (getState() == THREAD_STATE_RUNNING) {
-		// check if the event has a valid id
-		if (task->getEventId() == 0) {
-			// if not generate one
-			if (++lastEventId == 0) {
-				lastEventId = 1;
+	int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(time - wheelStart).count();
+	if (elapsed <= 0) {
+		return 0;
+	}
+
+	if (roundUp) {
+		return (elapsed + tickDuration - 1) / tickDuration;
+	}
+	return elapsed / tickDuration;
+}
+
+uint64_t Scheduler::getNextTick() const
+{
+	if (eventIds.empty()) {
+		return std::numeric_limits<uint64_t>::max();
+	}
+
+	uint64_t nextTick = std::numeric_limits<uint64_t>::max();
+	if (eventIds.size() > rootSize) {
+		// upper levels have to be cascaded when the root wheel wraps
+		nextTick = (currentTick | (WHEEL_ROOT_SIZE - 1)) + 1;
+	}
+
+	if (rootSize != 0) {
+		for (uint64_t tick = currentTick, last = std::min(nextTick, currentTick + WHEEL_ROOT_SIZE); tick < last; ++tick) {
+			if (slots[tick & (WHEEL_ROOT_SIZE - 1)].head) {
+				return tick;
 			}
+		}
+	}
+	return nextTick;
+}
+
+void Scheduler::insertTask(SchedulerTask* task)
+{
+	// events that are already due go to the tick being processed next
+	uint64_t tick = std::max(task->tick, currentTick);
+	uint64_t delta = tick - currentTick;
+
+	uint32_t slot;
+	if (delta < WHEEL_ROOT_SIZE) {
+		slot = tick & (WHEEL_ROOT_SIZE - 1);
+		++rootSize;
+	} else {
+		uint32_t level = 1;
+		uint32_t shift = WHEEL_ROOT_BITS;
+		while (level < WHEEL_LEVELS - 1 && delta >= (static_cast<uint64_t>(1) << (shift + WHEEL_LEVEL_BITS))) {
+			++level;
+			shift += WHEEL_LEVEL_BITS;
+		}
 
-			task->setEventId(lastEventId);
+		if (delta >= (static_cast<uint64_t>(1) << (shift + WHEEL_LEVEL_BITS))) {
+			// too far away, park it in the last slot and let it cascade down later
+			tick = currentTick + (static_cast<uint64_t>(1) << (shift + WHEEL_LEVEL_BITS)) - 1;
 		}
+		slot = WHEEL_ROOT_SIZE + (level - 1) * WHEEL_LEVEL_SIZE + ((tick >> shift) & (WHEEL_LEVEL_SIZE - 1));
+	}
 
-		// insert the event id in the list of active events
-		eventIds.insert(task->getEventId());
+	SchedulerSlot& list = slots[slot];
+	task->slot = slot;
+	task->prev = list.tail;
+	task->next = nullptr;
+	if (list.tail) {
+		list.tail->next = task;
+	} else {
+		list.head = task;
+	}
+	list.tail = task;
+}
 
-		// add the event to the queue
-		eventList.push(task);
+void Scheduler::unlinkTask(SchedulerTask* task)
+{
+	SchedulerSlot& list = slots[task->slot];
+	if (task->prev) {
+		task->prev->next = task->next;
+	} else {
+		list.head = task->next;
+	}
 
-		// if the list was empty or this event is the top in the list
-		// we have to signal it
-		do_signal = (task == eventList.top());
+	if (task->next) {
+		task->next->prev = task->prev;
 	} else {
+		list.tail = task->prev;
+	}
+
+	if (task->slot < WHEEL_ROOT_SIZE) {
+		--rootSize;
+	}
+	task->prev = task->next = nullptr;
+}
+
+void Scheduler::cascade(uint32_t level)
+{
+	uint32_t shift = WHEEL_ROOT_BITS + (level - 1) * WHEEL_LEVEL_BITS;
+	SchedulerSlot& list = slots[WHEEL_ROOT_SIZE + (level - 1) * WHEEL_LEVEL_SIZE + ((currentTick >> shift) & (WHEEL_LEVEL_SIZE - 1))];
+
+	SchedulerTask* task = list.head;
+	list.head = list.tail = nullptr;
+	while (task) {
+		SchedulerTask* next = task->next;
+		insertTask(task);
+		task = next;
+	}
+}
+
+void Scheduler::advance(uint64_t nowTick)
+{
+	while (currentTick <= nowTick) {
+		if (eventIds.empty()) {
+			currentTick = nowTick + 1;
+			break;
+		}
+
+		uint32_t index = currentTick & (WHEEL_ROOT_SIZE - 1);
+		if (index == 0) {
+			for (uint32_t level = 1; level < WHEEL_LEVELS; ++level) {
+				cascade(level);
+				if (((currentTick >> (WHEEL_ROOT_BITS + (level - 1) * WHEEL_LEVEL_BITS)) & (WHEEL_LEVEL_SIZE - 1)) != 0) {
+					break;
+				}
+			}
+		}
+
+		if (rootSize == 0) {
+			// nothing due before the next cascade
+			currentTick = std::min(nowTick + 1, (currentTick | (WHEEL_ROOT_SIZE - 1)) + 1);
+			continue;
+		}
+
+		SchedulerSlot& list = slots[index];
+		for (SchedulerTask* task = list.head; task; task = task->next) {
+			eventIds.erase(task->eventId);
+			readyTasks.push_back(task);
+			--rootSize;
+		}
+		list.head = list.tail = nullptr;
+		++currentTick;
+	}
+}
+
+uint32_t Scheduler::addEvent(SchedulerTask* task)
+{
+	bool do_signal = false;
+	eventLock.lock();
+
+	if (getState() != THREAD_STATE_RUNNING) {
 		eventLock.unlock();
 		delete task;
 		return 0;
 	}
 
+	// check if the event has a valid id
+	if (task->getEventId() == 0) {
+		// if not generate one
+		do {
+			if (++lastEventId == 0) {
+				lastEventId = 1;
+			}
+		} while (eventIds.find(lastEventId) != eventIds.end());
+
+		task->setEventId(lastEventId);
+	}
+
+	const uint32_t eventId = task->getEventId();
+
+	// insert the event id in the list of active events
+	eventIds[eventId] = task;
+
+	// add the event to the wheel
+	task->tick = getTick(task->getCycle(), true);
+	insertTask(task);
+
+	// wake the scheduler up if it sleeps past this event
+	do_signal = wakeupTick != 0 && task->tick < wakeupTick;
+
 	eventLock.unlock();
 
 	if (do_signal) {
 		eventSignal.notify_one();
 	}
 
-	return task->getEventId();
+	return eventId;
 }
 
 bool Scheduler::stopEvent(uint32_t eventid)
@@ -112,7 +258,10 @@ bool Scheduler::stopEvent(uint32_t eventid)
 		return false;
 	}
 
+	SchedulerTask* task = it->second;
 	eventIds.erase(it);
+	unlinkTask(task);
+	delete task;
 	return true;
 }
 
@@ -122,13 +271,19 @@ void Scheduler::shutdown()
 	eventLock.lock();
 
 	//this list should already be empty
-	while (!eventList.empty()) {
-		delete eventList.top();
-		eventList.pop();
+	for (const auto& it : eventIds) {
+		delete it.second;
 	}
 
 	eventIds.clear();
+	slots.fill(SchedulerSlot());
+	rootSize = 0;
+
+	// due but not handed to the dispatcher yet, they already left eventIds
+	for (Task* task : readyTasks) {
+		delete task;
+	}
+	readyTasks.clear();
 	eventLock.unlock();
 	eventSignal.notify_one();
 }
-
@@ -21,13 +21,31 @@
 #define FS_SCHEDULER_H_2905B3D5EAB34B4BA8830167262D2DC1
 
 #include "tasks.h"
-#include <unordered_set>
-#include <queue>
+#include <array>
 
 #include "thread_holder_base.h"
 
 static constexpr int32_t SCHEDULER_MINTICKS = 50;
 
+// Resolution of the timing wheel, delays are rounded up to a whole tick
+static constexpr int32_t SCHEDULER_TICK = 10;
+static_assert(SCHEDULER_MINTICKS % SCHEDULER_TICK == 0, "SCHEDULER_MINTICKS must be a multiple of SCHEDULER_TICK");
+
+// The root wheel covers 256 ticks, every upper level 64 slots of the level
+// below it, which gives 256 * 64^3 ticks (~7.7 days) before events are
+// parked in the last slot and re-inserted when it cascades
+static constexpr uint32_t WHEEL_ROOT_BITS = 8;
+static constexpr uint32_t WHEEL_LEVEL_BITS = 6;
+static constexpr uint32_t WHEEL_LEVELS = 4;
+static constexpr uint32_t WHEEL_ROOT_SIZE = 1 << WHEEL_ROOT_BITS;
+static constexpr uint32_t WHEEL_LEVEL_SIZE = 1 << WHEEL_LEVEL_BITS;
+static constexpr uint32_t WHEEL_SLOTS = WHEEL_ROOT_SIZE + (WHEEL_LEVELS - 1) * WHEEL_LEVEL_SIZE;
+
+class SchedulerTask;
+
+template <typename F>
+SchedulerTask* createSchedulerTask(uint32_t delay, F&& f);
+
 class SchedulerTask : public Task
 {
 	public:
@@ -42,23 +60,39 @@ class SchedulerTask : public Task
 			return expiration;
 		}
 
+		static void* operator new(size_t) {
+			return LockfreePoolingAllocator<SchedulerTask, TASK_FREE_LIST_CAPACITY>().allocate(1);
+		}
+		static void operator delete(void* p) {
+			LockfreePoolingAllocator<SchedulerTask, TASK_FREE_LIST_CAPACITY>().deallocate(static_cast<SchedulerTask*>(p), 1);
+		}
+
 	protected:
-		SchedulerTask(uint32_t delay, const std::function<void (void)>& f) : Task(delay, f) {}
+		template <typename F>
+		SchedulerTask(uint32_t delay, F&& f) : Task(delay, std::forward<F>(f)) {}
 
 		uint32_t eventId = 0;
 
-		friend SchedulerTask* createSchedulerTask(uint32_t, const std::function<void (void)>&);
+		// position in the timing wheel, only touched under Scheduler::eventLock
+		SchedulerTask* prev = nullptr;
+		SchedulerTask* next = nullptr;
+		uint64_t tick = 0;
+		uint32_t slot = 0;
+
+		template <typename F>
+		friend SchedulerTask* createSchedulerTask(uint32_t, F&&);
+		friend class Scheduler;
 };
 
-inline SchedulerTask* createSchedulerTask(uint32_t delay, const std::function<void (void)>& f)
+template <typename F>
+inline SchedulerTask* createSchedulerTask(uint32_t delay, F&& f)
 {
-	return new SchedulerTask(delay, f);
+	return new SchedulerTask(delay, std::forward<F>(f));
 }
 
-struct TaskComparator {
-	bool operator()(const SchedulerTask* lhs, const SchedulerTask* rhs) const {
-		return lhs->getCycle() > rhs->getCycle();
-	}
+struct SchedulerSlot {
+	SchedulerTask* head = nullptr;
+	SchedulerTask* tail = nullptr;
 };
 
 class Scheduler : public ThreadHolder<Scheduler>
@@ -71,13 +105,27 @@ class Scheduler : public ThreadHolder<Scheduler>
 
 		void threadMain();
 	protected:
+		uint64_t getTick(std::chrono::system_clock::time_point time, bool roundUp) const;
+		uint64_t getNextTick() const;
+
+		void insertTask(SchedulerTask* task);
+		void unlinkTask(SchedulerTask* task);
+		void cascade(uint32_t level);
+		void advance(uint64_t nowTick);
+
 		std::thread thread;
 		std::mutex eventLock;
 		std::condition_variable eventSignal;
 
 		uint32_t lastEventId {0};
-		std::priority_queue<SchedulerTask*, std::deque<SchedulerTask*>, TaskComparator> eventList;
-		std::unordered_set<uint32_t> eventIds;
+		std::unordered_map<uint32_t, SchedulerTask*> eventIds;
+
+		const std::chrono::system_clock::time_point wheelStart = std::chrono::system_clock::now();
+		uint64_t currentTick = 0;
+		uint64_t wakeupTick = 0;
+		uint32_t rootSize = 0;
+		std::array<SchedulerSlot, WHEEL_SLOTS> slots;
+		std::vector<Task*> readyTasks;
 };
 
 extern Scheduler g_scheduler;
@@ -20,6 +20,8 @@
 #ifndef FS_SCRIPT_H_2905B3D5EAB34B4BA8830167262D2DC1
 #define FS_SCRIPT_H_2905B3D5EAB34B4BA8830167262D2DC1
 
+#include <string_view>
+
 #include "tools.h"
 
 enum TOKEN
@@ -40,6 +42,7 @@ public:
 	{
 		Token = ENDOFFILE;
 		RecursionDepth = -1;
+		Errors = 0;
 	}
 
 	~ScriptReader()
@@ -47,22 +50,22 @@ public:
 		if (RecursionDepth != -1)
 		{
 			std::cout << "ScriptReader::~ScriptReader: File is still open.\n";
-			for (int i = RecursionDepth; i != -1; i = RecursionDepth)
+			while (RecursionDepth != -1)
 			{
-				if (fclose(File[i]))
-				{
-					std::cout << "ScriptReader::close: Error when closing the file.\n";
-				}
-				--RecursionDepth;
+				close();
 			}
 		}
 	}
 
 	TOKEN Token;
-	FILE* File[3];
+	// every open file is read whole and tokenized from memory
+	std::vector<char> Data[3];
+	std::string_view Input[3]; // not tokenized yet
 	int RecursionDepth;
-	char Filename[3][4096];
+	int Errors; // reported so far, a result with errors is never cached
+	std::string Filename[3];
 	std::string CurrentDirectory;
+	std::vector<std::string> IncludedFiles; // opened through @"...", in order
 	std::string String;
 	unsigned char Bytes[1000];
 	int Line[3];
@@ -74,77 +77,71 @@ public:
 
 	bool open(const std::string& FileName)
 	{
-		RecursionDepth++;
-		if (RecursionDepth == 3)
+		if (RecursionDepth == 2)
 		{
-			error("ScriptReader::open: too big recursion.\n");
 			error("Recursion depth too high.\n");
 			return false;
 		}
 
-		if (RecursionDepth > -1)
+		int depth = RecursionDepth + 1;
+		CurrentDirectory = FileName;
+		if (FileName.find('/') != std::string::npos) {
+			int32_t end = FileName.find_last_of('/');
+			CurrentDirectory = FileName.substr(0, end);
+			Filename[depth] = FileName.substr(end + 1);
+		} else {
+			Filename[depth] = FileName;
+		}
+
+		if (!readFile(FileName, Data[depth]))
 		{
-			CurrentDirectory = FileName;
-			if (FileName.find('/') != std::string::npos) {
-				int32_t end = FileName.find_last_of('/');
-				CurrentDirectory = FileName.substr(0, end);
-				strcpy(Filename[RecursionDepth], FileName.substr(end + 1, FileName.length() - end).c_str());
-			} else {
-				strcpy(Filename[RecursionDepth], FileName.c_str());
-			}
+			printf("ScriptReader::open: Can not open file %s.\n", FileName.c_str());
+			printf("Cannot open script-file\n");
+			return false;
+		}
 
-			File[RecursionDepth] = fopen(FileName.c_str(), "rb");
-			if (!File[RecursionDepth])
-			{
-				printf("ScriptReader::open: Can not open file %s.\n", FileName.c_str());
-				RecursionDepth--;
-				printf("Cannot open script-file\n");
-				return false;
-			}
+		RecursionDepth = depth;
+		Input[depth] = std::string_view(Data[depth].data(), Data[depth].size());
+		if (depth > 0)
+		{
+			IncludedFiles.push_back(FileName);
 		}
 
-		Line[RecursionDepth] = 1;
+		Line[depth] = 1;
 		return true;
 	}
 
 	void close()
 	{
-		int depth; // eax@1
-
-		depth = RecursionDepth;
-		if (depth == -1)
+		if (RecursionDepth == -1)
 		{
 			std::cout << "ScriptReader::close: Invalid recursion depth.\n";
 		} else
 		{
-			if (fclose(this->File[depth]))
-			{
-				std::cout << "ScriptReader::close: Error when closing file.\n";
-			}
+			Input[RecursionDepth] = std::string_view();
+			std::vector<char>().swap(Data[RecursionDepth]);
 			--RecursionDepth;
 		}
 	}
 
 	void error(const std::string& text)
 	{
-		int depth = this->RecursionDepth;
-		if (depth != -1)
+		++this->Errors;
+		if (this->RecursionDepth != -1)
 		{
-			printf("error in script-file \"%s\", line %d: %s\n", Filename[this->RecursionDepth], this->Line[this->RecursionDepth], text.c_str());
-			do
+			printf("error in script-file \"%s\", line %d: %s\n", Filename[this->RecursionDepth].c_str(), this->Line[this->RecursionDepth], text.c_str());
+			while (this->RecursionDepth != -1)
 			{
-				if (fclose(this->File[depth]))
-				{
-					std::cout << "ScriptReader::close: Error when closing file.\n";
-				}
-				--this->RecursionDepth;
-				depth = this->RecursionDepth;
-			} while (this->RecursionDepth != -1);
+				close();
+			}
 		}
 	}
 
 	void nextToken();
 
+	// tokenizes items.srv and every npc script, for /benchmark scripts
+	static std::string benchmark(uint32_t iterations);
+
 	std::string readIdentifier()
 	{
 		nextToken();
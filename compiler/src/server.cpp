@@ -36,13 +36,49 @@ ServiceManager::~ServiceManager()
 void ServiceManager::die()
 {
 	io_service.stop();
+	for (auto& service : connectionServices) {
+		service->stop();
+	}
+}
+
+void ServiceManager::initConnectionServices()
+{
+	if (!connectionServices.empty()) {
+		return;
+	}
+
+	int32_t threads = g_config.getNumber(ConfigManager::NETWORK_THREADS);
+	if (threads <= 0) {
+		threads = std::max<int32_t>(1, std::thread::hardware_concurrency());
+	}
+
+	for (int32_t i = 0; i < threads; ++i) {
+		connectionServices.emplace_back(new boost::asio::io_service(1));
+		connectionWork.emplace_back(new boost::asio::io_service::work(*connectionServices.back()));
+	}
+}
+
+boost::asio::io_service& ServiceManager::getConnectionService()
+{
+	return *connectionServices[nextConnectionService++ % connectionServices.size()];
 }
 
 void ServiceManager::run()
 {
 	assert(!running);
 	running = true;
+
+	std::vector<std::thread> threads;
+	threads.reserve(connectionServices.size());
+	for (auto& service : connectionServices) {
+		threads.emplace_back([&service]() { service->run(); });
+	}
+
 	io_service.run();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
 }
 
 void ServiceManager::stop()
@@ -63,6 +99,9 @@ void ServiceManager::stop()
 
 	acceptors.clear();
 
+	// let the pool threads return once their connections are gone
+	connectionWork.clear();
+
 	death_timer.expires_from_now(boost::posix_time::seconds(3));
 	death_timer.async_wait(std::bind(&ServiceManager::die, this));
 }
@@ -98,7 +137,7 @@ void ServicePort::accept()
 		return;
 	}
 
-	auto connection = ConnectionManager::getInstance().createConnection(io_service, shared_from_this());
+	auto connection = ConnectionManager::getInstance().createConnection(manager.getConnectionService(), shared_from_this());
 	acceptor->async_accept(connection->getSocket(), std::bind(&ServicePort::onAccept, shared_from_this(), connection, std::placeholders::_1));
 }
 
@@ -109,6 +148,8 @@ void ServicePort::onAccept(Connection_ptr connection, const boost::system::error
 			return;
 		}
 
+		connection->resolveIP();
+
 		auto remote_ip = connection->getIP();
 		if (remote_ip != 0 && g_bans.acceptConnection(remote_ip)) {
 			Service_ptr service = services.front();
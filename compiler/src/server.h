@@ -24,6 +24,7 @@
 #include <memory>
 
 class Protocol;
+class ServiceManager;
 
 class ServiceBase
 {
@@ -57,7 +58,7 @@ class Service final : public ServiceBase
 class ServicePort : public std::enable_shared_from_this<ServicePort>
 {
 	public:
-		explicit ServicePort(boost::asio::io_service& io_service) : io_service(io_service) {}
+		ServicePort(boost::asio::io_service& io_service, ServiceManager& manager) : io_service(io_service), manager(manager) {}
 		~ServicePort();
 
 		// non-copyable
@@ -80,6 +81,7 @@ class ServicePort : public std::enable_shared_from_this<ServicePort>
 		void accept();
 
 		boost::asio::io_service& io_service;
+		ServiceManager& manager;
 		std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor;
 		std::vector<Service_ptr> services;
 
@@ -107,13 +109,23 @@ class ServiceManager
 			return acceptors.empty() == false;
 		}
 
+		// connections are spread round-robin over the pool, each one keeps
+		// its io_service (and strand) for its whole lifetime
+		boost::asio::io_service& getConnectionService();
+
 	protected:
 		void die();
+		void initConnectionServices();
 
 		std::unordered_map<uint16_t, ServicePort_ptr> acceptors;
 
+		// acceptors and the shutdown timer, run by the thread calling run()
 		boost::asio::io_service io_service;
 		boost::asio::deadline_timer death_timer { io_service };
+
+		std::vector<std::unique_ptr<boost::asio::io_service>> connectionServices;
+		std::vector<std::unique_ptr<boost::asio::io_service::work>> connectionWork;
+		std::atomic<size_t> nextConnectionService{0};
 		bool running = false;
 };
 
@@ -125,12 +137,14 @@ bool ServiceManager::add(uint16_t port)
 		return false;
 	}
 
+	initConnectionServices();
+
 	ServicePort_ptr service_port;
 
 	auto foundServicePort = acceptors.find(port);
 
 	if (foundServicePort == acceptors.end()) {
-		service_port = std::make_shared<ServicePort>(io_service);
+		service_port = std::make_shared<ServicePort>(io_service, *this);
 		service_port->open(port);
 		acceptors[port] = service_port;
 	} else {
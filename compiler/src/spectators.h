@@ -0,0 +1,118 @@
+/**
+ * Tibia GIMUD Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2017  Alejandro Mujica <alejandrodemujica@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef FS_SPECTATORS_H_B6348D923F084CBD99B28B926C724197
+#define FS_SPECTATORS_H_B6348D923F084CBD99B28B926C724197
+
+class Creature;
+
+// Flat list of creatures returned by Map::getSpectators, the first
+// INLINE_CAPACITY entries live inside the object so typical queries never
+// touch the heap
+class SpectatorVec
+{
+	public:
+		static constexpr size_t INLINE_CAPACITY = 32;
+
+		using value_type = Creature*;
+		using iterator = Creature**;
+		using const_iterator = Creature* const*;
+
+		SpectatorVec() = default;
+		~SpectatorVec() {
+			if (data != inlineData) {
+				delete[] data;
+			}
+		}
+
+		SpectatorVec(const SpectatorVec& other) {
+			assign(other);
+		}
+		SpectatorVec& operator=(const SpectatorVec& other) {
+			if (this != &other) {
+				count = 0;
+				assign(other);
+			}
+			return *this;
+		}
+
+		iterator begin() { return data; }
+		iterator end() { return data + count; }
+		const_iterator begin() const { return data; }
+		const_iterator end() const { return data + count; }
+
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		void clear() { count = 0; }
+
+		bool contains(const Creature* creature) const {
+			return std::find(begin(), end(), creature) != end();
+		}
+
+		// set semantics, a creature is only stored once
+		void insert(Creature* creature) {
+			if (!contains(creature)) {
+				push_back(creature);
+			}
+		}
+
+		// no duplicate check, for callers that know the creature is new
+		void push_back(Creature* creature) {
+			if (count == capacity) {
+				reserve(capacity * 2);
+			}
+			data[count++] = creature;
+		}
+
+		void erase(const Creature* creature) {
+			auto it = std::find(begin(), end(), creature);
+			if (it != end()) {
+				*it = data[--count];
+			}
+		}
+
+		void reserve(size_t newCapacity) {
+			if (newCapacity <= capacity) {
+				return;
+			}
+
+			Creature** newData = new Creature*[newCapacity];
+			std::copy(begin(), end(), newData);
+			if (data != inlineData) {
+				delete[] data;
+			}
+			data = newData;
+			capacity = newCapacity;
+		}
+
+	private:
+		void assign(const SpectatorVec& other) {
+			reserve(other.count);
+			std::copy(other.begin(), other.end(), data);
+			count = other.count;
+		}
+
+		Creature* inlineData[INLINE_CAPACITY];
+		Creature** data = inlineData;
+		size_t count = 0;
+		size_t capacity = INLINE_CAPACITY;
+};
+
+#endif
@@ -20,79 +20,165 @@
 #include "otpch.h"
 
 #include "tasks.h"
-#include "game.h"
-
-extern Game g_game;
 
 void Dispatcher::threadMain()
 {
+	taskBatch.reserve(DISPATCHER_QUEUE_RESERVE);
+
 	// NOTE: second argument defer_lock is to prevent from immediate locking
 	std::unique_lock<std::mutex> taskLockUnique(taskLock, std::defer_lock);
 
 	while (getState() != THREAD_STATE_TERMINATED) {
-		// check if there are tasks waiting
-		taskLockUnique.lock();
+		runPriorityTasks();
 
-		if (taskList.empty()) {
-			//if the list is empty wait for signal
-			taskSignal.wait(taskLockUnique);
-		}
+		// take everything that is waiting in one go
+		taskList.consume_all([this](Task* task) {
+			taskBatch.push_back(task);
+		});
 
-		if (!taskList.empty()) {
-			// take the first task
-			Task* task = taskList.front();
-			taskList.pop_front();
-			taskLockUnique.unlock();
-
-			if (!task->hasExpired()) {
-				++dispatcherCycle;
-				// execute it
-				(*task)();
+		if (taskBatch.empty()) {
+			if (runFrame()) {
+				continue;
+			}
 
-				g_game.map.clearSpectatorCache();
+			taskLockUnique.lock();
+			sleeping.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (taskList.empty() && priorityList.empty()) {
+				//if both queues are empty wait for signal or the next frame
+				if (frameFunc) {
+					taskSignal.wait_until(taskLockUnique, nextFrame);
+				} else {
+					taskSignal.wait(taskLockUnique);
+				}
 			}
-			delete task;
-		} else {
+			sleeping.store(false);
 			taskLockUnique.unlock();
+			continue;
 		}
+
+		for (Task* task : taskBatch) {
+			if (getState() == THREAD_STATE_TERMINATED) {
+				delete task;
+				continue;
+			}
+
+			// scheduled tasks still run ahead of the rest of the batch
+			runPriorityTasks();
+			executeTask(task);
+		}
+		taskBatch.clear();
+
+		runFrame();
 	}
 }
 
-void Dispatcher::addTask(Task* task, bool push_front /*= false*/)
+bool Dispatcher::runFrame()
 {
-	bool do_signal = false;
+	if (!frameFunc || getState() == THREAD_STATE_TERMINATED) {
+		return false;
+	}
 
-	taskLock.lock();
+	auto now = std::chrono::steady_clock::now();
+	if (now < nextFrame) {
+		return false;
+	}
 
-	if (getState() == THREAD_STATE_RUNNING) {
-		do_signal = taskList.empty();
+	nextFrame += frameInterval;
+	if (nextFrame <= now) {
+		// we fell behind, do not try to catch up with a burst of frames
+		nextFrame = now + frameInterval;
+	}
 
-		if (push_front) {
-			taskList.push_front(task);
-		} else {
-			taskList.push_back(task);
+	++dispatcherCycle;
+	frameFunc();
+	if (epilogueFunc) {
+		epilogueFunc();
+	}
+	return true;
+}
+
+void Dispatcher::setFrame(uint32_t interval, std::function<void (void)> frame)
+{
+	frameFunc = std::move(frame);
+	frameInterval = std::chrono::milliseconds(interval);
+	nextFrame = std::chrono::steady_clock::now() + frameInterval;
+}
+
+void Dispatcher::setTaskEpilogue(std::function<void (void)> epilogue)
+{
+	epilogueFunc = std::move(epilogue);
+}
+
+void Dispatcher::executeTask(Task* task)
+{
+	if (!task->hasExpired()) {
+		++dispatcherCycle;
+		// execute it
+		(*task)();
+		if (epilogueFunc) {
+			epilogueFunc();
 		}
-	} else {
-		delete task;
 	}
+	delete task;
+}
 
-	taskLock.unlock();
+void Dispatcher::runPriorityTasks()
+{
+	priorityList.consume_all([this](Task* task) {
+		executeTask(task);
+	});
+}
 
-	// send a signal if the list was empty
-	if (do_signal) {
+void Dispatcher::signal()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping.load()) {
+		// the dispatcher holds taskLock until it is actually waiting
+		std::lock_guard<std::mutex> lockClass(taskLock);
 		taskSignal.notify_one();
 	}
 }
 
+void Dispatcher::addTask(Task* task, bool push_front /*= false*/)
+{
+	if (getState() != THREAD_STATE_RUNNING) {
+		delete task;
+		return;
+	}
+
+	if (push_front) {
+		priorityList.push(task);
+	} else {
+		taskList.push(task);
+	}
+
+	signal();
+}
+
+void Dispatcher::addTasks(const std::vector<Task*>& tasks)
+{
+	if (getState() != THREAD_STATE_RUNNING) {
+		for (Task* task : tasks) {
+			delete task;
+		}
+		return;
+	}
+
+	// scheduled tasks go to the priority lane, one wakeup for all of them
+	for (Task* task : tasks) {
+		priorityList.push(task);
+	}
+
+	signal();
+}
+
 void Dispatcher::shutdown()
 {
 	Task* task = createTask([this]() {
 		setState(THREAD_STATE_TERMINATED);
-		taskSignal.notify_one();
 	});
 
-	std::lock_guard<std::mutex> lockClass(taskLock);
-	taskList.push_back(task);
-
-	taskSignal.notify_one();
+	taskList.push(task);
+	signal();
 }
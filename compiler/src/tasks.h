@@ -21,19 +21,66 @@
 #define FS_TASKS_H_A66AC384766041E59DCA059DAB6E1976
 
 #include <condition_variable>
+#include <boost/lockfree/queue.hpp>
 #include "thread_holder_base.h"
+#include "lockfree.h"
 #include "enums.h"
 
 const int DISPATCHER_TASK_EXPIRATION = 2000;
 const auto SYSTEM_TIME_ZERO = std::chrono::system_clock::time_point(std::chrono::milliseconds(0));
 
+static constexpr size_t TASK_FREE_LIST_CAPACITY = 4096;
+static constexpr size_t DISPATCHER_QUEUE_RESERVE = 1024;
+
+// Type-erased void() callable that keeps small functors (the usual std::bind
+// of a member function and a few ids) inline instead of on the heap
+class TaskFunc
+{
+	public:
+		static constexpr size_t INLINE_SIZE = 64;
+
+		template <typename F>
+		explicit TaskFunc(F&& f) {
+			using Fn = typename std::decay<F>::type;
+			if constexpr (sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(Storage)) {
+				new (&storage) Fn(std::forward<F>(f));
+				invoker = [](void* p) { (*static_cast<Fn*>(p))(); };
+				destroyer = [](void* p) { static_cast<Fn*>(p)->~Fn(); };
+			} else {
+				*reinterpret_cast<Fn**>(&storage) = new Fn(std::forward<F>(f));
+				invoker = [](void* p) { (**static_cast<Fn**>(p))(); };
+				destroyer = [](void* p) { delete *static_cast<Fn**>(p); };
+			}
+		}
+		~TaskFunc() {
+			destroyer(&storage);
+		}
+
+		// non-copyable
+		TaskFunc(const TaskFunc&) = delete;
+		TaskFunc& operator=(const TaskFunc&) = delete;
+
+		void operator()() {
+			invoker(&storage);
+		}
+
+	private:
+		using Storage = typename std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type;
+
+		Storage storage;
+		void (*invoker)(void*);
+		void (*destroyer)(void*);
+};
+
 class Task
 {
 	public:
 		// DO NOT allocate this class on the stack
-		explicit Task(std::function<void (void)> f) : func(std::move(f)) {}
-		Task(uint32_t ms, std::function<void (void)> f) :
-			expiration(std::chrono::system_clock::now() + std::chrono::milliseconds(ms)), func(std::move(f)) {}
+		template <typename F>
+		explicit Task(F&& f) : func(std::forward<F>(f)) {}
+		template <typename F>
+		Task(uint32_t ms, F&& f) :
+			expiration(std::chrono::system_clock::now() + std::chrono::milliseconds(ms)), func(std::forward<F>(f)) {}
 
 		virtual ~Task() = default;
 		void operator()() {
@@ -51,27 +98,45 @@ class Task
 			return expiration < std::chrono::system_clock::now();
 		}
 
+		// tasks are created on every thread and released by the dispatcher,
+		// so their storage is recycled through a lock-free free list
+		static void* operator new(size_t) {
+			return LockfreePoolingAllocator<Task, TASK_FREE_LIST_CAPACITY>().allocate(1);
+		}
+		static void operator delete(void* p) {
+			LockfreePoolingAllocator<Task, TASK_FREE_LIST_CAPACITY>().deallocate(static_cast<Task*>(p), 1);
+		}
+
 	protected:
 		// Expiration has another meaning for scheduler tasks,
 		// then it is the time the task should be added to the
 		// dispatcher
 		std::chrono::system_clock::time_point expiration = SYSTEM_TIME_ZERO;
-		std::function<void (void)> func;
+		TaskFunc func;
 };
 
-inline Task* createTask(const std::function<void (void)>& f)
+template <typename F>
+inline Task* createTask(F&& f)
 {
-	return new Task(f);
+	return new Task(std::forward<F>(f));
 }
 
-inline Task* createTask(uint32_t expiration, const std::function<void (void)>& f)
+template <typename F>
+inline Task* createTask(uint32_t expiration, F&& f)
 {
-	return new Task(expiration, f);
+	return new Task(expiration, std::forward<F>(f));
 }
 
 class Dispatcher : public ThreadHolder<Dispatcher> {
 	public:
 		void addTask(Task* task, bool push_front = false);
+		void addTasks(const std::vector<Task*>& tasks);
+
+		// runs frame every interval milliseconds between tasks (tick loop mode),
+		// must be called from the dispatcher thread
+		void setFrame(uint32_t interval, std::function<void (void)> frame);
+		// runs after every task and frame, must be called from the dispatcher thread
+		void setTaskEpilogue(std::function<void (void)> epilogue);
 
 		void shutdown();
 
@@ -82,12 +147,27 @@ class Dispatcher : public ThreadHolder<Dispatcher> {
 		void threadMain();
 
 	protected:
+		void signal();
+		void executeTask(Task* task);
+		void runPriorityTasks();
+		bool runFrame();
+
 		std::thread thread;
 		std::mutex taskLock;
 		std::condition_variable taskSignal;
+		std::atomic<bool> sleeping {false};
 
-		std::list<Task*> taskList;
+		// multi-producer queues drained by the dispatcher thread only;
+		// priorityList takes the tasks that used to be pushed to the front
+		boost::lockfree::queue<Task*> taskList {DISPATCHER_QUEUE_RESERVE};
+		boost::lockfree::queue<Task*> priorityList {DISPATCHER_QUEUE_RESERVE};
+		std::vector<Task*> taskBatch;
 		uint64_t dispatcherCycle = 0;
+
+		std::function<void (void)> frameFunc;
+		std::function<void (void)> epilogueFunc;
+		std::chrono::milliseconds frameInterval {0};
+		std::chrono::steady_clock::time_point nextFrame;
 };
 
 extern Dispatcher g_dispatcher;
@@ -25,6 +25,7 @@
 #include "cylinder.h"
 #include "item.h"
 #include "tools.h"
+#include "spectators.h"
 
 class Creature;
 class Teleport;
@@ -35,7 +36,6 @@ class BedItem;
 
 typedef std::vector<Creature*> CreatureVector;
 typedef std::vector<Item*> ItemVector;
-typedef std::unordered_set<Creature*> SpectatorVec;
 
 enum tileflags_t : uint32_t {
 	TILESTATE_NONE = 0,
@@ -206,6 +206,9 @@ class Tile : public Cylinder
 		inline void resetFlag(uint32_t flag) {
 			this->flags &= ~flag;
 		}
+		uint32_t getFlags() const {
+			return flags;
+		}
 
 		ZoneType_t getZone() const {
 			if (hasFlag(TILESTATE_PROTECTIONZONE)) {
@@ -119,6 +119,15 @@ static void processSHA1MessageBlock(const uint8_t* messageBlock, uint32_t* H)
 	H[4] += E;
 }
 
+uint64_t updateDigest(uint64_t digest, const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		digest = (digest ^ bytes[i]) * 1099511628211ULL;
+	}
+	return digest;
+}
+
 std::string transformToSHA1(const std::string& input)
 {
 	uint32_t H[] = {
@@ -1141,3 +1150,23 @@ void getFilesInDirectory(const boost::filesystem::path& root, const std::string&
 		}
 	}
 }
+
+bool readFile(const std::string& fileName, std::vector<char>& data)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (!file) {
+		return false;
+	}
+
+	bool success = false;
+	if (fseek(file, 0, SEEK_END) == 0) {
+		long size = ftell(file);
+		if (size >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+			data.resize(size);
+			success = size == 0 || fread(data.data(), 1, size, file) == static_cast<size_t>(size);
+		}
+	}
+
+	fclose(file);
+	return success;
+}
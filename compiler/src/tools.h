@@ -30,6 +30,10 @@
 void printXMLError(const std::string& where, const std::string& fileName, const pugi::xml_parse_result& result);
 
 std::string transformToSHA1(const std::string& input);
+
+// FNV-1a, used to tell whether serialized data changed since it was last saved
+static constexpr uint64_t DIGEST_OFFSET = 14695981039346656037ULL;
+uint64_t updateDigest(uint64_t digest, const void* data, size_t size);
 uint8_t getLiquidColor(uint8_t type);
 
 void extractArticleAndName(std::string& data, std::string& article, std::string& name);
@@ -97,6 +101,8 @@ itemAttrTypes stringToItemAttribute(const std::string& str);
 const char* getReturnMessage(ReturnValue value);
 
 void getFilesInDirectory(const boost::filesystem::path& root, const std::string& ext, std::vector<boost::filesystem::path>& ret);
+// the whole file in one read
+bool readFile(const std::string& fileName, std::vector<char>& data);
 
 inline int64_t OTSYS_TIME()
 {
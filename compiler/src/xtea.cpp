@@ -0,0 +1,455 @@
+/**
+ * Tibia GIMUD Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2017  Alejandro Mujica <alejandrodemujica@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "otpch.h"
+
+#include "xtea.h"
+#include "tools.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define XTEA_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define XTEA_TARGET(arch) __attribute__((target(arch)))
+#else
+#define XTEA_TARGET(arch)
+#endif
+
+namespace xtea {
+
+namespace {
+
+constexpr uint32_t delta = 0x61C88647;
+constexpr int32_t rounds = 32;
+
+// the key schedule does not depend on the data, every lane of a SIMD kernel
+// adds the same value in a given half round
+struct RoundKeys {
+	uint32_t first[rounds];
+	uint32_t second[rounds];
+};
+
+void expandEncryptKey(const uint32_t* k, RoundKeys& rk)
+{
+	uint32_t sum = 0;
+	for (int32_t i = 0; i < rounds; ++i) {
+		rk.first[i] = sum + k[sum & 3];
+		sum -= delta;
+		rk.second[i] = sum + k[(sum >> 11) & 3];
+	}
+}
+
+void expandDecryptKey(const uint32_t* k, RoundKeys& rk)
+{
+	uint32_t sum = 0xC6EF3720;
+	for (int32_t i = 0; i < rounds; ++i) {
+		rk.first[i] = sum + k[(sum >> 11) & 3];
+		sum += delta;
+		rk.second[i] = sum + k[sum & 3];
+	}
+}
+
+void encryptBlocks(uint8_t* data, size_t blocks, const RoundKeys& rk)
+{
+	for (size_t b = 0; b < blocks; ++b, data += BLOCK_SIZE) {
+		uint32_t v0, v1;
+		memcpy(&v0, data, 4);
+		memcpy(&v1, data + 4, 4);
+
+		for (int32_t i = 0; i < rounds; ++i) {
+			v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ rk.first[i];
+			v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ rk.second[i];
+		}
+
+		memcpy(data, &v0, 4);
+		memcpy(data + 4, &v1, 4);
+	}
+}
+
+void decryptBlocks(uint8_t* data, size_t blocks, const RoundKeys& rk)
+{
+	for (size_t b = 0; b < blocks; ++b, data += BLOCK_SIZE) {
+		uint32_t v0, v1;
+		memcpy(&v0, data, 4);
+		memcpy(&v1, data + 4, 4);
+
+		for (int32_t i = 0; i < rounds; ++i) {
+			v1 -= ((v0 << 4 ^ v0 >> 5) + v0) ^ rk.first[i];
+			v0 -= ((v1 << 4 ^ v1 >> 5) + v1) ^ rk.second[i];
+		}
+
+		memcpy(data, &v0, 4);
+		memcpy(data + 4, &v1, 4);
+	}
+}
+
+#ifdef XTEA_X86
+// Blocks are stored as (v0, v1) pairs. Two loads hold 4 (or 8) blocks, a
+// shuffle splits them into a vector of v0 and a vector of v1 and the unpacks
+// at the end put them back in the original order.
+
+XTEA_TARGET("sse2") size_t encryptSSE2(uint8_t* data, size_t blocks, const RoundKeys& rk)
+{
+	size_t done = 0;
+	for (; done + 4 <= blocks; done += 4, data += 4 * BLOCK_SIZE) {
+		__m128i* p = reinterpret_cast<__m128i*>(data);
+		const __m128 a = _mm_castsi128_ps(_mm_loadu_si128(p));
+		const __m128 b = _mm_castsi128_ps(_mm_loadu_si128(p + 1));
+		__m128i v0 = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i v1 = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		for (int32_t i = 0; i < rounds; ++i) {
+			__m128i f = _mm_add_epi32(_mm_xor_si128(_mm_slli_epi32(v1, 4), _mm_srli_epi32(v1, 5)), v1);
+			v0 = _mm_add_epi32(v0, _mm_xor_si128(f, _mm_set1_epi32(static_cast<int32_t>(rk.first[i]))));
+			f = _mm_add_epi32(_mm_xor_si128(_mm_slli_epi32(v0, 4), _mm_srli_epi32(v0, 5)), v0);
+			v1 = _mm_add_epi32(v1, _mm_xor_si128(f, _mm_set1_epi32(static_cast<int32_t>(rk.second[i]))));
+		}
+
+		_mm_storeu_si128(p, _mm_castps_si128(_mm_unpacklo_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1))));
+		_mm_storeu_si128(p + 1, _mm_castps_si128(_mm_unpackhi_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1))));
+	}
+	return done;
+}
+
+XTEA_TARGET("sse2") size_t decryptSSE2(uint8_t* data, size_t blocks, const RoundKeys& rk)
+{
+	size_t done = 0;
+	for (; done + 4 <= blocks; done += 4, data += 4 * BLOCK_SIZE) {
+		__m128i* p = reinterpret_cast<__m128i*>(data);
+		const __m128 a = _mm_castsi128_ps(_mm_loadu_si128(p));
+		const __m128 b = _mm_castsi128_ps(_mm_loadu_si128(p + 1));
+		__m128i v0 = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i v1 = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		for (int32_t i = 0; i < rounds; ++i) {
+			__m128i f = _mm_add_epi32(_mm_xor_si128(_mm_slli_epi32(v0, 4), _mm_srli_epi32(v0, 5)), v0);
+			v1 = _mm_sub_epi32(v1, _mm_xor_si128(f, _mm_set1_epi32(static_cast<int32_t>(rk.first[i]))));
+			f = _mm_add_epi32(_mm_xor_si128(_mm_slli_epi32(v1, 4), _mm_srli_epi32(v1, 5)), v1);
+			v0 = _mm_sub_epi32(v0, _mm_xor_si128(f, _mm_set1_epi32(static_cast<int32_t>(rk.second[i]))));
+		}
+
+		_mm_storeu_si128(p, _mm_castps_si128(_mm_unpacklo_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1))));
+		_mm_storeu_si128(p + 1, _mm_castps_si128(_mm_unpackhi_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1))));
+	}
+	return done;
+}
+
+// the 256-bit shuffles and unpacks work per 128-bit lane, the block order in
+// between differs from SSE2 but the unpacks still invert the shuffles
+XTEA_TARGET("avx2") size_t encryptAVX2(uint8_t* data, size_t blocks, const RoundKeys& rk)
+{
+	size_t done = 0;
+	for (; done + 8 <= blocks; done += 8, data += 8 * BLOCK_SIZE) {
+		__m256i* p = reinterpret_cast<__m256i*>(data);
+		const __m256 a = _mm256_castsi256_ps(_mm256_loadu_si256(p));
+		const __m256 b = _mm256_castsi256_ps(_mm256_loadu_si256(p + 1));
+		__m256i v0 = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m256i v1 = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		for (int32_t i = 0; i < rounds; ++i) {
+			__m256i f = _mm256_add_epi32(_mm256_xor_si256(_mm256_slli_epi32(v1, 4), _mm256_srli_epi32(v1, 5)), v1);
+			v0 = _mm256_add_epi32(v0, _mm256_xor_si256(f, _mm256_set1_epi32(static_cast<int32_t>(rk.first[i]))));
+			f = _mm256_add_epi32(_mm256_xor_si256(_mm256_slli_epi32(v0, 4), _mm256_srli_epi32(v0, 5)), v0);
+			v1 = _mm256_add_epi32(v1, _mm256_xor_si256(f, _mm256_set1_epi32(static_cast<int32_t>(rk.second[i]))));
+		}
+
+		_mm256_storeu_si256(p, _mm256_castps_si256(_mm256_unpacklo_ps(_mm256_castsi256_ps(v0), _mm256_castsi256_ps(v1))));
+		_mm256_storeu_si256(p + 1, _mm256_castps_si256(_mm256_unpackhi_ps(_mm256_castsi256_ps(v0), _mm256_castsi256_ps(v1))));
+	}
+	return done;
+}
+
+XTEA_TARGET("avx2") size_t decryptAVX2(uint8_t* data, size_t blocks, const RoundKeys& rk)
+{
+	size_t done = 0;
+	for (; done + 8 <= blocks; done += 8, data += 8 * BLOCK_SIZE) {
+		__m256i* p = reinterpret_cast<__m256i*>(data);
+		const __m256 a = _mm256_castsi256_ps(_mm256_loadu_si256(p));
+		const __m256 b = _mm256_castsi256_ps(_mm256_loadu_si256(p + 1));
+		__m256i v0 = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m256i v1 = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+		for (int32_t i = 0; i < rounds; ++i) {
+			__m256i f = _mm256_add_epi32(_mm256_xor_si256(_mm256_slli_epi32(v0, 4), _mm256_srli_epi32(v0, 5)), v0);
+			v1 = _mm256_sub_epi32(v1, _mm256_xor_si256(f, _mm256_set1_epi32(static_cast<int32_t>(rk.first[i]))));
+			f = _mm256_add_epi32(_mm256_xor_si256(_mm256_slli_epi32(v1, 4), _mm256_srli_epi32(v1, 5)), v1);
+			v0 = _mm256_sub_epi32(v0, _mm256_xor_si256(f, _mm256_set1_epi32(static_cast<int32_t>(rk.second[i]))));
+		}
+
+		_mm256_storeu_si256(p, _mm256_castps_si256(_mm256_unpacklo_ps(_mm256_castsi256_ps(v0), _mm256_castsi256_ps(v1))));
+		_mm256_storeu_si256(p + 1, _mm256_castps_si256(_mm256_unpackhi_ps(_mm256_castsi256_ps(v0), _mm256_castsi256_ps(v1))));
+	}
+	return done;
+}
+#endif
+
+enum Kernel_t {
+	KERNEL_SCALAR,
+	KERNEL_SSE2,
+	KERNEL_AVX2,
+};
+
+const char* kernelNames[] = {"scalar", "sse2", "avx2"};
+
+Kernel_t detectKernel()
+{
+#if defined(XTEA_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return KERNEL_AVX2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return KERNEL_SSE2;
+	}
+#elif defined(XTEA_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	const bool sse2 = (info[3] & (1 << 26)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+		__cpuidex(info, 7, 0);
+		if ((info[1] & (1 << 5)) != 0) {
+			return KERNEL_AVX2;
+		}
+	}
+	if (sse2) {
+		return KERNEL_SSE2;
+	}
+#endif
+	return KERNEL_SCALAR;
+}
+
+void encryptWith(Kernel_t kernel, uint8_t* data, size_t length, const uint32_t* key)
+{
+	RoundKeys rk;
+	expandEncryptKey(key, rk);
+
+	const size_t blocks = length / BLOCK_SIZE;
+	size_t done = 0;
+#ifdef XTEA_X86
+	if (kernel >= KERNEL_AVX2) {
+		done += encryptAVX2(data, blocks, rk);
+	}
+	if (kernel >= KERNEL_SSE2) {
+		done += encryptSSE2(data + done * BLOCK_SIZE, blocks - done, rk);
+	}
+#endif
+	encryptBlocks(data + done * BLOCK_SIZE, blocks - done, rk);
+}
+
+void decryptWith(Kernel_t kernel, uint8_t* data, size_t length, const uint32_t* key)
+{
+	RoundKeys rk;
+	expandDecryptKey(key, rk);
+
+	const size_t blocks = length / BLOCK_SIZE;
+	size_t done = 0;
+#ifdef XTEA_X86
+	if (kernel >= KERNEL_AVX2) {
+		done += decryptAVX2(data, blocks, rk);
+	}
+	if (kernel >= KERNEL_SSE2) {
+		done += decryptSSE2(data + done * BLOCK_SIZE, blocks - done, rk);
+	}
+#endif
+	decryptBlocks(data + done * BLOCK_SIZE, blocks - done, rk);
+}
+
+// a kernel is only used if it matches the reference on a buffer that covers
+// the wide path, the narrow path and the scalar tail
+bool verifyKernel(Kernel_t kernel)
+{
+	static constexpr uint32_t key[] = {0x9E3779B9, 0x01234567, 0x89ABCDEF, 0xFEDCBA98};
+
+	uint8_t plain[8 * 4 * BLOCK_SIZE + 7 * BLOCK_SIZE];
+	for (size_t i = 0; i < sizeof(plain); ++i) {
+		plain[i] = static_cast<uint8_t>(i * 131 + 17);
+	}
+
+	uint8_t expected[sizeof(plain)];
+	memcpy(expected, plain, sizeof(plain));
+	encryptScalar(expected, sizeof(expected), key);
+
+	uint8_t actual[sizeof(plain)];
+	memcpy(actual, plain, sizeof(plain));
+	encryptWith(kernel, actual, sizeof(actual), key);
+	if (memcmp(actual, expected, sizeof(actual)) != 0) {
+		return false;
+	}
+
+	decryptWith(kernel, actual, sizeof(actual), key);
+	return memcmp(actual, plain, sizeof(plain)) == 0;
+}
+
+Kernel_t selectKernel()
+{
+	Kernel_t kernel = detectKernel();
+	while (kernel != KERNEL_SCALAR && !verifyKernel(kernel)) {
+		std::cout << "[Warning - xtea] " << kernelNames[kernel] << " kernel does not match the reference, not using it." << std::endl;
+		kernel = static_cast<Kernel_t>(kernel - 1);
+	}
+	return kernel;
+}
+
+Kernel_t getKernel()
+{
+	static const Kernel_t kernel = selectKernel();
+	return kernel;
+}
+
+}
+
+void encrypt(uint8_t* data, size_t length, const uint32_t* key)
+{
+	encryptWith(getKernel(), data, length, key);
+}
+
+void decrypt(uint8_t* data, size_t length, const uint32_t* key)
+{
+	decryptWith(getKernel(), data, length, key);
+}
+
+void encryptScalar(uint8_t* data, size_t length, const uint32_t* key)
+{
+	const uint32_t k[] = {key[0], key[1], key[2], key[3]};
+	for (size_t readPos = 0; readPos < length; readPos += BLOCK_SIZE) {
+		uint32_t v0;
+		memcpy(&v0, data + readPos, 4);
+		uint32_t v1;
+		memcpy(&v1, data + readPos + 4, 4);
+
+		uint32_t sum = 0;
+
+		for (int32_t i = rounds; --i >= 0;) {
+			v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + k[sum & 3]);
+			sum -= delta;
+			v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + k[(sum >> 11) & 3]);
+		}
+
+		memcpy(data + readPos, &v0, 4);
+		memcpy(data + readPos + 4, &v1, 4);
+	}
+}
+
+void decryptScalar(uint8_t* data, size_t length, const uint32_t* key)
+{
+	const uint32_t k[] = {key[0], key[1], key[2], key[3]};
+	for (size_t readPos = 0; readPos < length; readPos += BLOCK_SIZE) {
+		uint32_t v0;
+		memcpy(&v0, data + readPos, 4);
+		uint32_t v1;
+		memcpy(&v1, data + readPos + 4, 4);
+
+		uint32_t sum = 0xC6EF3720;
+
+		for (int32_t i = rounds; --i >= 0;) {
+			v1 -= ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + k[(sum >> 11) & 3]);
+			sum += delta;
+			v0 -= ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + k[sum & 3]);
+		}
+
+		memcpy(data + readPos, &v0, 4);
+		memcpy(data + readPos + 4, &v1, 4);
+	}
+}
+
+const char* getKernelName()
+{
+	return kernelNames[getKernel()];
+}
+
+std::string benchmark(uint32_t iterations)
+{
+	std::mt19937& generator = getRandomGenerator();
+	std::uniform_int_distribution<uint32_t> randomWord;
+	auto randomize = [&](uint8_t* data, size_t length) {
+		for (size_t i = 0; i < length; i += 4) {
+			const uint32_t word = randomWord(generator);
+			memcpy(data + i, &word, 4);
+		}
+	};
+
+	// random keys and lengths so every kernel runs its wide path, narrow path
+	// and scalar tail against the reference
+	std::vector<uint8_t> plain, expected, actual;
+	uint32_t mismatches = 0;
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t key[4];
+		randomize(reinterpret_cast<uint8_t*>(key), sizeof(key));
+
+		plain.resize(std::uniform_int_distribution<size_t>(1, 512)(generator) * BLOCK_SIZE);
+		randomize(plain.data(), plain.size());
+
+		expected = plain;
+		encryptScalar(expected.data(), expected.size(), key);
+		actual = plain;
+		encrypt(actual.data(), actual.size(), key);
+		if (actual != expected) {
+			++mismatches;
+			continue;
+		}
+
+		decryptScalar(expected.data(), expected.size(), key);
+		decrypt(actual.data(), actual.size(), key);
+		if (actual != expected || actual != plain) {
+			++mismatches;
+		}
+	}
+
+	uint32_t key[4];
+	randomize(reinterpret_cast<uint8_t*>(key), sizeof(key));
+
+	std::vector<uint8_t> buffer(64 * 1024);
+	randomize(buffer.data(), buffer.size());
+
+	const uint64_t bytes = static_cast<uint64_t>(buffer.size()) * iterations;
+	auto measure = [&](void (*function)(uint8_t*, size_t, const uint32_t*)) {
+		int64_t start = OTSYS_TIME();
+		for (uint32_t i = 0; i < iterations; ++i) {
+			function(buffer.data(), buffer.size(), key);
+		}
+		return std::max<int64_t>(1, OTSYS_TIME() - start);
+	};
+
+	std::ostringstream ss;
+	ss << "kernel " << getKernelName() << ", 256 random buffers " << (mismatches == 0 ? "match" : "DIFFER from") << " the scalar reference";
+	if (mismatches != 0) {
+		ss << " (" << mismatches << " mismatches)";
+	}
+	ss << '\n';
+
+	for (const auto& it : {std::make_pair("encrypt", std::make_pair(&encrypt, &encryptScalar)), std::make_pair("decrypt", std::make_pair(&decrypt, &decryptScalar))}) {
+		int64_t elapsed = measure(it.second.first);
+		int64_t scalarElapsed = measure(it.second.second);
+		ss << it.first << ": " << bytes / 1024 << " KB, " << elapsed << " ms (" << (bytes / 1000) / elapsed << " MB/s) vs scalar "
+		   << scalarElapsed << " ms (" << (bytes / 1000) / scalarElapsed << " MB/s)\n";
+	}
+	return ss.str();
+}
+
+}
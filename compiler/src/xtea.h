@@ -0,0 +1,48 @@
+/**
+ * Tibia GIMUD Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2017  Alejandro Mujica <alejandrodemujica@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_XTEA_H_1DE56F117770460AB9E1867FB2611987
+#define FS_XTEA_H_1DE56F117770460AB9E1867FB2611987
+
+// XTEA in ECB mode as used by the client protocol. Every 8-byte block is
+// independent, so the SIMD kernels run 4 (SSE2) or 8 (AVX2) blocks per pass.
+// The kernel is picked once from the CPU features and checked against the
+// scalar one before it is used.
+namespace xtea {
+
+static constexpr size_t BLOCK_SIZE = 8;
+
+// length must be a multiple of BLOCK_SIZE
+void encrypt(uint8_t* data, size_t length, const uint32_t* key);
+void decrypt(uint8_t* data, size_t length, const uint32_t* key);
+
+// reference implementation, one block at a time
+void encryptScalar(uint8_t* data, size_t length, const uint32_t* key);
+void decryptScalar(uint8_t* data, size_t length, const uint32_t* key);
+
+// "avx2", "sse2" or "scalar"
+const char* getKernelName();
+
+// times the selected kernel against the scalar one and checks that both give
+// the same output on random data, for /benchmark xtea
+std::string benchmark(uint32_t iterations);
+
+}
+
+#endif
@@ -115,6 +115,9 @@ bindOnlyGlobalAddress = false
 loginProtocolPort = 7171
 gameProtocolPort = 7172
 statusProtocolPort = 7171
+-- NOTE: threads reading, writing and encrypting client traffic, every
+-- connection stays on one of them, 0 means one per CPU core
+networkThreads = 0
 maxPlayers = 2000
 motd = "Welcome to TibiaCore!"
 onePlayerOnlinePerAccount = true
@@ -123,6 +126,13 @@ serverName = "TibiaCore"
 statusTimeout = 5000
 replaceKickOnLogin = true
 maxPacketsPerSecond = -1
+-- NOTE: logins waiting for the database, further clients are asked to
+-- retry in a moment, 0 means no limit
+maxPendingLogins = 100
+-- NOTE: bytes a client may have waiting on its socket before window,
+-- chat and other low priority packets are held back for a later flush,
+-- 0 means no limit
+outputFlushBudget = 32768
 autoStackCumulatives = true
 moneyRate = 1
 
@@ -144,6 +154,12 @@ timeBetweenExActions = 1000
 -- NOTE: set mapName WITHOUT .otbm at the end
 mapName = "map"
 mapAuthor = "CipSoft"
+-- NOTE: threads decoding tile areas at startup, 0 means one per CPU core
+-- and 1 loads the map on the main thread only
+mapLoaderThreads = 0
+-- NOTE: mapChecksum prints a digest of every tile after loading, the same map
+-- must give the same value whatever mapLoaderThreads is, it slows down startup
+mapChecksum = false
 
 -- MySQL
 mysqlHost = "127.0.0.1"
@@ -153,6 +169,9 @@ mysqlDatabase = "tibiacore"
 mysqlPort = 3306
 mysqlSock = ""
 encryptionType = "sha1"
+-- NOTE: every worker opens its own connection, asynchronous queries and
+-- player saves are spread over them, all work for one player stays in order
+databaseWorkers = 2
 
 -- Misc.
 allowChangeOutfit = true
@@ -186,6 +205,13 @@ deSpawnRadius = 0
 warnUnsafeScripts = true
 convertUnsafeScripts = true
 
+-- Game loop
+-- NOTE: tickLoop runs creature thinking, decay, light and the network flush
+-- once per fixed frame of tickLoopInterval milliseconds on the dispatcher
+-- instead of scheduling each of them separately
+tickLoop = false
+tickLoopInterval = 50
+
 -- Startup
 -- NOTE: defaultPriority only works on Windows and sets process
 -- priority, valid values are: "normal", "above-normal", "high"